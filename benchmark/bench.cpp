@@ -0,0 +1,255 @@
+#include <unistd.h> // for getopt, sysconf
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "common_defs.h"
+#include "csv_defs.h"
+#include "dialect.h"
+#include "find_indexes.h"
+#include "io_util.h"
+#include "mem_util.h"
+#include "simd_kernels.h"
+#include "synthetic.h"
+#include "timing.h"
+using namespace std;
+
+// The benchmark suite: find_indexes over synthetic corpora that vary one
+// property at a time from a base case (8-byte fields, no quotes, LF, 8
+// columns, half the last-level cache up to 64 MiB), with each kernel the
+// CPU has.
+//
+// simdcsv_bench [-i <iterations>] [-k <kernel>] [-j] [-q]
+//   -i  runs per measurement (default: enough for about 1 GB, 5 to 1000)
+//   -k  only this kernel
+//   -j  JSON output, one object, for tracking regressions across releases
+//   -q  quick: leave out the inputs larger than the last-level cache
+
+struct Result {
+  const CorpusSpec *spec;
+  size_t bytes;
+  const char *kernel;
+  uint64_t n_indexes;
+  double best;  // seconds, the fastest run
+  double cycles; // per byte, over all runs; negative without perf events
+  double instructions;
+  double branch_misses;
+};
+
+static size_t last_level_cache() {
+  long llc = -1;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+  llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+  if (llc <= 0) {
+    llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+  }
+#endif
+  return llc > 0 ? llc : 32 << 20;
+}
+
+static vector<CorpusSpec> scenarios(size_t llc, bool quick) {
+  CorpusSpec base;
+  base.name = "base";
+  base.size = std::min<size_t>(llc / 2, 64 << 20);
+  vector<CorpusSpec> all;
+  all.push_back(base);
+  for (size_t w : {2, 32, 128}) {
+    CorpusSpec s = base;
+    s.name = "width-" + to_string(w);
+    s.field_width = w;
+    all.push_back(s);
+  }
+  for (double q : {0.1, 0.5, 1.0}) {
+    CorpusSpec s = base;
+    s.name = "quoted-" + to_string(int(q * 100)) + "%";
+    s.quoted = q;
+    all.push_back(s);
+  }
+  {
+    CorpusSpec s = base;
+    s.name = "newlines-10%";
+    s.quoted = 0.5;
+    s.newlines = 0.1;
+    all.push_back(s);
+  }
+  {
+    CorpusSpec s = base;
+    s.name = "crlf";
+    s.crlf = true;
+    all.push_back(s);
+  }
+  for (size_t c : {1, 64}) {
+    CorpusSpec s = base;
+    s.name = "columns-" + to_string(c);
+    s.columns = c;
+    all.push_back(s);
+  }
+  // L1 and L2 resident, then out of the cache; at most 512 MiB, since the
+  // index takes four times the corpus
+  vector<pair<string, size_t>> sizes = {{"size-16KiB", 16 << 10},
+                                        {"size-256KiB", 256 << 10}};
+  if (!quick) {
+    sizes.push_back({"size-2xLLC", std::min<size_t>(2 * llc, 512 << 20)});
+    sizes.push_back({"size-10xLLC", std::min<size_t>(10 * llc, 512 << 20)});
+  }
+  for (const auto &size : sizes) {
+    if (size.second == all.back().size) {
+      continue; // capped to the same size as the last
+    }
+    CorpusSpec s = base;
+    s.name = size.first;
+    s.size = size.second;
+    all.push_back(s);
+  }
+  return all;
+}
+
+static void json_number(double x) {
+  if (x < 0) {
+    cout << "null";
+  } else {
+    cout << x;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t iterations = 0;
+  const char *only_kernel = nullptr;
+  bool json = false;
+  bool quick = false;
+  int c;
+  while ((c = getopt(argc, argv, "i:k:jq")) != -1) {
+    switch (c) {
+    case 'i':
+      iterations = atoi(optarg);
+      break;
+    case 'k':
+      only_kernel = optarg;
+      break;
+    case 'j':
+      json = true;
+      break;
+    case 'q':
+      quick = true;
+      break;
+    default:
+      cerr << "Usage: " << argv[0] << " [-i <iterations>] [-k <kernel>] [-j] [-q]" << endl;
+      return EXIT_FAILURE;
+    }
+  }
+  vector<const Kernel *> kernels;
+  for (const Kernel *k : all_kernels()) {
+    if (k->supported() && (only_kernel == nullptr || strcmp(k->name, only_kernel) == 0)) {
+      kernels.push_back(k);
+    }
+  }
+  if (kernels.empty()) {
+    cerr << "kernel " << only_kernel << " is not available" << endl;
+    return EXIT_FAILURE;
+  }
+
+  size_t llc = last_level_cache();
+  vector<CorpusSpec> specs = scenarios(llc, quick);
+  vector<int> evts = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                      PERF_COUNT_HW_BRANCH_MISSES};
+  TimingAccumulator ta(1, evts);
+  vector<Result> results;
+  bool consistent = true;
+  for (const CorpusSpec &spec : specs) {
+    string corpus = generate_corpus(spec);
+    size_t len = corpus.size();
+    uint8_t *buf = allocate_padded_buffer(len, CSV_PADDING);
+    uint32_t *indexes = new uint32_t[len + CSV_PADDING];
+    if (buf == nullptr) {
+      cerr << "could not allocate memory" << endl;
+      delete[] indexes;
+      return EXIT_FAILURE;
+    }
+    memcpy(buf, corpus.data(), len);
+    string().swap(corpus);
+    memset(buf + len, 0, CSV_PADDING);
+    Dialect dialect;
+    dialect.crlf = spec.crlf;
+    size_t runs = iterations != 0
+                      ? iterations
+                      : std::min<size_t>(1000, std::max<size_t>(5, (size_t(1) << 30) / len));
+    uint64_t expected = 0; // the indexes found by the first kernel
+    for (const Kernel *k : kernels) {
+      select_kernel(k->name);
+      ParsedCSV pcsv;
+      pcsv.indexes = indexes;
+      // once to fault in the index, and for the count
+      find_indexes(buf, len + CSV_PADDING, pcsv, dialect);
+      Result r = {&spec, len, k->name, pcsv.n_indexes, 0, -1, -1, -1};
+      vector<uint64_t> before = ta.results;
+      for (size_t i = 0; i < runs; i++) {
+        auto start = chrono::steady_clock::now();
+        {
+          TimingPhase p(ta, 0);
+          find_indexes(buf, len + CSV_PADDING, pcsv, dialect);
+        }
+        double t = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        r.best = (i == 0 || t < r.best) ? t : r.best;
+      }
+      if (ta.working) {
+        double volume = double(len) * runs;
+        r.cycles = (ta.results[0] - before[0]) / volume;
+        r.instructions = (ta.results[1] - before[1]) / volume;
+        r.branch_misses = (ta.results[2] - before[2]) / volume;
+      }
+      if (k == kernels[0]) {
+        expected = r.n_indexes;
+      } else if (r.n_indexes != expected) {
+        cerr << k->name << " found " << r.n_indexes << " indexes in " << spec.name
+             << ", " << kernels[0]->name << " " << expected << endl;
+        consistent = false;
+      }
+      results.push_back(r);
+    }
+    aligned_free(buf);
+    delete[] indexes;
+  }
+
+  if (json) {
+    cout << "{\n  \"llc_bytes\": " << llc << ",\n  \"perf_events\": "
+         << (ta.working ? "true" : "false") << ",\n  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+      const Result &r = results[i];
+      cout << (i == 0 ? "\n" : ",\n") << "    {\"scenario\": \"" << r.spec->name
+           << "\", \"kernel\": \"" << r.kernel << "\", \"bytes\": " << r.bytes
+           << ", \"field_width\": " << r.spec->field_width
+           << ", \"quoted\": " << r.spec->quoted
+           << ", \"newlines\": " << r.spec->newlines
+           << ", \"crlf\": " << (r.spec->crlf ? "true" : "false")
+           << ", \"columns\": " << r.spec->columns
+           << ", \"indexes\": " << r.n_indexes
+           << ", \"gb_per_s\": " << r.bytes / r.best / (1024 * 1024 * 1024)
+           << ", \"cycles_per_byte\": ";
+      json_number(r.cycles);
+      cout << ", \"instructions_per_byte\": ";
+      json_number(r.instructions);
+      cout << ", \"branch_misses_per_byte\": ";
+      json_number(r.branch_misses);
+      cout << "}";
+    }
+    cout << "\n  ]\n}" << endl;
+  } else {
+    cout << "last-level cache: " << llc << " bytes" << endl;
+    cout << "scenario\tbytes\tkernel\tGB/s\tcycles/B\tinstr/B" << endl;
+    for (const Result &r : results) {
+      cout << r.spec->name << "\t" << r.bytes << "\t" << r.kernel << "\t"
+           << r.bytes / r.best / (1024 * 1024 * 1024) << "\t";
+      if (r.cycles >= 0) {
+        cout << r.cycles << "\t" << r.instructions;
+      } else {
+        cout << "-\t-";
+      }
+      cout << endl;
+    }
+  }
+  return consistent ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,75 @@
+#ifndef SIMDCSV_SYNTHETIC_H
+#define SIMDCSV_SYNTHETIC_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+
+// Synthetic CSV for the benchmarks: rows of random alphanumeric fields,
+// shaped by a CorpusSpec. The same spec and seed always give the same bytes.
+
+struct CorpusSpec {
+  std::string name;
+  size_t field_width{8}; // the mean bytes of content of a field (1 to 2w-1)
+  double quoted{0};      // the fraction of fields that are quoted
+  double newlines{0};    // of the quoted fields, those with a line ending
+  bool crlf{false};      // CR-LF record ends (and embedded line endings)
+  size_t columns{8};
+  size_t size{1 << 20};  // in bytes, cut back to the last whole row
+};
+
+// the corpus of spec, at most spec.size bytes (more only if a single row is
+// longer than that)
+inline std::string generate_corpus(const CorpusSpec &spec, uint64_t seed = 1) {
+  static const char alphabet[] =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> coin(0, 1);
+  std::uniform_int_distribution<size_t> width(
+      1, spec.field_width > 1 ? 2 * spec.field_width - 1 : 1);
+  std::uniform_int_distribution<size_t> letter(0, sizeof(alphabet) - 2);
+  const char *line_end = spec.crlf ? "\r\n" : "\n";
+  std::string out;
+  out.reserve(spec.size + 4096);
+  size_t last_row_end = 0;
+  while (out.size() < spec.size) {
+    for (size_t c = 0; c < spec.columns; c++) {
+      if (c > 0) {
+        out += ',';
+      }
+      size_t n = width(rng);
+      bool quoted = spec.quoted > 0 && coin(rng) < spec.quoted;
+      if (!quoted) {
+        for (size_t i = 0; i < n; i++) {
+          out += alphabet[letter(rng)];
+        }
+        continue;
+      }
+      // the quoted fields also hold a delimiter, an escaped quote and maybe
+      // a line ending, somewhere in their content
+      size_t special = n / 2;
+      bool newline = spec.newlines > 0 && coin(rng) < spec.newlines;
+      out += '"';
+      for (size_t i = 0; i < n; i++) {
+        if (i != special) {
+          out += alphabet[letter(rng)];
+        } else if (newline) {
+          out += line_end;
+        } else {
+          out += (i % 2 == 0) ? "," : "\"\"";
+        }
+      }
+      out += '"';
+    }
+    out += line_end;
+    if (out.size() <= spec.size) {
+      last_row_end = out.size();
+    }
+  }
+  if (last_row_end > 0) {
+    out.resize(last_row_end);
+  }
+  return out;
+}
+
+#endif
@@ -0,0 +1,44 @@
+#include "arena.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "mem_util.h"
+
+Arena::Arena(size_t chunk_size_in) : chunk_size(std::max<size_t>(chunk_size_in, 64)) {}
+
+Arena::~Arena() {
+  for (uint8_t *c : chunks) {
+    aligned_free(c);
+  }
+}
+
+void Arena::grow(size_t n) {
+  size_t size = std::max(n, chunk_size);
+  uint8_t *c = static_cast<uint8_t *>(aligned_malloc(64, size));
+  if (c == nullptr) {
+    throw std::runtime_error("could not allocate memory");
+  }
+  if (chunks.empty()) {
+    first_size = size;
+  }
+  chunks.push_back(c);
+  used_before += chunk_end - free_bytes;
+  next = c;
+  free_bytes = size;
+  chunk_end = size;
+}
+
+void Arena::clear() {
+  if (chunks.empty()) {
+    return;
+  }
+  for (size_t i = 1; i < chunks.size(); i++) {
+    aligned_free(chunks[i]);
+  }
+  chunks.resize(1);
+  next = chunks[0];
+  free_bytes = first_size;
+  chunk_end = first_size;
+  used_before = 0;
+}
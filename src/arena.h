@@ -0,0 +1,59 @@
+#ifndef SIMDCSV_ARENA_H
+#define SIMDCSV_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A bump allocator: allocations are carved out of large chunks, one after
+// the other, and are only ever freed all at once (clear, or the arena
+// going away). What they hold stays put as the arena grows, so pointers
+// (and string_views) into it stay valid until then.
+//
+// throws an exception if a chunk cannot be allocated
+class Arena {
+public:
+  // requests larger than the chunk size get a chunk of their own
+  explicit Arena(size_t chunk_size_in = 1 << 20);
+  ~Arena();
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  // n bytes, not aligned in any way
+  uint8_t *allocate(size_t n) {
+    if (n > free_bytes) {
+      grow(n);
+    }
+    uint8_t *p = next;
+    next += n;
+    free_bytes -= n;
+    return p;
+  }
+
+  // give back the end of the last allocation, which was only n bytes long
+  // after all
+  void shrink_last(uint8_t *last, size_t n) {
+    free_bytes += next - (last + n);
+    next = last + n;
+  }
+
+  // free everything, keeping the first chunk for what comes next
+  void clear();
+
+  // bytes handed out since the last clear
+  size_t bytes_used() const { return used_before + (chunk_end - free_bytes); }
+
+private:
+  void grow(size_t n);
+
+  size_t chunk_size;
+  std::vector<uint8_t *> chunks;
+  uint8_t *next{nullptr};
+  size_t free_bytes{0};
+  size_t chunk_end{0};   // size of the current chunk
+  size_t first_size{0};  // and of the first one, kept by clear
+  size_t used_before{0}; // bytes used in the chunks before it
+};
+
+#endif
@@ -0,0 +1,125 @@
+#include "bitmap_index.h"
+
+#include <algorithm>
+
+#include "portability.h"
+#include "simd_kernels.h"
+
+namespace {
+
+// the words between two entries of the rank directory
+const size_t words_per_rank = 8;
+
+// the position of the set bit of rank k in w, which has more than k
+really_inline int select_in_word(uint64_t w, uint64_t k) {
+#ifdef __BMI2__
+  return trailingzeroes(_pdep_u64(uint64_t(1) << k, w));
+#else
+  for (; k > 0; k--) {
+    w &= w - 1;
+  }
+  return trailingzeroes(w);
+#endif
+}
+
+// the rank directory of bits (see BitmapIndex)
+void build_ranks(const std::vector<uint64_t> &bits, std::vector<uint64_t> &ranks,
+                 uint64_t &total) {
+  ranks.clear();
+  total = 0;
+  for (size_t i = 0; i < bits.size(); i++) {
+    if (i % words_per_rank == 0) {
+      ranks.push_back(total);
+    }
+    total += hamming(bits[i]);
+  }
+  ranks.push_back(total);
+}
+
+} // namespace
+
+void BitmapIndex::build(const uint8_t *buf, size_t len, const Dialect &d) {
+  dialect = d;
+  size_t lenminus64 = len < 64 ? 0 : len - 64;
+  size_t n_blocks = (lenminus64 + 63) / 64;
+  seps.resize(n_blocks);
+  ends.resize(n_blocks);
+  ParseState state;
+  // a batch at a time, so that the scan stays in the cache
+  const size_t batch = 1024;
+  for (size_t b = 0; b < n_blocks; b += batch) {
+    size_t n = std::min(batch, n_blocks - b);
+    active_kernel->scan_blocks(buf, 64 * b, n, dialect, state, seps.data() + b,
+                               ends.data() + b, 0);
+  }
+  // a final record without a line ending ends at the end of the data, as
+  // in BasicParsedCSV: a separator and a record end there close it
+  size_t last = n_blocks;
+  while (last > 0 && ends[last - 1] == 0) {
+    last--;
+  }
+  uint64_t row_start = last == 0 ? 0 : 64 * last - leadingzeroes(ends[last - 1]);
+  last_row_open = row_start < lenminus64;
+  if (last_row_open) {
+    seps.resize(lenminus64 / 64 + 1, 0);
+    ends.resize(lenminus64 / 64 + 1, 0);
+    seps[lenminus64 / 64] |= uint64_t(1) << (lenminus64 % 64);
+    ends[lenminus64 / 64] |= uint64_t(1) << (lenminus64 % 64);
+  }
+  data_len = lenminus64;
+  build_ranks(seps, sep_ranks, total_seps);
+  build_ranks(ends, end_ranks, total_ends);
+}
+
+uint64_t BitmapIndex::select(const std::vector<uint64_t> &bits,
+                             const std::vector<uint64_t> &ranks, uint64_t k) {
+  // the last directory entry at or below k
+  size_t r = std::upper_bound(ranks.begin(), ranks.end(), k) - ranks.begin() - 1;
+  k -= ranks[r];
+  for (size_t i = r * words_per_rank;; i++) {
+    uint64_t n = hamming(bits[i]);
+    if (k < n) {
+      return 64 * i + select_in_word(bits[i], k);
+    }
+    k -= n;
+  }
+}
+
+uint64_t BitmapIndex::rank(const std::vector<uint64_t> &bits,
+                           const std::vector<uint64_t> &ranks, uint64_t offset) {
+  size_t word = offset / 64;
+  if (word >= bits.size()) {
+    return ranks.back();
+  }
+  size_t r = word / words_per_rank;
+  uint64_t count = ranks[r];
+  for (size_t i = r * words_per_rank; i < word; i++) {
+    count += hamming(bits[i]);
+  }
+  return count + hamming(bits[word] & ((uint64_t(1) << (offset % 64)) - 1));
+}
+
+uint64_t BitmapIndex::next_separator(uint64_t offset) const {
+  size_t i = offset / 64;
+  uint64_t w = seps[i] & ~((uint64_t(1) << (offset % 64)) - 1);
+  while (w == 0) {
+    w = seps[++i];
+  }
+  return 64 * i + trailingzeroes(w);
+}
+
+void BitmapIndex::field(uint64_t r, uint64_t m, uint64_t &start,
+                        uint64_t &end) const {
+  if (m == 0) {
+    start = r == 0 ? 0 : row_end(r - 1) + 1;
+  } else {
+    start = separator(row_begin(r) + m - 1) + 1;
+  }
+  // the field ends at the next separator, which is rarely far
+  end = next_separator(start);
+  // record ends point at the LF of the CR-LF pair (the end of the data, of
+  // an open last row, does not)
+  if (dialect.crlf && end < data_len && ((ends[end / 64] >> (end % 64)) & 1) != 0) {
+    end--;
+  }
+}
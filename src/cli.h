@@ -0,0 +1,108 @@
+#ifndef SIMDCSV_CLI_H
+#define SIMDCSV_CLI_H
+
+// The modes of the simdcsv program, each in a cli_*.cpp file of its own;
+// main.cpp parses the options, checks that they go with the mode picked and
+// runs it. They print their results and return the exit status, so they
+// are built into the program only, not into simdcsv_core.
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "dialect.h"
+#include "io_util.h"
+#include "strict_check.h"
+#include "timing.h"
+#include "typed_columns.h"
+
+// the command line, as parsed by main
+struct CliOptions {
+  bool verbose = false;
+  bool dump = false;
+  size_t iterations = 100;
+  size_t threads = 1;
+  bool wide = false;
+  size_t window = 0; // -S
+  bool pipelined = false;
+  bool map = false;
+  int map_flags = CORPUS_MAP_SEQUENTIAL;
+  bool rows = false;
+  bool utf8 = false;
+  bool strict = false;
+  bool unescape = false;
+  std::vector<ColumnSpec> schema;
+  bool columnar = false; // -A
+  size_t header_rows = 0;
+  bool sniff = false;
+  bool sniff_schema_columns = false; // -T auto
+  const char *index_path = nullptr; // -x
+  size_t piece = 0; // -z
+  bool sweep = false; // -D
+  bool unpadded = false;
+  bool bitmap = false;
+  bool count_only = false; // -o
+  size_t split_points = 0; // -y
+#ifdef __linux__
+  std::vector<PerfEvent> perf_events; // -E, the default set if empty
+#endif
+  const char *profile_format = nullptr; // -G
+  std::vector<size_t> columns; // -c
+  Dialect dialect;
+};
+
+// the outcome of UTF-8 validation, for -u
+inline void report_utf8(uint64_t error, bool verbose) {
+  if (error != UINT64_MAX) {
+    std::cout << "invalid UTF-8 at byte " << error << std::endl;
+  } else if (verbose) {
+    std::cout << "valid UTF-8" << std::endl;
+  }
+}
+
+// the first structural error found in strict mode, for -R
+inline void report_structure(const StructureError &error, bool verbose) {
+  if (error.code != CSV_OK) {
+    std::cout << csv_error_message(error.code) << " at byte " << error.offset
+              << " (row " << error.row << ")" << std::endl;
+  } else if (verbose) {
+    std::cout << "well-formed RFC 4180" << std::endl;
+  }
+}
+
+// the whole file in memory, indexed (the default), projected (-c) or into
+// column buffers (-A); cli_index.cpp
+int index_corpus(const char *filename, CliOptions o);
+
+// -S, cli_stream.cpp
+int stream_corpus(const char *filename, size_t window, size_t iterations,
+                  const Dialect &dialect, bool utf8, bool strict,
+                  bool dump, bool verbose, bool pipelined);
+
+// -x, cli_index_file.cpp
+int index_file_corpus(const char *filename, const char *index_path,
+                      const Dialect &dialect, bool dump, bool verbose);
+
+// -b, cli_bitmap.cpp
+int bitmap_corpus(const char *filename, size_t iterations,
+                  const Dialect &dialect, bool dump, bool verbose);
+
+// -o, cli_count.cpp
+int count_corpus(const char *filename, size_t iterations,
+                 const Dialect &dialect, bool verbose);
+
+// -y, cli_split.cpp
+int split_corpus(const char *filename, size_t n, const Dialect &dialect,
+                 bool verbose);
+
+// -G, cli_profile.cpp
+int profile_corpus(const char *filename, const CliOptions &o);
+
+// -z and -D, cli_bench.cpp
+int small_files_benchmark(const char *filename, size_t piece,
+                          size_t iterations, const Dialect &dialect,
+                          bool rows, bool huge_pages, bool verbose);
+int density_sweep(size_t iterations, bool verbose);
+
+#endif
@@ -0,0 +1,204 @@
+#include <sys/resource.h> // for getrusage
+#include <unistd.h> // for rmdir
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "cli.h"
+#include "csv_defs.h"
+#include "csv_parser.h"
+#include "find_indexes.h"
+#include "io_util.h"
+#include "mem_util.h"
+#include "simd_kernels.h"
+using namespace std;
+
+// the minor page faults of the process so far
+static long minor_faults() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_minflt;
+}
+
+// split filename into files of about piece bytes (cut after the next line
+// ending), then index them all, with fresh buffers for each file as main
+// does and with a CsvParser reusing its own
+int small_files_benchmark(const char *filename, size_t piece,
+                          size_t iterations, const Dialect &dialect,
+                          bool rows, bool huge_pages, bool verbose) {
+  std::basic_string_view<uint8_t> p;
+  try {
+    p = get_corpus(filename, CSV_PADDING);
+  } catch (const std::exception &e) {
+    std::cout << "Could not load the file " << filename << std::endl;
+    return EXIT_FAILURE;
+  }
+  size_t len = p.size() - CSV_PADDING;
+  char dir[] = "/tmp/simdcsv-XXXXXX";
+  if (mkdtemp(dir) == nullptr) {
+    cerr << "could not create a temporary directory" << endl;
+    aligned_free((void *)p.data());
+    return EXIT_FAILURE;
+  }
+  vector<string> names;
+  bool written = true;
+  for (size_t start = 0; start < len && written;) {
+    size_t end = std::min(start + piece, len);
+    while (end < len && p[end - 1] != '\n') {
+      end++;
+    }
+    names.push_back(string(dir) + "/" + to_string(names.size()) + ".csv");
+    std::FILE *fp = std::fopen(names.back().c_str(), "wb");
+    written = fp != nullptr &&
+              std::fwrite(p.data() + start, 1, end - start, fp) == end - start;
+    if (fp != nullptr && std::fclose(fp) != 0) {
+      written = false;
+    }
+    start = end;
+  }
+  aligned_free((void *)p.data());
+  auto clean_up = [&]() {
+    for (const string &name : names) {
+      std::remove(name.c_str());
+    }
+    rmdir(dir);
+  };
+  if (!written) {
+    cerr << "could not write the pieces to " << dir << endl;
+    clean_up();
+    return EXIT_FAILURE;
+  }
+  if (verbose) {
+    cout << "[verbose] " << names.size() << " files of about " << piece
+         << " bytes in " << dir << endl;
+  }
+  double fresh_time = 0, reused_time = 0;
+  long fresh_faults = 0, reused_faults = 0;
+  uint64_t n_indexes = 0, reused_indexes = 0;
+  try {
+    for (size_t i = 0; i < iterations; i++) {
+      long faults = minor_faults();
+      auto start = chrono::steady_clock::now();
+      for (const string &name : names) {
+        std::basic_string_view<uint8_t> q = get_corpus(name, CSV_PADDING);
+        ParsedCSV pcsv;
+        pcsv.indexes = new uint32_t[q.size()];
+        pcsv.row_offsets = rows ? new uint32_t[q.size() + 1] : nullptr;
+        find_indexes(q.data(), q.size(), pcsv, dialect);
+        n_indexes += pcsv.n_indexes;
+        delete[] pcsv.indexes;
+        delete[] pcsv.row_offsets;
+        aligned_free((void *)q.data());
+      }
+      fresh_time += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      fresh_faults += minor_faults() - faults;
+    }
+    CsvParser parser(rows, huge_pages);
+    for (size_t i = 0; i < iterations; i++) {
+      long faults = minor_faults();
+      auto start = chrono::steady_clock::now();
+      for (const string &name : names) {
+        parser.parse_file(name, dialect);
+        reused_indexes += parser.index().n_indexes;
+      }
+      reused_time += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      reused_faults += minor_faults() - faults;
+    }
+    if (verbose) {
+      cout << "[verbose] the parser holds " << parser.footprint() << " bytes" << endl;
+    }
+  } catch (const std::exception &e) {
+    cerr << e.what() << endl;
+    clean_up();
+    return EXIT_FAILURE;
+  }
+  clean_up();
+  if (n_indexes != reused_indexes) {
+    cerr << "the parser found " << reused_indexes << " indexes, not " << n_indexes << endl;
+    return EXIT_FAILURE;
+  }
+  double volume = double(len) * iterations / (1024 * 1024 * 1024);
+  cout << "files                      : " << names.size() << endl;
+  cout << "fresh buffers page faults  : " << fresh_faults / iterations << " per pass" << endl;
+  cout << "reused parser page faults  : " << reused_faults / iterations << " per pass" << endl;
+  cout << " fresh buffers GB/s: " << volume / fresh_time << endl;
+  cout << " reused parser GB/s: " << volume / reused_time << endl;
+  return EXIT_SUCCESS;
+}
+
+// index synthetic CSV of fields of 1 to 64 bytes (separator densities from
+// 1/2 to 1/65) with each flattener of the active kernel, best of iterations
+int density_sweep(size_t iterations, bool verbose) {
+  const size_t field_lengths[] = {1, 2, 3, 4, 6, 8, 12, 16, 32, 64};
+  const size_t len = 16 << 20;
+  vector<Flattener> flatteners;
+  for (unsigned f = 0; f < N_FLATTENERS; f++) {
+    if (active_kernel->flatteners & (1u << f)) {
+      flatteners.push_back(Flattener(f));
+    }
+  }
+  uint8_t *buf = allocate_padded_buffer(len, CSV_PADDING);
+  uint32_t *indexes = new uint32_t[len + CSV_PADDING];
+  uint32_t *expected = new uint32_t[len + CSV_PADDING];
+  if (buf == nullptr) {
+    cerr << "could not allocate memory" << endl;
+    delete[] indexes;
+    delete[] expected;
+    return EXIT_FAILURE;
+  }
+  memset(buf + len, 0, CSV_PADDING);
+  Flattener saved = active_flattener;
+  bool same = true;
+  cout << "field bytes";
+  for (Flattener f : flatteners) {
+    cout << "\t" << flattener_name(f);
+  }
+  cout << "\t(GB/s)" << endl;
+  for (size_t field_length : field_lengths) {
+    // rows of 8 fields
+    for (size_t i = 0, field = 0; i < len; field++) {
+      size_t n = std::min(field_length, len - i);
+      memset(buf + i, 'x', n);
+      i += n;
+      if (i < len) {
+        buf[i++] = (field % 8 == 7) ? '\n' : ',';
+      }
+    }
+    cout << field_length;
+    size_t n_expected = 0;
+    for (Flattener f : flatteners) {
+      active_flattener = f;
+      ParsedCSV pcsv;
+      pcsv.indexes = indexes;
+      double best = 0;
+      for (size_t i = 0; i < std::max<size_t>(iterations, 1); i++) {
+        auto start = chrono::steady_clock::now();
+        find_indexes(buf, len + CSV_PADDING, pcsv, Dialect());
+        double t = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        best = (i == 0 || t < best) ? t : best;
+      }
+      if (f == flatteners[0]) {
+        n_expected = pcsv.n_indexes;
+        memcpy(expected, indexes, n_expected * sizeof(uint32_t));
+      } else if (pcsv.n_indexes != n_expected ||
+                 memcmp(expected, indexes, n_expected * sizeof(uint32_t)) != 0) {
+        cerr << flattener_name(f) << " differs from " << flattener_name(flatteners[0])
+             << " for fields of " << field_length << " bytes" << endl;
+        same = false;
+      }
+      cout << "\t" << len / best / (1024 * 1024 * 1024);
+    }
+    cout << endl;
+    if (verbose) {
+      cout << "[verbose] " << n_expected << " indexes in " << len << " bytes" << endl;
+    }
+  }
+  active_flattener = saved;
+  aligned_free(buf);
+  delete[] indexes;
+  delete[] expected;
+  return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
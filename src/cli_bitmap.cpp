@@ -0,0 +1,67 @@
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+#include "bitmap_index.h"
+#include "cli.h"
+#include "csv_defs.h"
+#include "io_util.h"
+#include "mem_util.h"
+using namespace std;
+
+// index filename as a BitmapIndex, and time looking fields up in it
+int bitmap_corpus(const char *filename, size_t iterations,
+                  const Dialect &dialect, bool dump, bool verbose) {
+  std::basic_string_view<uint8_t> p;
+  try {
+    p = get_corpus(filename, CSV_PADDING);
+  } catch (const std::exception &e) {
+    std::cout << "Could not load the file " << filename << std::endl;
+    return EXIT_FAILURE;
+  }
+  size_t len = p.size() - CSV_PADDING;
+  BitmapIndex index;
+  double best = 0;
+  for (size_t i = 0; i < std::max<size_t>(iterations, 1); i++) {
+    auto start = chrono::steady_clock::now();
+    index.build(p.data(), p.size(), dialect);
+    double t = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    best = (i == 0 || t < best) ? t : best;
+  }
+  // a field of a random row, as a sparse reader would
+  const size_t lookups = 1 << 20;
+  std::mt19937_64 rng(1);
+  uint64_t checksum = 0;
+  auto start = chrono::steady_clock::now();
+  for (size_t i = 0; i < lookups && index.n_rows() > 0; i++) {
+    uint64_t r = rng() % index.n_rows();
+    uint64_t field_start, field_end;
+    index.field(r, 0, field_start, field_end);
+    checksum += field_end - field_start;
+  }
+  double lookup_time = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  if (dump) {
+    for (uint64_t r = 0; r < index.n_rows(); r++) {
+      cout << r << ":";
+      for (uint64_t m = 0; m < index.row_fields(r); m++) {
+        uint64_t field_start, field_end;
+        index.field(r, m, field_start, field_end);
+        cout << (m == 0 ? " " : " | ");
+        for (size_t j = field_start; j < field_end; j++) {
+          cout << p[j];
+        }
+      }
+      cout << "\n";
+    }
+  }
+  cout << "bitmap index GB/s          : " << len / best / (1024 * 1024 * 1024) << endl;
+  cout << "bitmap index bytes         : " << index.footprint() << " (flattened: "
+       << (index.n_separators() + index.n_rows() + 1) * sizeof(uint32_t) << ")" << endl;
+  cout << "random row lookup          : " << lookup_time / lookups * 1e9 << " ns" << endl;
+  if (verbose) {
+    cout << "[verbose] " << index.n_rows() << " rows, " << index.n_separators()
+         << " separators (lookup checksum " << checksum << ")" << endl;
+  }
+  aligned_free((void *)p.data());
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,47 @@
+#include <algorithm>
+#include <chrono>
+
+#include "cli.h"
+#include "count_fields.h"
+#include "csv_defs.h"
+#include "io_util.h"
+#include "mem_util.h"
+using namespace std;
+
+// count the rows and fields of filename, and the rows with each number of
+// fields, without indexing it
+int count_corpus(const char *filename, size_t iterations,
+                 const Dialect &dialect, bool verbose) {
+  std::basic_string_view<uint8_t> p;
+  try {
+    p = get_corpus(filename, CSV_PADDING);
+  } catch (const std::exception &e) {
+    std::cout << "Could not load the file " << filename << std::endl;
+    return EXIT_FAILURE;
+  }
+  size_t len = p.size() - CSV_PADDING;
+  CsvCounts counts;
+  double best = 0;
+  for (size_t i = 0; i < std::max<size_t>(iterations, 1); i++) {
+    auto start = chrono::steady_clock::now();
+    count_fields(p.data(), p.size(), counts, dialect);
+    double t = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    best = (i == 0 || t < best) ? t : best;
+  }
+  cout << "records                    : " << counts.n_rows << endl;
+  cout << "fields                     : " << counts.n_fields() << endl;
+  cout << "uniform                    : " << (counts.uniform() ? "yes" : "no") << endl;
+  for (size_t k = 0; k < counts.histogram.size(); k++) {
+    if (counts.histogram[k] != 0) {
+      cout << "  " << k << " fields: " << counts.histogram[k] << " records" << endl;
+    }
+  }
+  cout << "count GB/s                 : " << len / best / (1024 * 1024 * 1024) << endl;
+  if (verbose) {
+    cout << "[verbose] " << counts.n_separators
+         << " separators, " << counts.final_fields
+         << " fields in a last record without a line ending" << endl;
+  }
+  aligned_free((void *)p.data());
+  return EXIT_SUCCESS;
+}
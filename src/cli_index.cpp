@@ -0,0 +1,389 @@
+#include <chrono>
+#include <memory>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "arena.h"
+#include "cli.h"
+#include "column_projection.h"
+#include "columnar.h"
+#include "csv_defs.h"
+#include "find_indexes.h"
+#include "io_util.h"
+#include "mem_util.h"
+#include "parallel_indexer.h"
+#include "sniffer.h"
+#include "timing.h"
+#include "typed_columns.h"
+#include "unescape.h"
+using namespace std;
+
+// load filename whole (read, or mapped for -m/-p/-H), sniff it for -I, then
+// index it iterations times: the separators and rows (the default, on
+// threads with -t, then unescaped for -U and typed for -T), only the
+// columns of -c, or the column buffers of -A
+int index_corpus(const char *filename, CliOptions o) {
+  if (o.verbose) {
+    cout << "[verbose] loading " << filename << endl;
+  }
+  std::basic_string_view<uint8_t> p;
+  auto load_start = chrono::steady_clock::now();
+  try {
+    p = o.map ? map_corpus(filename, CSV_PADDING, o.map_flags)
+            : get_corpus(filename, CSV_PADDING);
+  } catch (const std::exception &e) { // caught by reference to base
+    std::cout << "Could not load the file " << filename << std::endl;
+    return EXIT_FAILURE;
+  }
+  // a mapping that is not populated pays for its page faults during the
+  // first parse instead
+  double load_time = chrono::duration<double>(chrono::steady_clock::now() - load_start).count();
+  auto release_corpus = [&]() {
+    if (o.map) {
+      unmap_corpus(p);
+    } else {
+      aligned_free((void*)p.data());
+    }
+  };
+  if (o.verbose) {
+    cout << "[verbose] " << (o.map ? "mapped " : "loaded ") << filename << " (" << p.size() << " bytes)" << endl;
+  }
+  if (o.sniff) {
+    // the sniffed dialect and header replace those of the command line
+    auto sniff_start = chrono::steady_clock::now();
+    SniffedSchema sniffed = sniff_schema(p.data(), p.size() - CSV_PADDING);
+    double sniff_time = chrono::duration<double>(chrono::steady_clock::now() - sniff_start).count();
+    o.dialect = sniffed.dialect;
+    o.header_rows = sniffed.header;
+    if (o.sniff_schema_columns) {
+      o.schema = numeric_columns(sniffed);
+    }
+    cout << "sniffed: delimiter ";
+    if (o.dialect.delimiter == '\t') {
+      cout << "tab";
+    } else {
+      cout << "'" << o.dialect.delimiter << "'";
+    }
+    cout << (o.dialect.crlf ? ", CR-LF" : "") << (sniffed.header ? ", header" : "")
+         << ", " << sniffed.n_columns << " columns:";
+    for (FieldType t : sniffed.types) {
+      cout << " " << field_type_name(t);
+    }
+    cout << endl;
+    if (o.verbose) {
+      cout << "[verbose] sniffed " << sniffed.rows_sampled << " rows in "
+           << sniff_time * 1e6 << " us, " << sniffed.consistency * 100
+           << "% of them with " << sniffed.n_columns << " fields" << endl;
+    }
+  }
+#ifdef __linux__
+  vector<int> evts;
+  evts.push_back(PERF_COUNT_HW_CPU_CYCLES);
+  evts.push_back(PERF_COUNT_HW_INSTRUCTIONS);
+  evts.push_back(PERF_COUNT_HW_BRANCH_MISSES);
+  evts.push_back(PERF_COUNT_HW_CACHE_REFERENCES);
+  evts.push_back(PERF_COUNT_HW_CACHE_MISSES);
+  evts.push_back(PERF_COUNT_HW_REF_CPU_CYCLES);
+#endif //__linux__
+
+  // 32-bit offsets unless asked for (to measure what they cost) or needed
+  if (!fits_index_type<uint32_t>(p.size())) {
+    o.wide = true;
+  }
+
+#ifdef __linux__
+  // note: the counters only follow the calling thread
+  TimingAccumulator ta = o.perf_events.empty() ? TimingAccumulator(1, evts)
+                                             : TimingAccumulator(1, o.perf_events);
+#endif // __linux__
+  // wall clock rather than clock(): the latter adds up the time of every thread
+  double total = 0; // naive accumulator
+  double unescape_total = 0; // materializing the fields, for -U
+  double decode_total = 0; // converting the typed columns, for -T
+  // the same loop for either width of index, pcsv just selects the type
+  auto run = [&](auto pcsv) -> bool {
+    typedef typename std::remove_pointer<decltype(pcsv.indexes)>::type index_t;
+    pcsv.indexes = new (std::nothrow) index_t[p.size()]; // can't have more indexes than we have data
+    if(pcsv.indexes == nullptr) {
+      cerr << "You are running out of memory." << endl;
+      return false;
+    }
+    if (o.rows) {
+      pcsv.row_offsets = new (std::nothrow) index_t[p.size() + 1];
+      if(pcsv.row_offsets == nullptr) {
+        cerr << "You are running out of memory." << endl;
+        delete[] pcsv.indexes;
+        return false;
+      }
+    }
+    pcsv.validate_utf8 = o.utf8;
+    pcsv.strict = o.strict;
+    unique_ptr<BasicParallelIndexer<index_t>> parallel;
+    if (o.threads > 1) {
+      parallel.reset(new BasicParallelIndexer<index_t>(o.threads));
+    }
+    bool ok = true;
+    for (size_t i = 0; i < o.iterations && ok; i++) {
+        auto start = chrono::steady_clock::now();
+#ifdef __linux__
+        {TimingPhase p1(ta, 0);
+#endif // __linux__
+        if (parallel) {
+          ok = parallel->find_indexes(p.data(), p.size(), pcsv, o.dialect);
+        } else if (o.unpadded) {
+          // as if the corpus had no padding
+          ok = find_indexes_unpadded(p.data(), p.size() - CSV_PADDING, pcsv, o.dialect);
+        } else {
+          ok = find_indexes(p.data(), p.size(), pcsv, o.dialect);
+        }
+#ifdef __linux__
+        }
+#endif // __linux__
+        total += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    if (!ok) {
+      if (pcsv.error.code != CSV_OK) {
+        report_structure(pcsv.error, o.verbose);
+      } else {
+        cerr << "Could not index " << filename << endl;
+      }
+      delete[] pcsv.indexes;
+      delete[] pcsv.row_offsets;
+      return false;
+    }
+
+    // the fields of the last index, as string_views
+    Arena arena;
+    vector<string_view> fields;
+    for (size_t i = 0; i < o.iterations && o.unescape; i++) {
+      auto start = chrono::steady_clock::now();
+      arena.clear();
+      unescape_fields(p.data(), pcsv, arena, fields);
+      unescape_total += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    // the typed columns of the last index
+    vector<TypedColumn> typed;
+    for (size_t i = 0; i < o.iterations && !o.schema.empty(); i++) {
+      auto start = chrono::steady_clock::now();
+      decode_columns(p.data(), pcsv, o.schema, typed, o.header_rows);
+      decode_total += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    if (o.dump && o.rows && o.unescape) {
+      for (index_t r = 0; r < pcsv.n_rows; r++) {
+        cout << r << ":";
+        for (index_t m = 0; m < pcsv.row_fields(r); m++) {
+          cout << (m == 0 ? " " : " | ") << fields[pcsv.row_offsets[r] + m];
+        }
+        cout << "\n";
+      }
+    } else if (o.dump && o.rows) {
+      for (index_t r = 0; r < pcsv.n_rows; r++) {
+        cout << r << ":";
+        for (index_t m = 0; m < pcsv.row_fields(r); m++) {
+          index_t start, end;
+          pcsv.field(r, m, start, end);
+          cout << (m == 0 ? " " : " | ");
+          for (size_t j = start; j < end; j++) {
+            cout << p[j];
+          }
+        }
+        cout << "\n";
+      }
+    } else if (o.dump) {
+      for (size_t i = 0; i < pcsv.n_indexes; i++) {
+        cout << pcsv.indexes[i] << ": ";
+        if (i != pcsv.n_indexes-1) {
+          for (size_t j = pcsv.indexes[i]; j < pcsv.indexes[i+1]; j++) {
+            cout << p[j];
+          }
+        }
+        cout << "\n";
+      }
+    }
+    if (o.utf8) {
+      report_utf8(pcsv.utf8_error == SIZE_MAX ? UINT64_MAX : pcsv.utf8_error,
+                  o.verbose);
+    }
+    if (o.strict) {
+      report_structure(pcsv.error, o.verbose);
+    }
+    if(o.verbose) {
+      cout << "number of indexes found    : " << pcsv.n_indexes << endl;
+      cout << "number of bytes per index : " << p.size() / double(pcsv.n_indexes) << endl;
+      cout << "bytes per index entry      : " << sizeof(index_t) << endl;
+      if (o.rows) {
+        cout << "number of rows found       : " << pcsv.n_rows << endl;
+      }
+      if (o.unescape) {
+        cout << "bytes copied to the arena  : " << arena.bytes_used() << endl;
+      }
+      for (const TypedColumn &t : typed) {
+        double sum = 0;
+        for (size_t r = 0; r < t.size(); r++) {
+          sum += t.spec.type == COLUMN_INT64 ? t.ints[r] : t.doubles[r];
+        }
+        cout << "column " << t.spec.column
+             << (t.spec.type == COLUMN_INT64 ? " (int64)  " : " (double) ")
+             << ": " << t.size() << " values, " << t.n_nulls << " nulls ("
+             << t.n_invalid << " invalid), sum " << sum << endl;
+      }
+    }
+    delete[] pcsv.indexes;
+    delete[] pcsv.row_offsets;
+    return true;
+  };
+  // only the selected columns, for -c
+  auto project = [&](auto pcsv) -> bool {
+    typedef typename std::remove_pointer<decltype(pcsv.indexes)>::type index_t;
+    ColumnProjection proj(o.columns);
+    BasicProjectedCSV<index_t> out;
+    bool ok = true;
+    for (size_t i = 0; i < o.iterations && ok; i++) {
+        auto start = chrono::steady_clock::now();
+#ifdef __linux__
+        {TimingPhase p1(ta, 0);
+#endif // __linux__
+        ok = find_projected_indexes(p.data(), p.size(), proj, out, o.dialect);
+#ifdef __linux__
+        }
+#endif // __linux__
+        total += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    if (!ok) {
+      cerr << "Could not index " << filename << endl;
+      return false;
+    }
+    if (o.dump) {
+      for (size_t r = 0; r < out.n_rows; r++) {
+        cout << r << ":";
+        for (size_t j = 0; j < out.width; j++) {
+          cout << (j == 0 ? " " : " | ");
+          const index_t *f = &out.fields[2 * (r * out.width + j)];
+          for (size_t k = f[0]; k < f[1]; k++) {
+            cout << p[k];
+          }
+        }
+        cout << "\n";
+      }
+    }
+    if(o.verbose) {
+      cout << "number of columns selected : " << out.width << endl;
+      cout << "number of rows found       : " << out.n_rows << endl;
+      cout << "bytes of index             : " << 2 * out.n_rows * out.width * sizeof(index_t) << endl;
+    }
+    return true;
+  };
+  // Arrow-style column buffers, for -A
+  auto to_columns = [&](auto &&out) -> bool {
+    bool ok = true;
+    for (size_t i = 0; i < o.iterations && ok; i++) {
+        auto start = chrono::steady_clock::now();
+#ifdef __linux__
+        {TimingPhase p1(ta, 0);
+#endif // __linux__
+        ok = find_columns(p.data(), p.size(), out, o.dialect);
+#ifdef __linux__
+        }
+#endif // __linux__
+        total += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    if (!ok) {
+      cerr << "Could not index " << filename << endl;
+      return false;
+    }
+    if (o.dump) {
+      for (size_t r = 0; r < out.n_rows; r++) {
+        cout << r << ":";
+        for (size_t j = 0; j < out.columns.size(); j++) {
+          cout << (j == 0 ? " " : " | ");
+          if (out.columns[j].is_valid(r)) {
+            cout << out.columns[j].value(r);
+          }
+        }
+        cout << "\n";
+      }
+    }
+    if(o.verbose) {
+      size_t bytes = 0, nulls = 0;
+      for (const auto &c : out.columns) {
+        bytes += c.data.size();
+        nulls += c.null_count;
+      }
+      cout << "number of columns          : " << out.columns.size() << endl;
+      cout << "number of rows found       : " << out.n_rows << endl;
+      cout << "number of nulls            : " << nulls << endl;
+      cout << "bytes of column data       : " << bytes << endl;
+    }
+    return true;
+  };
+  bool ok;
+  if (o.columnar) {
+    ok = o.wide ? to_columns(ColumnarCSV64()) : to_columns(ColumnarCSV());
+  } else if (!o.columns.empty()) {
+    ok = o.wide ? project(ParsedCSV64()) : project(ParsedCSV());
+  } else {
+    ok = o.wide ? run(ParsedCSV64()) : run(ParsedCSV());
+  }
+  if (!ok) {
+    release_corpus();
+    return EXIT_FAILURE;
+  }
+  double volume = o.iterations * p.size();
+  double time_in_s = total;
+  if(o.verbose) {
+    cout << "Number of threads          = " << o.threads << endl;
+    cout << "Total time in (s)          = " << time_in_s << endl;
+    cout << "Number of iterations       = " << volume << endl;
+  }
+#ifdef __linux__
+  if (!ta.working) {
+    // no counters (perf_event_open refused, say): nothing was counted
+    cout << (o.perf_events.empty() ? "Cycles per byte" : "Events") << " n/a"
+         << endl;
+  } else if (!o.perf_events.empty()) {
+    // the events of -E
+    for (int j = 0; j < ta.num_events; j++) {
+      cout << ta.event_names[j] << " = " << ta.count(0, j) << " ("
+           << ta.count(0, j) / volume << " per byte)" << endl;
+    }
+  } else if(o.verbose) {
+    cout << "Number of cycles                   = " << ta.results[0] << endl;
+    cout << "Number of cycles per byte          = " << ta.results[0] / volume << endl;
+    cout << "Number of cycles (ref)             = " << ta.results[5] << endl;
+    cout << "Number of cycles (ref) per byte    = " << ta.results[5] / volume << endl;
+    cout << "Number of instructions             = " << ta.results[1] << endl;
+    cout << "Number of instructions per byte    = " << ta.results[1] / volume << endl;
+    cout << "Number of instructions per cycle   = " << double(ta.results[1]) / ta.results[0] << endl;
+    cout << "Number of branch misses            = " << ta.results[2] << endl;
+    cout << "Number of branch misses per byte   = " << ta.results[2] / volume << endl;
+    cout << "Number of cache references         = " << ta.results[3] << endl;
+    cout << "Number of cache references per b.  = " << ta.results[3] / volume << endl;
+    cout << "Number of cache misses             = " << ta.results[4] << endl;
+    cout << "Number of cache misses per byte    = " << ta.results[4] / volume << endl;
+    cout << "CPU freq (effective)               = " << ta.results[0] / time_in_s / (1000 * 1000 * 1000) << endl; 
+    cout << "CPU freq (base)                    = " << ta.results[5] / time_in_s / (1000 * 1000 * 1000) << endl; 
+   } else {
+    ta.dump();
+  }
+  if (ta.working && o.perf_events.empty()) {
+    cout << "Cycles per byte " << (1.0*ta.results[0])/volume << "\n";
+  }
+#endif
+  cout << " GB/s: " << volume / time_in_s / (1024 * 1024 * 1024) << endl;
+  if (o.unescape) {
+    cout << " unescape GB/s: " << volume / unescape_total / (1024 * 1024 * 1024) << endl;
+  }
+  if (!o.schema.empty()) {
+    cout << " typed columns GB/s: " << volume / decode_total / (1024 * 1024 * 1024) << endl;
+  }
+  cout << " load time (s): " << load_time << " ("
+       << p.size() / load_time / (1024 * 1024 * 1024) << " GB/s)" << endl;
+  if (o.verbose) {
+    cout << "[verbose] done " << endl;
+  }
+  release_corpus();
+  return EXIT_SUCCESS;
+}
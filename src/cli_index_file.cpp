@@ -0,0 +1,83 @@
+#include <chrono>
+
+#include "cli.h"
+#include "csv_defs.h"
+#include "index_file.h"
+#include "io_util.h"
+#include "stream_parser.h"
+using namespace std;
+
+// index filename through the persistent index at index_path: reopened if it
+// is still valid, written otherwise
+int index_file_corpus(const char *filename, const char *index_path,
+                      const Dialect &dialect, bool dump, bool verbose) {
+  std::basic_string_view<uint8_t> p;
+  try {
+    p = map_corpus(filename, CSV_PADDING);
+  } catch (const std::exception &e) {
+    std::cout << "Could not load the file " << filename << std::endl;
+    return EXIT_FAILURE;
+  }
+  size_t len = p.size() - CSV_PADDING;
+  IndexFile index;
+  try {
+    auto start = chrono::steady_clock::now();
+    if (index.open(index_path, filename, p.data(), len, dialect)) {
+      double t = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      cout << "reopened " << index_path << " in " << t * 1e6 << " us" << endl;
+    } else {
+      // packed as the separators come, a window at a time: the memory
+      // taken is that of the window and of the index file, not 8 bytes of
+      // offset per byte of data
+      IndexFileWriter writer;
+      StreamParser parser(1 << 20, [&](const IndexBatch &batch) {
+        for (uint32_t i = 0; i < batch.n_indexes; i++) {
+          uint64_t offset = batch.base + batch.indexes[i];
+          writer.add(offset, batch.is_record_end(i));
+        }
+      }, dialect, 0, true);
+      for (size_t pos = 0; pos < len; pos += parser.window_size()) {
+        parser.feed_window(p.data() + pos, std::min(parser.window_size(), len - pos));
+      }
+      parser.finish();
+      writer.write(index_path, filename, p.data(), len, dialect);
+      double t = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+      if (!index.open(index_path, filename, p.data(), len, dialect)) {
+        throw std::runtime_error("could not reopen the index");
+      }
+      cout << "wrote " << index_path << " in " << t * 1e6 << " us" << endl;
+    }
+  } catch (const std::exception &e) {
+    cerr << e.what() << endl;
+    unmap_corpus(p);
+    return EXIT_FAILURE;
+  }
+  if (verbose) {
+    cout << "[verbose] " << index.n_rows() << " rows, " << index.n_indexes()
+         << " separators in " << index.file_size() << " bytes ("
+         << index.file_size() * 8.0 / std::max<size_t>(index.n_indexes(), 1)
+         << " bits per separator)" << endl;
+    size_t r = index.first_row_at(len / 2);
+    cout << "[verbose] the first row from the middle on is row " << r;
+    if (r < index.n_rows()) {
+      cout << ", at byte " << index.row_start(r);
+    }
+    cout << endl;
+  }
+  if (dump) {
+    for (size_t r = 0; r < index.n_rows(); r++) {
+      cout << r << ":";
+      for (size_t m = 0; m < index.row_fields(r); m++) {
+        uint64_t start, end;
+        index.field(r, m, start, end);
+        cout << (m == 0 ? " " : " | ");
+        for (size_t j = start; j < end; j++) {
+          cout << p[j];
+        }
+      }
+      cout << "\n";
+    }
+  }
+  unmap_corpus(p);
+  return EXIT_SUCCESS;
+}
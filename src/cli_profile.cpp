@@ -0,0 +1,33 @@
+#include <cstring>
+
+#include "cli.h"
+#include "common_defs.h"
+#include "stage_profile.h"
+using namespace std;
+
+// the stages of indexing filename, as JSON or CSV; only in a build with
+// SIMDCSV_INSTRUMENT, on Linux (the arguments are unused otherwise)
+int profile_corpus(UNUSED const char *filename, UNUSED const CliOptions &o) {
+#if defined(SIMDCSV_INSTRUMENT) && defined(__linux__)
+  vector<PerfEvent> events = o.perf_events;
+  if (events.empty()) {
+    string bad;
+    parse_perf_events("cycles,instructions,branch-misses", events, bad);
+  }
+  try {
+    StageProfile profile = profile_stages(filename, o.dialect, events, o.iterations);
+    if (strcmp(o.profile_format, "json") == 0) {
+      write_profile_json(cout, profile);
+    } else {
+      write_profile_csv(cout, profile);
+    }
+  } catch (const std::exception &e) {
+    std::cout << "Could not load the file " << filename << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+#else
+  cerr << "the stage profile needs a build with -DSIMDCSV_INSTRUMENT=ON, on Linux" << endl;
+  return EXIT_FAILURE;
+#endif
+}
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "cli.h"
+#include "csv_defs.h"
+#include "find_indexes.h"
+#include "io_util.h"
+#include "mem_util.h"
+#include "split_point.h"
+using namespace std;
+
+// split filename at n random offsets with find_split_point, and check the
+// split points and the pieces between them, each indexed on its own,
+// against the index of the whole
+int split_corpus(const char *filename, size_t n, const Dialect &dialect,
+                 bool verbose) {
+  std::basic_string_view<uint8_t> p;
+  try {
+    p = get_corpus(filename, CSV_PADDING);
+  } catch (const std::exception &e) {
+    std::cout << "Could not load the file " << filename << std::endl;
+    return EXIT_FAILURE;
+  }
+  size_t len = p.size() - CSV_PADDING;
+  if (!fits_index_type<uint32_t>(p.size())) {
+    cerr << filename << " is too large for 32-bit indexes" << endl;
+    aligned_free((void *)p.data());
+    return EXIT_FAILURE;
+  }
+  ParsedCSV pcsv;
+  std::vector<uint32_t> indexes(p.size());
+  std::vector<uint32_t> row_offsets(p.size() + 1);
+  pcsv.indexes = indexes.data();
+  pcsv.row_offsets = row_offsets.data();
+  find_indexes(p.data(), p.size(), pcsv, dialect);
+  // the record starts, the end of the data included
+  std::vector<size_t> starts = {0};
+  for (uint32_t r = 0; r < pcsv.n_rows - pcsv.last_row_open(); r++) {
+    starts.push_back(indexes[row_offsets[r + 1] - 1] + 1);
+  }
+  if (starts.back() != len) {
+    starts.push_back(len);
+  }
+
+  std::mt19937_64 rng(1);
+  std::vector<size_t> offsets;
+  for (size_t i = 0; i < n; i++) {
+    offsets.push_back(len > 0 ? rng() % len : 0);
+  }
+  std::sort(offsets.begin(), offsets.end());
+  size_t by_confidence[SPLIT_EXACT + 1] = {0};
+  size_t wrong = 0;
+  std::vector<size_t> splits = {0};
+  for (size_t offset : offsets) {
+    SplitPoint sp = find_split_point(p.data(), p.size(), offset, dialect);
+    by_confidence[sp.confidence]++;
+    if (sp.confidence == SPLIT_NONE) {
+      continue;
+    }
+    size_t expected = *std::lower_bound(starts.begin(), starts.end(), offset);
+    if (sp.offset != expected) {
+      wrong++;
+      cerr << "split at " << offset << ": " << sp.offset << " ("
+           << split_confidence_name(sp.confidence) << "), the record starts at "
+           << expected << endl;
+    } else if (verbose) {
+      cout << "[verbose] split at " << offset << ": " << sp.offset << " ("
+           << split_confidence_name(sp.confidence) << ")";
+      if (sp.contradiction.code != CSV_OK) {
+        cout << ", else " << csv_error_message(sp.contradiction.code)
+             << " at " << sp.contradiction.offset;
+      }
+      cout << endl;
+    }
+    if (sp.offset != splits.back()) {
+      splits.push_back(sp.offset);
+    }
+  }
+  if (splits.back() != len) {
+    splits.push_back(len);
+  }
+
+  // the pieces, as the workers would index them
+  std::vector<uint32_t> piece_indexes(p.size());
+  ParsedCSV piece;
+  piece.indexes = piece_indexes.data();
+  size_t n_indexes = 0;
+  size_t bad_pieces = 0;
+  for (size_t i = 0; i + 1 < splits.size(); i++) {
+    find_indexes_unpadded(p.data() + splits[i], splits[i + 1] - splits[i],
+                          piece, dialect);
+    bool same = n_indexes + piece.n_indexes <= pcsv.n_indexes;
+    for (uint32_t k = 0; same && k < piece.n_indexes; k++) {
+      same = piece_indexes[k] + splits[i] == indexes[n_indexes + k];
+    }
+    bad_pieces += !same;
+    n_indexes += piece.n_indexes;
+  }
+  bad_pieces += n_indexes != pcsv.n_indexes;
+
+  cout << "split points               :";
+  for (int c = SPLIT_EXACT; c >= SPLIT_NONE; c--) {
+    cout << " " << by_confidence[c] << " " << split_confidence_name(SplitConfidence(c));
+  }
+  cout << endl;
+  cout << "wrong split points         : " << wrong << endl;
+  cout << "pieces                     : " << splits.size() - 1 << " ("
+       << bad_pieces << " not matching the whole)" << endl;
+  aligned_free((void *)p.data());
+  return wrong == 0 && bad_pieces == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,125 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+#include "cli.h"
+#include "read_pipeline.h"
+#include "stream_parser.h"
+using namespace std;
+
+// index filename (or standard input, for "-") a window at a time, without
+// ever holding the whole file in memory; pipelined, the windows are read on
+// another thread while the previous ones are indexed
+int stream_corpus(const char *filename, size_t window, size_t iterations,
+                  const Dialect &dialect, bool utf8, bool strict,
+                  bool dump, bool verbose, bool pipelined) {
+  bool from_stdin = strcmp(filename, "-") == 0;
+  if (from_stdin) {
+    iterations = 1; // can only be read once
+    pipelined = false;
+  }
+  uint64_t n_indexes = 0;
+  bool dumping = dump;
+  unique_ptr<StreamParser> parser;
+  unique_ptr<ReadPipeline> pipeline;
+  try {
+    if (pipelined) {
+      pipeline.reset(new ReadPipeline(window));
+    }
+    parser.reset(new StreamParser(window, [&](const IndexBatch &batch) {
+      n_indexes += batch.n_indexes;
+      if (dumping) {
+        for (size_t i = 0; i < batch.n_indexes; i++) {
+          cout << batch.base + batch.indexes[i] << "\n";
+        }
+      }
+    }, dialect, (utf8 ? CHECK_UTF8 : 0) | (strict ? CHECK_STRICT : 0)));
+  } catch (const std::exception &e) {
+    cerr << e.what() << endl;
+    return EXIT_FAILURE;
+  }
+  if (verbose) {
+    cout << "[verbose] streaming " << filename << " in windows of "
+         << parser->window_size() << " bytes"
+         << (pipelined ? ", read ahead on another thread" : "") << endl;
+  }
+  double total = 0;
+  double volume = 0;
+  double consumer_wait = 0;
+  double reader_wait = 0;
+  uint64_t volume_in = 0; // compressed, if it is
+  for (size_t i = 0; i < iterations && pipelined; i++) {
+    n_indexes = 0;
+    dumping = dump && i == 0;
+    auto start = chrono::steady_clock::now();
+    try {
+      volume += pipeline->run(filename, [&](const uint8_t *buf, size_t len) {
+        parser->feed_window(buf, len);
+      });
+      parser->finish();
+    } catch (const std::exception &e) {
+      std::cout << "Could not load the file " << filename << std::endl;
+      return EXIT_FAILURE;
+    }
+    total += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    consumer_wait += pipeline->consumer_wait();
+    reader_wait += pipeline->reader_wait();
+    volume_in += pipeline->bytes_in();
+    if (i == 0 && pipeline->trailing_garbage() > 0) {
+      cerr << filename << ": " << pipeline->trailing_garbage()
+           << " bytes of trailing garbage ignored" << endl;
+    }
+  }
+  for (size_t i = 0; i < iterations && !pipelined; i++) {
+    n_indexes = 0;
+    dumping = dump && i == 0;
+    std::FILE *fp = from_stdin ? stdin : std::fopen(filename, "rb");
+    if (fp == nullptr) {
+      std::cout << "Could not load the file " << filename << std::endl;
+      return EXIT_FAILURE;
+    }
+    auto start = chrono::steady_clock::now();
+    try {
+      volume += parser->feed_file(fp);
+      parser->finish();
+    } catch (const std::exception &e) {
+      std::cout << "Could not load the file " << filename << std::endl;
+      if (!from_stdin) {
+        std::fclose(fp);
+      }
+      return EXIT_FAILURE;
+    }
+    total += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (!from_stdin) {
+      std::fclose(fp);
+    }
+  }
+  if (utf8) {
+    report_utf8(parser->utf8_error(), verbose);
+  }
+  if (strict) {
+    report_structure(parser->error(), verbose);
+  }
+  if (verbose) {
+    cout << "number of indexes found    : " << n_indexes << endl;
+    cout << "Total time in (s)          = " << total << endl;
+    if (pipelined) {
+      // the reader is busy reading (and decompressing) when it is not
+      // waiting for a free buffer; whichever side waits less is the bound
+      cout << "waiting for reads (s)      = " << consumer_wait << endl;
+      cout << "reader waiting (s)         = " << reader_wait << endl;
+      cout << "bytes read from the file   : " << volume_in / iterations << endl;
+      cout << "read/decompress GB/s       : "
+           << volume / (total - reader_wait) / (1024 * 1024 * 1024) << endl;
+      cout << "indexing GB/s              : "
+           << volume / (total - consumer_wait) / (1024 * 1024 * 1024) << endl;
+      cout << (consumer_wait > reader_wait ? "bound by reading/decompression"
+                                           : "bound by indexing")
+           << endl;
+    }
+  }
+  // this includes reading the file, unlike the in-memory figure
+  cout << " GB/s: " << volume / total / (1024 * 1024 * 1024) << endl;
+  return EXIT_SUCCESS;
+}
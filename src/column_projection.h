@@ -0,0 +1,186 @@
+#ifndef SIMDCSV_COLUMN_PROJECTION_H
+#define SIMDCSV_COLUMN_PROJECTION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "find_indexes.h"
+
+// the set of columns to materialize. A field is bounded by the separator
+// ending the column before it and its own, so those are the only separators
+// that are ever looked at individually: the "interesting" ones.
+class ColumnProjection {
+public:
+  explicit ColumnProjection(std::vector<size_t> columns_in)
+      : columns(std::move(columns_in)) {
+    std::sort(columns.begin(), columns.end());
+    columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+    size_t n = columns.empty() ? 0 : columns.back() + 1;
+    slots.assign(n, -1);
+    std::vector<bool> interesting(n, false);
+    for (size_t i = 0; i < columns.size(); i++) {
+      slots[columns[i]] = i;
+      interesting[columns[i]] = true;
+      if (columns[i] > 0) {
+        interesting[columns[i] - 1] = true;
+      }
+    }
+    next.resize(n);
+    size_t following = SIZE_MAX;
+    for (size_t c = n; c-- > 0;) {
+      if (interesting[c]) {
+        following = c;
+      }
+      next[c] = following;
+    }
+  }
+
+  // number of columns selected
+  size_t size() const { return columns.size(); }
+
+  // the selected columns, in ascending order
+  const std::vector<size_t> &selected() const { return columns; }
+
+  // the first column >= col whose closing separator matters, SIZE_MAX if none
+  size_t next_interesting(size_t col) const {
+    return col < next.size() ? next[col] : SIZE_MAX;
+  }
+
+  // where column col goes in a projected row, -1 if it is not selected
+  int slot(size_t col) const { return col < slots.size() ? slots[col] : -1; }
+
+private:
+  std::vector<size_t> columns;
+  std::vector<size_t> next;
+  std::vector<int> slots;
+};
+
+// the output of find_projected_indexes: for each row, 2 * width offsets,
+// the bytes [start, end) of each selected column in ascending column order.
+// A field missing from a short row is empty (start == end). Row r, selected
+// column j is fields[2 * (r * width + j)].
+template <typename index_t>
+struct BasicProjectedCSV {
+  index_t n_rows{0};
+  size_t width{0};
+  std::vector<index_t> fields;
+};
+
+typedef BasicProjectedCSV<uint32_t> ProjectedCSV;
+typedef BasicProjectedCSV<uint64_t> ProjectedCSV64;
+
+// find_indexes, but keeping only the fields of the selected columns. The
+// separator and record end masks come from the same kernel; within a block
+// the scan jumps straight to the next interesting separator or record end
+// (select_bit), so the cost scales with the number of selected fields rather
+// than with the number of separators.
+// A final record without a line ending ends at the end of the data.
+// returns false if the offsets would not fit index_t
+template <typename index_t>
+really_inline bool find_projected_indexes(const uint8_t * buf, size_t len,
+                                          const ColumnProjection & proj,
+                                          BasicProjectedCSV<index_t> & out,
+                                          const Dialect & dialect = Dialect()) {
+  if (!fits_index_type<index_t>(len)) {
+    return false;
+  }
+  ParseState state;
+  size_t lenminus64 = len < 64 ? 0 : len - 64;
+  const size_t width = proj.size();
+  index_t n_rows = 0;
+  // grown a row at a time, as the number of rows is not known in advance
+  std::vector<index_t> &fields = out.fields;
+  if (fields.size() < 2 * width) {
+    fields.resize(2 * width);
+  }
+  index_t *row = fields.data();
+  size_t col = 0;           // column of the field the scan is in
+  index_t field_start = 0;  // start of the field after the last separator seen
+  index_t row_start = 0;    // start of the record the scan is in
+  size_t filled = 0;        // selected fields of this row written so far
+  // as in find_indexes_range, the masks of a few blocks are computed ahead
+  // of their decoding for better pipelining
+  const size_t batch = 8;
+  const auto scan_blocks = active_kernel->scan_blocks;
+  uint64_t seps_ahead[batch];
+  uint64_t ends_ahead[batch];
+  for (size_t idx = 0; idx < lenminus64; idx += 64) {
+    size_t b = (idx / 64) % batch;
+    if (b == 0) {
+      scan_blocks(buf, idx, std::min(batch, (lenminus64 - idx + 63) / 64),
+                  dialect, state, seps_ahead, ends_ahead, 0);
+    }
+    uint64_t ends = ends_ahead[b];
+    uint64_t bits = seps_ahead[b];
+    while (bits != 0) {
+      size_t skip = proj.next_interesting(col) - col;
+      size_t n = hamming(bits);
+      uint64_t pending_ends = ends & bits;
+      if (skip >= n && pending_ends == 0) {
+        // nothing to see in the rest of this block
+        col += n;
+        break;
+      }
+      size_t pos;
+      size_t first_end = pending_ends != 0 ? trailingzeroes(pending_ends) : 64;
+      size_t target = skip < n ? select_bit(bits, skip) : 64;
+      if (first_end < target) {
+        col += hamming(bits & ((1ULL << first_end) - 1));
+        pos = first_end;
+      } else {
+        col += skip;
+        pos = target;
+      }
+      // the separator at pos closes column col
+      index_t at = static_cast<index_t>(idx + pos);
+      bool is_end = (ends >> pos) & 1;
+      int s = proj.slot(col);
+      if (s >= 0) {
+        row[2 * s] = field_start;
+        // record ends point at the LF of the CR-LF pair
+        row[2 * s + 1] = is_end && dialect.crlf ? at - 1 : at;
+        filled = s + 1;
+      }
+      field_start = at + 1;
+      col++;
+      if (is_end) {
+        row_start = field_start;
+        for (; filled < width; filled++) {
+          row[2 * filled] = at;
+          row[2 * filled + 1] = at;
+        }
+        n_rows++;
+        size_t needed = (static_cast<size_t>(n_rows) + 1) * 2 * width;
+        if (fields.size() < needed) {
+          fields.resize(std::max(needed, 2 * fields.size()));
+        }
+        row = fields.data() + static_cast<size_t>(n_rows) * 2 * width;
+        col = 0;
+        filled = 0;
+      }
+      bits &= ~((2ULL << pos) - 1);
+    }
+  }
+  // a final record without a line ending ends at the end of the data: col
+  // is its last field
+  if (row_start < lenminus64) {
+    index_t at = static_cast<index_t>(lenminus64);
+    int s = proj.slot(col);
+    if (s >= 0) {
+      row[2 * s] = field_start;
+      row[2 * s + 1] = at;
+      filled = s + 1;
+    }
+    for (; filled < width; filled++) {
+      row[2 * filled] = at;
+      row[2 * filled + 1] = at;
+    }
+    n_rows++;
+  }
+  out.n_rows = n_rows;
+  out.width = width;
+  return true;
+}
+
+#endif
@@ -0,0 +1,281 @@
+#ifndef SIMDCSV_COLUMNAR_H
+#define SIMDCSV_COLUMNAR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "find_indexes.h"
+#include "mem_util.h"
+#include "unescape.h"
+
+// Columnar output: instead of the separator offsets, one buffer set per
+// column, laid out as Apache Arrow lays out a variable-width string array
+// (utf8 with int32_t offsets, large_utf8 with int64_t offsets):
+//
+// - validity: a bitmap, bit r (least significant first) set if row r has
+//   the field, cleared if the row is too short to have it (a null)
+// - offsets: n_rows + 1 of them, field r being data[offsets[r], offsets[r + 1])
+// - data: the contents of the fields one after the other, unescaped (see
+//   unescape.h)
+//
+// Each buffer is 64-byte aligned and zero-padded to a multiple of 64
+// bytes, as Arrow recommends, so they can be handed to an Arrow consumer as
+// they are (through the C data interface, say), no copy needed.
+//
+// The fields go straight from the separator masks to their column: the
+// transposition is the flattening step, there is no index in between.
+
+// a buffer of T as Arrow wants them; throws an exception if it cannot grow
+template <typename T>
+class ArrowBuffer {
+public:
+  static_assert(std::is_trivially_copyable<T>::value, "a plain buffer");
+
+  ArrowBuffer() = default;
+  ~ArrowBuffer() { aligned_free(ptr); }
+  ArrowBuffer(const ArrowBuffer &) = delete;
+  ArrowBuffer &operator=(const ArrowBuffer &) = delete;
+  ArrowBuffer(ArrowBuffer &&other) noexcept
+      : ptr(other.ptr), n(other.n), capacity(other.capacity) {
+    other.ptr = nullptr;
+    other.n = other.capacity = 0;
+  }
+  ArrowBuffer &operator=(ArrowBuffer &&other) noexcept {
+    std::swap(ptr, other.ptr);
+    std::swap(n, other.n);
+    std::swap(capacity, other.capacity);
+    return *this;
+  }
+
+  T *data() { return ptr; }
+  const T *data() const { return ptr; }
+  size_t size() const { return n; }
+  T &operator[](size_t i) { return ptr[i]; }
+  const T &operator[](size_t i) const { return ptr[i]; }
+
+  void clear() { n = 0; }
+
+  // k more elements, left uninitialized: returns the first of them
+  T *extend(size_t k) {
+    if (n + k > capacity) {
+      grow(n + k);
+    }
+    T *p = ptr + n;
+    n += k;
+    return p;
+  }
+
+  // drop the last k elements
+  void shrink(size_t k) { n -= k; }
+
+  void push_back(T v) { *extend(1) = v; }
+
+  // append the len bytes at src, which must be readable 32 bytes past
+  // them: short runs are copied 32 bytes at a time, the bytes past len
+  // landing in the slack kept past the end, so that the padding is no
+  // longer zero (see zero_padding)
+  void append_bytes(const uint8_t *src, size_t len) {
+    static_assert(sizeof(T) == 1, "a byte buffer");
+    if (n + len + 32 > capacity) {
+      grow(n + len + 32);
+    }
+    if (len <= 32) {
+      memcpy(ptr + n, src, 32);
+    } else {
+      memcpy(ptr + n, src, len);
+    }
+    n += len;
+  }
+
+  // zero everything past the end, up to the capacity (a multiple of 64
+  // bytes): what append_bytes wrote there, and what a previous use of the
+  // buffer, longer, left
+  void zero_padding() {
+    if (ptr != nullptr) {
+      memset(ptr + n, 0, (capacity - n) * sizeof(T));
+    }
+  }
+
+private:
+  void grow(size_t at_least) {
+    size_t c = std::max(at_least, 2 * capacity);
+    size_t bytes = ROUNDUP_N(std::max<size_t>(c * sizeof(T), 64), 64);
+    T *p = static_cast<T *>(aligned_malloc(64, bytes));
+    if (p == nullptr) {
+      throw std::runtime_error("could not allocate memory");
+    }
+    if (n > 0) {
+      memcpy(p, ptr, n * sizeof(T));
+    }
+    // the padding is zeroed, as Arrow recommends
+    memset(reinterpret_cast<uint8_t *>(p) + n * sizeof(T), 0,
+           bytes - n * sizeof(T));
+    aligned_free(ptr);
+    ptr = p;
+    capacity = bytes / sizeof(T);
+  }
+
+  T *ptr{nullptr};
+  size_t n{0};
+  size_t capacity{0};
+};
+
+template <typename offset_t>
+struct BasicStringColumn {
+  ArrowBuffer<uint8_t> validity;
+  ArrowBuffer<offset_t> offsets;
+  ArrowBuffer<uint8_t> data;
+  size_t null_count{0};
+
+  bool is_valid(size_t r) const { return (validity[r / 8] >> (r % 8)) & 1; }
+
+  std::string_view value(size_t r) const {
+    return field_view(data.data() + offsets[r], offsets[r + 1] - offsets[r]);
+  }
+};
+
+// the columns are those of the first record: the fields of a longer record
+// past them are left out
+template <typename offset_t>
+struct BasicColumnarCSV {
+  static_assert(std::is_same<offset_t, int32_t>::value ||
+                std::is_same<offset_t, int64_t>::value,
+                "Arrow offsets are int32_t or int64_t");
+  size_t n_rows{0};
+  std::vector<BasicStringColumn<offset_t>> columns;
+};
+
+typedef BasicColumnarCSV<int32_t> ColumnarCSV;   // Arrow utf8
+typedef BasicColumnarCSV<int64_t> ColumnarCSV64; // Arrow large_utf8
+
+// append the contents of field buf[start, end) to column c (for row r); buf
+// is padded (CSV_PADDING)
+template <typename offset_t>
+really_inline void append_field(BasicStringColumn<offset_t> &c, size_t r,
+                                const uint8_t *buf, size_t start, size_t end,
+                                uint8_t quote) {
+  if (quoted_field_inside(buf, start, end, quote) &&
+      memchr(buf + start, quote, end - start) != nullptr) {
+    uint8_t *out = c.data.extend(end - start);
+    size_t len = active_kernel->unescape(buf + start, end - start, quote, out);
+    c.data.shrink(end - start - len);
+  } else {
+    c.data.append_bytes(buf + start, end - start);
+  }
+  c.offsets.push_back(static_cast<offset_t>(c.data.size()));
+  c.validity[r / 8] |= static_cast<uint8_t>(1 << (r % 8));
+}
+
+// row r of column c is a null
+template <typename offset_t>
+really_inline void append_null(BasicStringColumn<offset_t> &c) {
+  c.offsets.push_back(static_cast<offset_t>(c.data.size()));
+  c.null_count++;
+}
+
+// the columns of buf as Arrow arrays (see above), a final record without a
+// line ending included. An empty input has no columns.
+// returns false if the offsets would not fit offset_t
+// The dialect must be valid (see valid_dialect).
+template <typename offset_t>
+really_inline bool find_columns(const uint8_t *buf, size_t len,
+                                BasicColumnarCSV<offset_t> &out,
+                                const Dialect &dialect = Dialect()) {
+  if (len > static_cast<size_t>(std::numeric_limits<offset_t>::max())) {
+    return false;
+  }
+  ParseState state;
+  size_t lenminus64 = len < 64 ? 0 : len - 64;
+  // the buffers of a previous call are reused
+  std::vector<BasicStringColumn<offset_t>> &columns = out.columns;
+  size_t n_columns = 0;
+  size_t width = SIZE_MAX; // until the first record ends
+  size_t n_rows = 0;
+  size_t col = 0;
+  size_t field_start = 0;
+  // as in find_indexes_range, the masks of a few blocks are computed ahead
+  // of their decoding
+  const size_t batch = 8;
+  const auto scan_blocks = active_kernel->scan_blocks;
+  uint64_t seps_ahead[batch];
+  uint64_t ends_ahead[batch];
+  size_t row_start = 0;
+  // the field from field_start up to end, a record end if is_end
+  auto add_field = [&](size_t end, bool is_end) {
+    if (col < width) {
+      if (col == n_columns) {
+        // a new column, within the first record
+        if (n_columns == columns.size()) {
+          columns.emplace_back();
+        }
+        BasicStringColumn<offset_t> &c = columns[n_columns++];
+        c.validity.clear();
+        c.offsets.clear();
+        c.data.clear();
+        c.null_count = 0;
+        c.validity.push_back(0);
+        c.offsets.push_back(0);
+      }
+      append_field(columns[col], n_rows, buf, field_start, end, dialect.quote);
+    }
+    col++;
+    if (is_end) {
+      if (width == SIZE_MAX) {
+        width = n_columns;
+        columns.resize(width);
+      }
+      for (; col < width; col++) {
+        append_null(columns[col]);
+      }
+      n_rows++;
+      if (n_rows % 8 == 0) {
+        for (auto &c : columns) {
+          c.validity.push_back(0);
+        }
+      }
+      col = 0;
+    }
+  };
+  for (size_t idx = 0; idx < lenminus64; idx += 64) {
+    size_t b = (idx / 64) % batch;
+    if (b == 0) {
+      scan_blocks(buf, idx, std::min(batch, (lenminus64 - idx + 63) / 64),
+                  dialect, state, seps_ahead, ends_ahead, 0);
+    }
+    uint64_t ends = ends_ahead[b];
+    uint64_t bits = seps_ahead[b];
+    while (bits != 0) {
+      size_t pos = trailingzeroes(bits);
+      size_t at = idx + pos;
+      bool is_end = (ends >> pos) & 1;
+      // record ends point at the LF of the CR-LF pair
+      add_field(is_end && dialect.crlf ? at - 1 : at, is_end);
+      field_start = at + 1;
+      if (is_end) {
+        row_start = at + 1;
+      }
+      bits &= bits - 1;
+    }
+  }
+  // a final record without a line ending ends at the end of the data
+  if (row_start < lenminus64) {
+    add_field(lenminus64, true);
+  }
+  if (width == SIZE_MAX) {
+    columns.clear();
+  }
+  for (auto &c : columns) {
+    c.validity.zero_padding();
+    c.offsets.zero_padding();
+    c.data.zero_padding();
+  }
+  out.n_rows = n_rows;
+  return true;
+}
+
+#endif
@@ -52,4 +52,26 @@
 
 #endif  // MSC_VER
 
+// compile a region of code for a given instruction set, whatever the flags
+// of the build, so that the right one can be picked at runtime:
+//   SIMDCSV_TARGET_REGION("avx2,pclmul")
+//   ... functions using AVX2 ...
+//   SIMDCSV_UNTARGET_REGION
+// intrinsic headers must be included before the region.
+#define SIMDCSV_STRINGIFY_IMPLEMENTATION_(a) #a
+#define SIMDCSV_STRINGIFY(a) SIMDCSV_STRINGIFY_IMPLEMENTATION_(a)
+
+#if defined(__clang__)
+#define SIMDCSV_TARGET_REGION(T)                                               \
+  _Pragma(SIMDCSV_STRINGIFY(clang attribute push(__attribute__((target(T))), apply_to = function)))
+#define SIMDCSV_UNTARGET_REGION _Pragma("clang attribute pop")
+#elif defined(__GNUC__)
+#define SIMDCSV_TARGET_REGION(T)                                               \
+  _Pragma("GCC push_options") _Pragma(SIMDCSV_STRINGIFY(GCC target(T)))
+#define SIMDCSV_UNTARGET_REGION _Pragma("GCC pop_options")
+#else
+#define SIMDCSV_TARGET_REGION(T)
+#define SIMDCSV_UNTARGET_REGION
+#endif
+
 #endif // SIMDJSON_COMMON_DEFS_H
@@ -0,0 +1,32 @@
+#ifndef SIMDCSV_COMPRESS_LUT_H
+#define SIMDCSV_COMPRESS_LUT_H
+
+#include <cstdint>
+
+// the byte shuffles that compress 8 bytes: entry k lists, in order, the
+// positions of the bits set in k, followed by 0x80 (which pshufb and tbl
+// both turn into a zero byte). Used by the kernels to drop the bytes of a
+// block that are not wanted (see Kernel::unescape), 8 at a time.
+struct CompressLut {
+  uint8_t shuffle[256][8];
+};
+
+constexpr CompressLut make_compress_lut() {
+  CompressLut lut{};
+  for (int k = 0; k < 256; k++) {
+    int n = 0;
+    for (int i = 0; i < 8; i++) {
+      if (k & (1 << i)) {
+        lut.shuffle[k][n++] = static_cast<uint8_t>(i);
+      }
+    }
+    for (; n < 8; n++) {
+      lut.shuffle[k][n] = 0x80;
+    }
+  }
+  return lut;
+}
+
+inline constexpr CompressLut compress_lut = make_compress_lut();
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef SIMDCSV_COUNT_FIELDS_H
+#define SIMDCSV_COUNT_FIELDS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "common_defs.h"
+#include "dialect.h"
+#include "portability.h"
+#include "simd_kernels.h"
+
+// Counting without indexing: the rows, the fields and how many rows have
+// each number of fields, from the separator and record-end masks of the
+// kernel's scan alone. Nothing is flattened and there is no index array;
+// the masks of a batch of blocks stay in the L1 cache, and a block without
+// a record end costs a single popcount.
+
+struct CsvCounts {
+  // the separators (record ends included) and the rows, a last one without
+  // a line ending included, as find_indexes would find them (its n_indexes
+  // and n_rows)
+  uint64_t n_separators{0};
+  uint64_t n_rows{0};
+  // the fields of a last row without a line ending, 0 if there is none
+  uint64_t final_fields{0};
+  // histogram[k]: the rows with k fields
+  std::vector<uint64_t> histogram;
+
+  // the fields of all the rows (see BasicParsedCSV::n_fields)
+  uint64_t n_fields() const { return n_separators + (final_fields != 0); }
+
+  // do all the rows have the same number of fields?
+  bool uniform() const {
+    return std::count_if(histogram.begin(), histogram.end(),
+                         [](uint64_t n) { return n != 0; }) <= 1;
+  }
+};
+
+// count buf, len counting the padding as for find_indexes
+// The dialect must be valid (see valid_dialect).
+really_inline void count_fields(const uint8_t *buf, size_t len,
+                                CsvCounts &counts,
+                                const Dialect &dialect = Dialect()) {
+  size_t lenminus64 = len < 64 ? 0 : len - 64;
+  ParseState state;
+  const size_t batch = 64;
+  const auto scan_blocks = active_kernel->scan_blocks;
+  uint64_t seps[batch];
+  uint64_t ends[batch];
+  // most records have few fields: those are counted in an array, the
+  // others in the histogram directly
+  const uint64_t small = 256;
+  uint64_t small_counts[small] = {0};
+  uint64_t n_separators = 0;
+  uint64_t n_rows = 0;
+  uint64_t row_fields = 0; // the separators of the current record so far
+  size_t last_end = 0;     // one past the last record end
+  counts.histogram.clear();
+  for (size_t idx = 0; idx < lenminus64;) {
+    size_t n_blocks = std::min(batch, (lenminus64 - idx + 63) / 64);
+    scan_blocks(buf, idx, n_blocks, dialect, state, seps, ends, 0);
+    for (size_t b = 0; b < n_blocks; b++) {
+      uint64_t s = seps[b];
+      uint64_t e = ends[b];
+      n_separators += hamming(s);
+      if (e != 0) {
+        last_end = idx + 64 * b + 64 - leadingzeroes(e);
+      }
+      while (e != 0) {
+        // the separators up to and including this record end
+        uint64_t mask = e ^ (e - 1);
+        uint64_t fields = row_fields + hamming(s & mask);
+        if (likely(fields < small)) {
+          small_counts[fields]++;
+        } else {
+          if (counts.histogram.size() <= fields) {
+            counts.histogram.resize(fields + 1, 0);
+          }
+          counts.histogram[fields]++;
+        }
+        n_rows++;
+        row_fields = 0;
+        s &= ~mask;
+        e &= e - 1;
+      }
+      row_fields += hamming(s);
+    }
+    idx += 64 * n_blocks;
+  }
+  counts.n_separators = n_separators;
+  // a last record without a line ending has a field past its separators
+  counts.final_fields = last_end < lenminus64 ? row_fields + 1 : 0;
+  counts.n_rows = n_rows + (counts.final_fields != 0);
+  if (counts.final_fields != 0) {
+    if (counts.final_fields < small) {
+      small_counts[counts.final_fields]++;
+    } else {
+      if (counts.histogram.size() <= counts.final_fields) {
+        counts.histogram.resize(counts.final_fields + 1, 0);
+      }
+      counts.histogram[counts.final_fields]++;
+    }
+  }
+  uint64_t top = small;
+  while (top > 0 && small_counts[top - 1] == 0) {
+    top--;
+  }
+  if (counts.histogram.size() < top) {
+    counts.histogram.resize(top, 0);
+  }
+  for (uint64_t k = 0; k < top; k++) {
+    counts.histogram[k] += small_counts[k];
+  }
+}
+
+#endif
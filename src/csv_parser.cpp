@@ -0,0 +1,122 @@
+#include "csv_parser.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/mman.h> // for mmap
+#include <unistd.h>   // for sysconf
+
+#include "csv_defs.h"
+
+PageBuffer::~PageBuffer() {
+  if (ptr != nullptr) {
+    munmap(ptr, capacity);
+  }
+}
+
+void PageBuffer::grow(size_t n) {
+  // huge pages are 2 MiB on x64; smaller buffers would not get any
+  size_t unit = huge_pages ? size_t(2) << 20 : sysconf(_SC_PAGESIZE);
+  size_t c = ROUNDUP_N(std::max(n, 2 * capacity), unit);
+  // mmap only aligns to the page: for huge pages, map a unit more and keep
+  // the aligned part, or the first and last 2 MiB would not be huge pages
+  size_t slack = huge_pages ? unit : 0;
+  void *m = mmap(nullptr, c + slack, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (m == MAP_FAILED) {
+    throw std::runtime_error("could not allocate memory");
+  }
+  uint8_t *p = static_cast<uint8_t *>(m);
+  if (huge_pages) {
+    uint8_t *aligned = reinterpret_cast<uint8_t *>(
+        ROUNDUP_N(reinterpret_cast<uintptr_t>(p), unit));
+    if (aligned != p) {
+      munmap(p, aligned - p);
+    }
+    if (aligned + c != p + c + slack) {
+      munmap(aligned + c, p + slack - aligned);
+    }
+    p = aligned;
+  }
+#ifdef MADV_HUGEPAGE
+  if (huge_pages) {
+    madvise(p, c, MADV_HUGEPAGE);
+  }
+#endif
+  if (ptr != nullptr) {
+    munmap(ptr, capacity);
+  }
+  ptr = p;
+  capacity = c;
+}
+
+CsvParser::CsvParser(bool with_rows_in, bool huge_pages)
+    : with_rows(with_rows_in), corpus(huge_pages), indexes(huge_pages),
+      row_offsets(huge_pages) {}
+
+bool CsvParser::prepare(size_t n, bool with_corpus) {
+  if (!fits_index_type<uint32_t>(n + CSV_PADDING)) {
+    return false;
+  }
+  if (with_corpus) {
+    data_ptr = corpus.reserve(n + CSV_PADDING);
+  }
+  // can't have more indexes than we have data
+  pcsv.indexes = reinterpret_cast<uint32_t *>(
+      indexes.reserve((n + CSV_PADDING) * sizeof(uint32_t)));
+  pcsv.row_offsets =
+      with_rows ? reinterpret_cast<uint32_t *>(row_offsets.reserve(
+                      (n + CSV_PADDING + 1) * sizeof(uint32_t)))
+                : nullptr;
+  len = n;
+  return true;
+}
+
+bool CsvParser::index(const Dialect &dialect) {
+  // nothing after the data may look like a separator to the last block
+  memset(corpus.data() + len, 0, CSV_PADDING);
+  return find_indexes(corpus.data(), len + CSV_PADDING, pcsv, dialect);
+}
+
+bool CsvParser::parse(std::basic_string_view<uint8_t> input,
+                      const Dialect &dialect) {
+  if (!prepare(input.size())) {
+    return false;
+  }
+  if (!input.empty()) {
+    memcpy(corpus.data(), input.data(), input.size());
+  }
+  return index(dialect);
+}
+
+bool CsvParser::parse_in_place(std::basic_string_view<uint8_t> input,
+                               const Dialect &dialect) {
+  if (!prepare(input.size(), false)) {
+    return false;
+  }
+  data_ptr = input.data();
+  return find_indexes_unpadded(input.data(), input.size(), pcsv, dialect);
+}
+
+bool CsvParser::parse_file(const std::string &filename,
+                           const Dialect &dialect) {
+  std::FILE *fp = std::fopen(filename.c_str(), "rb");
+  if (fp == nullptr) {
+    throw std::runtime_error("could not load corpus");
+  }
+  std::fseek(fp, 0, SEEK_END);
+  size_t n = std::ftell(fp);
+  std::rewind(fp);
+  if (!prepare(n)) {
+    std::fclose(fp);
+    return false;
+  }
+  size_t readb = std::fread(corpus.data(), 1, n, fp);
+  std::fclose(fp);
+  if (readb != n) {
+    throw std::runtime_error("could not read the data");
+  }
+  return index(dialect);
+}
@@ -0,0 +1,95 @@
+#ifndef SIMDCSV_CSV_PARSER_H
+#define SIMDCSV_CSV_PARSER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "dialect.h"
+#include "find_indexes.h"
+
+// A parser to keep around, for many inputs one after the other: the corpus
+// and its index go to buffers the parser owns and keeps from one input to
+// the next, only ever growing them. After the first few inputs, parsing
+// another allocates nothing, and touches pages that are already mapped.
+
+// page-aligned memory (aligned to 2 MiB with huge pages), mapped
+// anonymously; it grows, never shrinks, and its contents are not kept when
+// it grows
+class PageBuffer {
+public:
+  explicit PageBuffer(bool huge_pages_in = false) : huge_pages(huge_pages_in) {}
+  ~PageBuffer();
+  PageBuffer(const PageBuffer &) = delete;
+  PageBuffer &operator=(const PageBuffer &) = delete;
+
+  // room for at least n bytes; throws an exception if it cannot be mapped
+  uint8_t *reserve(size_t n) {
+    if (n > capacity) {
+      grow(n);
+    }
+    return ptr;
+  }
+
+  uint8_t *data() const { return ptr; }
+  size_t size() const { return capacity; }
+
+private:
+  void grow(size_t n);
+
+  bool huge_pages;
+  uint8_t *ptr{nullptr};
+  size_t capacity{0};
+};
+
+// throws an exception if its buffers cannot be mapped
+class CsvParser {
+public:
+  // with_rows: record the row structure as well (see BasicParsedCSV);
+  // huge_pages: ask for transparent huge pages for the buffers
+  explicit CsvParser(bool with_rows = false, bool huge_pages = false);
+
+  // index input, copied to the parser's padded buffer first (its own
+  // memory need not be padded); returns false if it is too large for
+  // 32-bit offsets. The dialect must be valid (see valid_dialect).
+  bool parse(std::basic_string_view<uint8_t> input,
+             const Dialect &dialect = Dialect());
+
+  // index input where it is, without copying it: it need not be padded
+  // (see find_indexes_unpadded), and must outlive the use of the index.
+  // data() is then input.data(), with nothing after it.
+  bool parse_in_place(std::basic_string_view<uint8_t> input,
+                      const Dialect &dialect = Dialect());
+
+  // likewise for the contents of filename, read straight to the buffer
+  // throws an exception if the file cannot be read
+  bool parse_file(const std::string &filename,
+                  const Dialect &dialect = Dialect());
+
+  // of the last input: its bytes (followed by CSV_PADDING zeros, unless
+  // parsed in place) and index, valid until the next parse
+  const uint8_t *data() const { return data_ptr; }
+  size_t size() const { return len; }
+  const ParsedCSV &index() const { return pcsv; }
+
+  // the memory held, in bytes
+  size_t footprint() const {
+    return corpus.size() + indexes.size() + row_offsets.size();
+  }
+
+private:
+  // the buffers for an input of n bytes, the corpus only if asked; false if
+  // it is too large
+  bool prepare(size_t n, bool with_corpus = true);
+  bool index(const Dialect &dialect);
+
+  bool with_rows;
+  PageBuffer corpus;
+  PageBuffer indexes;
+  PageBuffer row_offsets;
+  const uint8_t *data_ptr{nullptr};
+  size_t len{0};
+  ParsedCSV pcsv;
+};
+
+#endif
@@ -0,0 +1,280 @@
+#include "decompress.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>    // for open, posix_fadvise
+#include <sys/stat.h> // for fstat
+#include <unistd.h>   // for pread, close
+
+#ifdef SIMDCSV_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef SIMDCSV_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// the compressed input is read this much at a time
+const size_t chunk_size = 1 << 18;
+
+// a file, read with pread from a running offset
+class FileReader {
+public:
+  explicit FileReader(const char *filename) {
+    fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+      throw std::runtime_error("could not load corpus");
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  }
+  ~FileReader() { close(fd); }
+  FileReader(const FileReader &) = delete;
+  FileReader &operator=(const FileReader &) = delete;
+
+  // up to len bytes, fewer only at the end of the file
+  size_t read(uint8_t *buf, size_t len) {
+    size_t n = 0;
+    while (n < len) {
+      ssize_t r = pread(fd, buf + n, len - n, offset);
+      if (r < 0 && errno == EINTR) {
+        continue;
+      }
+      if (r < 0) {
+        throw std::runtime_error("could not read the data");
+      }
+      if (r == 0) {
+        break;
+      }
+      n += r;
+      offset += r;
+    }
+    return n;
+  }
+
+  // the size of the file, or 0 if it cannot be had
+  uint64_t size() const {
+    struct stat st;
+    return fstat(fd, &st) == 0 ? static_cast<uint64_t>(st.st_size) : 0;
+  }
+
+  uint64_t offset{0};
+
+private:
+  int fd;
+};
+
+class PlainSource : public ByteSource {
+public:
+  explicit PlainSource(const char *filename) : file(filename) {}
+  size_t read(uint8_t *buf, size_t len) override { return file.read(buf, len); }
+  uint64_t bytes_in() const override { return file.offset; }
+
+private:
+  FileReader file;
+};
+
+#ifdef SIMDCSV_HAVE_ZLIB
+// concatenated gzip members decompress to the concatenation of their
+// contents. As with gzip -d, what follows the first member and does not
+// start another (a header that is invalid or cut short: zeros padding the
+// file to a block, say) ends the data, and is trailing garbage; an error
+// past a member's header is an error.
+class GzipSource : public ByteSource {
+public:
+  explicit GzipSource(const char *filename) : file(filename), in(chunk_size) {
+    memset(&z, 0, sizeof(z));
+    // 16: a gzip header and trailer around the deflate stream
+    if (inflateInit2(&z, 15 + 16) != Z_OK) {
+      throw std::runtime_error("could not allocate memory");
+    }
+    start_member();
+  }
+  ~GzipSource() override { inflateEnd(&z); }
+
+  size_t read(uint8_t *buf, size_t len) override {
+    z.next_out = buf;
+    z.avail_out = static_cast<uInt>(len);
+    while (z.avail_out > 0 && !done) {
+      if (z.avail_in == 0) {
+        z.next_in = in.data();
+        z.avail_in = static_cast<uInt>(file.read(in.data(), in.size()));
+        if (z.avail_in == 0) {
+          // the input ends inside a member, or between them
+          if (in_member && !in_trailer()) {
+            throw std::runtime_error("could not decompress the data");
+          }
+          end_data(file.offset);
+          break;
+        }
+      }
+      in_member = true;
+      int ret = inflate(&z, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END) {
+        inflateReset(&z);
+        n_members++;
+        start_member();
+      } else if (ret == Z_DATA_ERROR && in_trailer()) {
+        end_data(file.size());
+      } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        throw std::runtime_error("could not decompress the data");
+      }
+    }
+    return len - z.avail_out;
+  }
+
+  uint64_t bytes_in() const override { return file.offset; }
+
+  uint64_t trailing_garbage() const override { return garbage; }
+
+private:
+  // a member starts at the next input byte
+  void start_member() {
+    memset(&header, 0, sizeof(header));
+    inflateGetHeader(&z, &header);
+    member_start = file.offset - z.avail_in;
+    in_member = false;
+  }
+
+  // is the current member no member at all, but what follows the data? (its
+  // header not read yet, or no gzip header: done is 0 or -1)
+  bool in_trailer() const { return n_members > 0 && header.done != 1; }
+
+  // the data ends at member_start, the file at file_size
+  void end_data(uint64_t file_size) {
+    garbage = in_member ? file_size - member_start : 0;
+    done = true;
+  }
+
+  FileReader file;
+  std::vector<uint8_t> in;
+  z_stream z;
+  gz_header header;
+  size_t n_members{0};
+  uint64_t member_start{0};
+  uint64_t garbage{0};
+  bool in_member{false};
+  bool done{false};
+};
+#endif // SIMDCSV_HAVE_ZLIB
+
+#ifdef SIMDCSV_HAVE_ZSTD
+// likewise for concatenated zstd frames
+class ZstdSource : public ByteSource {
+public:
+  explicit ZstdSource(const char *filename) : file(filename), in(chunk_size) {
+    stream = ZSTD_createDStream();
+    if (stream == nullptr) {
+      throw std::runtime_error("could not allocate memory");
+    }
+    ZSTD_initDStream(stream);
+    input.src = in.data();
+    input.size = 0;
+    input.pos = 0;
+  }
+  ~ZstdSource() override { ZSTD_freeDStream(stream); }
+
+  size_t read(uint8_t *buf, size_t len) override {
+    ZSTD_outBuffer output = {buf, len, 0};
+    while (output.pos < len && !done) {
+      if (input.pos == input.size) {
+        input.size = file.read(in.data(), in.size());
+        input.pos = 0;
+        if (input.size == 0) {
+          if (in_frame) {
+            throw std::runtime_error("could not decompress the data");
+          }
+          done = true;
+          break;
+        }
+      }
+      size_t ret = ZSTD_decompressStream(stream, &output, &input);
+      if (ZSTD_isError(ret)) {
+        throw std::runtime_error("could not decompress the data");
+      }
+      // 0 once a frame is complete and flushed
+      in_frame = ret != 0;
+    }
+    return output.pos;
+  }
+
+  uint64_t bytes_in() const override { return file.offset; }
+
+private:
+  FileReader file;
+  std::vector<uint8_t> in;
+  ZSTD_DStream *stream;
+  ZSTD_inBuffer input;
+  bool in_frame{false};
+  bool done{false};
+};
+#endif // SIMDCSV_HAVE_ZSTD
+
+} // namespace
+
+Compression detect_compression(const char *filename) {
+  FileReader file(filename);
+  uint8_t magic[4] = {0, 0, 0, 0};
+  size_t n = file.read(magic, 4);
+  if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    return COMPRESSION_GZIP;
+  }
+  if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f &&
+      magic[3] == 0xfd) {
+    return COMPRESSION_ZSTD;
+  }
+  return COMPRESSION_NONE;
+}
+
+const char *compression_name(Compression c) {
+  switch (c) {
+  case COMPRESSION_GZIP:
+    return "gzip";
+  case COMPRESSION_ZSTD:
+    return "zstd";
+  default:
+    return "none";
+  }
+}
+
+bool compression_supported(Compression c) {
+  switch (c) {
+  case COMPRESSION_NONE:
+    return true;
+#ifdef SIMDCSV_HAVE_ZLIB
+  case COMPRESSION_GZIP:
+    return true;
+#endif
+#ifdef SIMDCSV_HAVE_ZSTD
+  case COMPRESSION_ZSTD:
+    return true;
+#endif
+  default:
+    return false;
+  }
+}
+
+std::unique_ptr<ByteSource> open_source(const char *filename) {
+  Compression c = detect_compression(filename);
+  switch (c) {
+#ifdef SIMDCSV_HAVE_ZLIB
+  case COMPRESSION_GZIP:
+    return std::unique_ptr<ByteSource>(new GzipSource(filename));
+#endif
+#ifdef SIMDCSV_HAVE_ZSTD
+  case COMPRESSION_ZSTD:
+    return std::unique_ptr<ByteSource>(new ZstdSource(filename));
+#endif
+  case COMPRESSION_NONE:
+    return std::unique_ptr<ByteSource>(new PlainSource(filename));
+  default:
+    throw std::runtime_error(std::string("no support for ") +
+                             compression_name(c) + " compiled in");
+  }
+}
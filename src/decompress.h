@@ -0,0 +1,51 @@
+#ifndef SIMDCSV_DECOMPRESS_H
+#define SIMDCSV_DECOMPRESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Where ReadPipeline gets its bytes from: a file as it is, or a gzip or
+// zstd compressed file, decompressed as it is read. The compressed formats
+// are only there if their library was found at build time (zlib defines
+// SIMDCSV_HAVE_ZLIB, libzstd SIMDCSV_HAVE_ZSTD; see CMakeLists.txt).
+
+enum Compression {
+  COMPRESSION_NONE,
+  COMPRESSION_GZIP, // starts with 1f 8b
+  COMPRESSION_ZSTD, // starts with 28 b5 2f fd
+};
+
+// the compression of filename, from its first bytes (not its name)
+// throws an exception if it cannot be read
+Compression detect_compression(const char *filename);
+
+const char *compression_name(Compression c);
+
+// is support for c compiled in?
+bool compression_supported(Compression c);
+
+class ByteSource {
+public:
+  virtual ~ByteSource() {}
+
+  // fill buf with up to len bytes: fewer only at the end of the input
+  // returns the number of bytes written; throws an exception if the input
+  // cannot be read or decompressed
+  virtual size_t read(uint8_t *buf, size_t len) = 0;
+
+  // the bytes taken from the file so far (compressed, if it is)
+  virtual uint64_t bytes_in() const = 0;
+
+  // once read has returned fewer bytes than asked: the bytes of the file
+  // past the end of the compressed data, left out (trailing zeros, or
+  // garbage that does not start a gzip member)
+  virtual uint64_t trailing_garbage() const { return 0; }
+};
+
+// a source for filename, decompressing it if need be
+// throws an exception if it cannot be opened, or its compression is not
+// supported
+std::unique_ptr<ByteSource> open_source(const char *filename);
+
+#endif
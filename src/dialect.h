@@ -0,0 +1,34 @@
+#ifndef SIMDCSV_DIALECT_H
+#define SIMDCSV_DIALECT_H
+
+#include <cstdint>
+
+// how fields and records are delimited. The default is RFC 4180 with bare LF
+// line endings; quotes are escaped by doubling them, whatever the quote is.
+struct Dialect {
+  uint8_t delimiter{','};
+  uint8_t quote{'"'};
+  // records end with CR-LF: a bare LF is then ordinary field content, and a
+  // record end points at the LF of the pair
+  bool crlf{false};
+};
+
+// a dialect fixed at compile time. The kernels are instantiated for the
+// common ones (see with_dialect in kernel_generic.h), so that their hot loops
+// compare against constants; any other dialect goes through a slightly
+// slower loop reading a Dialect.
+template <uint8_t delimiter_, uint8_t quote_, bool crlf_>
+struct StaticDialect {
+  static constexpr uint8_t delimiter = delimiter_;
+  static constexpr uint8_t quote = quote_;
+  static constexpr bool crlf = crlf_;
+};
+
+// can the dialect be parsed at all? The delimiter and the quote must differ,
+// and neither can be part of a line ending.
+inline bool valid_dialect(const Dialect &d) {
+  return d.delimiter != d.quote && d.delimiter != 0x0a && d.delimiter != 0x0d &&
+         d.quote != 0x0a && d.quote != 0x0d;
+}
+
+#endif
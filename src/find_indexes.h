@@ -0,0 +1,335 @@
+#ifndef SIMDCSV_FIND_INDEXES_H
+#define SIMDCSV_FIND_INDEXES_H
+
+#include "common_defs.h"
+#include "portability.h"
+#include "simd_kernels.h"
+#include "flatten_bits.h"
+#include "utf8.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+// the separator offsets found by find_indexes. 32-bit offsets are the default,
+// as they halve the memory traffic of flattening; they can only describe
+// inputs up to 4 GiB, beyond which the 64-bit variant must be used.
+//
+// If row_offsets is set (to room for len + 1 entries), find_indexes also
+// records the row structure, CSR style: the separators of row r are
+// indexes[row_offsets[r]] .. indexes[row_offsets[r + 1] - 1], the last of
+// them being its record end. row_offsets[0] is 0 and there are n_rows + 1
+// entries. A final record without a line ending (the last one is optional
+// in RFC 4180) is a row too: its last field ends at the end of the data,
+// the offset of which is then written to indexes[n_indexes], past the
+// separators proper, with row_offsets[n_rows] = n_indexes + 1 (see
+// last_row_open). Without the row structure, there is nothing past them.
+//
+// If validate_utf8 is set, find_indexes also checks that the input is UTF-8,
+// in the same pass: utf8_error is then the offset of the first byte of the
+// first ill-formed sequence, or SIZE_MAX if there is none.
+//
+// If strict is set, find_indexes also checks that the input is well-formed
+// RFC 4180 (see strict_check.h), in the same pass: 'error' then tells what
+// the first structural error is and where. The indexes are still all there.
+template <typename index_t>
+struct BasicParsedCSV {
+  static_assert(std::numeric_limits<index_t>::is_integer &&
+                !std::numeric_limits<index_t>::is_signed,
+                "indexes are unsigned integers");
+  index_t n_indexes{0};
+  index_t *indexes;
+  index_t n_rows{0};
+  index_t *row_offsets{nullptr};
+  // the dialect the input was indexed with, set by find_indexes
+  Dialect dialect;
+  bool validate_utf8{false};
+  size_t utf8_error{SIZE_MAX};
+  bool strict{false};
+  StructureError error;
+
+  // the checks find_indexes has the kernel do (see Kernel)
+  unsigned checks() const {
+    return (validate_utf8 ? CHECK_UTF8 : 0) | (strict ? CHECK_STRICT : 0);
+  }
+
+  // number of fields of row r
+  index_t row_fields(index_t r) const {
+    return row_offsets[r + 1] - row_offsets[r];
+  }
+
+  // does the last row end without a line ending, at the end of the data?
+  bool last_row_open() const {
+    return row_offsets != nullptr && n_rows > 0 &&
+           row_offsets[n_rows] > n_indexes;
+  }
+
+  // the fields of all the rows: one per separator, and the last field of
+  // a last row without a line ending
+  index_t n_fields() const { return n_indexes + last_row_open(); }
+
+  // the bytes [start, end) of field m of row r, for m < row_fields(r)
+  void field(index_t r, index_t m, index_t &start, index_t &end) const {
+    index_t k = row_offsets[r] + m;
+    start = k == 0 ? 0 : indexes[k - 1] + 1;
+    end = indexes[k];
+    // record ends point at the LF of the CR-LF pair, the end of the data
+    // past the separators does not
+    if (dialect.crlf && k == row_offsets[r + 1] - 1 && k < n_indexes) {
+      end--;
+    }
+  }
+};
+
+typedef BasicParsedCSV<uint32_t> ParsedCSV;
+typedef BasicParsedCSV<uint64_t> ParsedCSV64;
+
+// can an input of len bytes be described with index_t offsets?
+template <typename index_t>
+really_inline bool fits_index_type(size_t len) {
+  return len == 0 || len - 1 <= std::numeric_limits<index_t>::max();
+}
+
+// for every record end in 'ends', append the position just past it in the
+// index array to row_ptr[n_rows]. 'seps' are all the separators of the block
+// (ends included) and base the number of indexes before the block. Records
+// are sparse next to fields, so a plain loop will do.
+template <typename index_t>
+really_inline void flatten_rows(index_t *row_ptr, index_t &n_rows, index_t base,
+                                uint64_t seps, uint64_t ends) {
+  while (ends != 0) {
+    // the separators up to and including this record end
+    row_ptr[n_rows++] = base + hamming(seps & (ends ^ (ends - 1)));
+    ends = ends & (ends - 1);
+  }
+}
+
+// with the row structure, once the data_len bytes of data are indexed: a
+// final record without a line ending is made the last row, its last field
+// ending at the end of the data (see BasicParsedCSV)
+template <typename index_t>
+really_inline void close_last_row(BasicParsedCSV<index_t> &pcsv,
+                                  size_t data_len) {
+  index_t k = pcsv.row_offsets[pcsv.n_rows];
+  size_t row_start = k == 0 ? 0 : pcsv.indexes[k - 1] + 1;
+  if (row_start < data_len) {
+    pcsv.indexes[pcsv.n_indexes] = static_cast<index_t>(data_len);
+    pcsv.row_offsets[++pcsv.n_rows] = pcsv.n_indexes + 1;
+  }
+}
+
+// the plain index is the hot path: the kernels scan and flatten it in a
+// single loop, compiled for their instruction set
+really_inline bool kernel_index_range(const uint8_t * buf, size_t idx, size_t end,
+                                      const Dialect & dialect, ParseState & state,
+                                      uint32_t *base_ptr, uint32_t & base,
+                                      unsigned checks) {
+  return active_kernel->index_range32(buf, idx, end, dialect, state, base_ptr,
+                                      base, checks);
+}
+
+really_inline bool kernel_index_range(const uint8_t * buf, size_t idx, size_t end,
+                                      const Dialect & dialect, ParseState & state,
+                                      uint64_t *base_ptr, uint64_t & base,
+                                      unsigned checks) {
+  return active_kernel->index_range64(buf, idx, end, dialect, state, base_ptr,
+                                      base, checks);
+}
+
+// scan the 64-byte blocks starting at buf + idx, buf + idx + 64, ... for as
+// long as the block start is below end, appending the separators found to
+// base_ptr[base]. The quote and CR state is taken from and left in 'state'.
+// With with_rows, the row structure is appended to row_ptr[n_rows] as well
+// (see flatten_rows); the row offsets count from base_ptr, not from the
+// start of the input.
+// The checks (see Kernel) are done on the way: with CHECK_UTF8, returns false
+// if the blocks scanned were not valid UTF-8 (see utf8_range_error); returns
+// true otherwise. With CHECK_STRICT, state.strict must have been set up with
+// the offset of buf and the end of the input.
+template <typename index_t, bool with_rows>
+really_inline bool find_indexes_range(const uint8_t * buf, size_t idx, size_t end,
+                                      const Dialect & dialect, ParseState & state,
+                                      index_t *base_ptr, index_t & base,
+                                      index_t *row_ptr, index_t & n_rows,
+                                      unsigned checks = 0) {
+  if (!with_rows) {
+    return kernel_index_range(buf, idx, end, dialect, state, base_ptr, base,
+                              checks);
+  }
+  bool valid = true;
+  // the masks of a batch of blocks are computed by the kernel ahead of their
+  // decoding here
+  const size_t batch = 8;
+  const auto scan_blocks = active_kernel->scan_blocks;
+  uint64_t fields[batch];
+  uint64_t ends[batch];
+  while (idx < end) {
+    size_t n_blocks = std::min(batch, (end - idx + 63) / 64);
+    valid &= scan_blocks(buf, idx, n_blocks, dialect, state, fields, ends,
+                         checks);
+    const index_t rows_before = n_rows;
+    const index_t base_before = base;
+    for(size_t b = 0; b < n_blocks; b++){
+      size_t internal_idx = 64 * b + idx;
+      flatten_rows(row_ptr, n_rows, base, fields[b], ends[b]);
+      flatten_bits(base_ptr, base, static_cast<index_t>(internal_idx), fields[b]);
+    }
+    if (checks & CHECK_STRICT) {
+      // the field counts are those of the rows just flattened
+      strict_check_rows_ends(state.strict, idx, n_blocks, fields, ends,
+                             row_ptr + rows_before, n_rows - rows_before,
+                             base_before, base);
+    }
+    idx += 64 * n_blocks;
+  }
+  return valid;
+}
+
+template <typename index_t>
+really_inline bool find_indexes_range(const uint8_t * buf, size_t idx, size_t end,
+                                      const Dialect & dialect, ParseState & state,
+                                      index_t *base_ptr, index_t & base,
+                                      unsigned checks = 0) {
+  return kernel_index_range(buf, idx, end, dialect, state, base_ptr, base,
+                            checks);
+}
+
+// after find_indexes_range found the blocks of buf[idx, end) not to be valid
+// UTF-8, starting from a state whose utf8_tail was 'tail': the offset in buf
+// of the first ill-formed sequence (at most 3 bytes before idx). Only ever
+// needed on invalid input, so this is scalar.
+really_inline size_t utf8_range_error(const uint8_t * buf, size_t idx, size_t end,
+                                      uint32_t tail) {
+  size_t len = ROUNDUP_N(end - idx, 64);
+  int64_t e = utf8_first_error(buf + idx, len, tail);
+  return idx + (e < static_cast<int64_t>(len) ? e : 0);
+}
+
+// once all of the input up to 'end' is found valid, with the given final
+// utf8_tail: the offset of a sequence cut short by the end of the input,
+// SIZE_MAX if there is none
+really_inline size_t utf8_end_error(size_t end, uint32_t tail) {
+  int k = utf8_incomplete_tail(tail);
+  return k == 0 ? SIZE_MAX : end + k;
+}
+
+// index buf, whose len bytes are the data followed by at least 64 bytes of
+// zero padding (CSV_PADDING, as allocate_padded_buffer and get_corpus give):
+// the blocks starting below len - 64 are scanned, the last of them into the
+// padding. For data that cannot be padded, see find_indexes_unpadded.
+// returns false, without touching pcsv, if the offsets would not fit index_t,
+// and in strict mode, once done, if the input is not well-formed
+// The dialect must be valid (see valid_dialect).
+template <typename index_t>
+really_inline bool find_indexes(const uint8_t * buf, size_t len,
+                                BasicParsedCSV<index_t> & pcsv,
+                                const Dialect & dialect = Dialect()) {
+  if (!fits_index_type<index_t>(len)) {
+    return false;
+  }
+  ParseState state;
+  size_t lenminus64 = len < 64 ? 0 : len - 64;
+  state.strict.limit = lenminus64;
+  index_t base = 0;
+  bool valid;
+  if (pcsv.row_offsets != nullptr) {
+    index_t n_rows = 0;
+    pcsv.row_offsets[0] = 0;
+    valid = find_indexes_range<index_t, true>(buf, 0, lenminus64, dialect, state,
+                                              pcsv.indexes, base,
+                                              pcsv.row_offsets + 1, n_rows,
+                                              pcsv.checks());
+    pcsv.n_rows = n_rows;
+    pcsv.n_indexes = base;
+    close_last_row(pcsv, lenminus64);
+  } else {
+    valid = find_indexes_range(buf, 0, lenminus64, dialect, state, pcsv.indexes,
+                               base, pcsv.checks());
+  }
+  pcsv.n_indexes = base;
+  pcsv.dialect = dialect;
+  if (pcsv.validate_utf8) {
+    pcsv.utf8_error = valid ? utf8_end_error(ROUNDUP_N(lenminus64, 64), state.utf8_tail)
+                            : utf8_range_error(buf, 0, lenminus64, 0);
+  }
+  if (pcsv.strict) {
+    strict_finish(state.strict, lenminus64, state.prev_iter_inside_quote != 0);
+    pcsv.error = state.strict.error;
+    return pcsv.error.code == CSV_OK;
+  }
+  return true;
+}
+
+// find_indexes for a buffer without padding, which is never read past its
+// end: len is the length of the data alone, and no more than buf[0, len)
+// need be readable. The whole blocks are scanned where they are, and the
+// last, partial one from a zero-padded copy on the stack, so the result is
+// that of find_indexes over the same data padded. pcsv.indexes (and
+// row_offsets) must have room for len + CSV_PADDING entries (and one more).
+template <typename index_t>
+really_inline bool find_indexes_unpadded(const uint8_t * buf, size_t len,
+                                         BasicParsedCSV<index_t> & pcsv,
+                                         const Dialect & dialect = Dialect()) {
+  if (!fits_index_type<index_t>(ROUNDUP_N(len, 64))) {
+    return false;
+  }
+  ParseState state;
+  state.strict.limit = len;
+  const size_t whole = ROUNDDOWN_N(len, 64);
+  const bool with_rows = pcsv.row_offsets != nullptr;
+  index_t base = 0;
+  index_t n_rows = 0;
+  auto scan = [&](const uint8_t *from, size_t end) {
+    if (with_rows) {
+      return find_indexes_range<index_t, true>(from, 0, end, dialect, state,
+                                               pcsv.indexes, base,
+                                               pcsv.row_offsets + 1, n_rows,
+                                               pcsv.checks());
+    }
+    return find_indexes_range(from, 0, end, dialect, state, pcsv.indexes, base,
+                              pcsv.checks());
+  };
+  if (with_rows) {
+    pcsv.row_offsets[0] = 0;
+  }
+  bool valid = scan(buf, whole);
+  if (whole < len) {
+    alignas(64) uint8_t last[64];
+    memset(last, 0, 64);
+    memcpy(last, buf + whole, len - whole);
+    // the strict checks report offsets in the input, not in 'last'
+    state.strict.base = whole;
+    state.strict.limit = len - whole;
+    index_t first = base;
+    valid &= scan(last, 64);
+    for (index_t i = first; i < base; i++) {
+      pcsv.indexes[i] += static_cast<index_t>(whole);
+    }
+  }
+  pcsv.n_indexes = base;
+  if (with_rows) {
+    pcsv.n_rows = n_rows;
+    close_last_row(pcsv, len);
+  }
+  pcsv.dialect = dialect;
+  if (pcsv.validate_utf8) {
+    if (valid) {
+      pcsv.utf8_error = utf8_end_error(ROUNDUP_N(len, 64), state.utf8_tail);
+    } else {
+      // as utf8_range_error does over the padded input
+      int64_t e = utf8_first_error(buf, len, 0);
+      pcsv.utf8_error = e < static_cast<int64_t>(len)
+                            ? e
+                            : utf8_end_error(len, utf8_next_tail(buf, len, 0));
+    }
+  }
+  if (pcsv.strict) {
+    strict_finish(state.strict, len, state.prev_iter_inside_quote != 0);
+    pcsv.error = state.strict.error;
+    return pcsv.error.code == CSV_OK;
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,61 @@
+// flatten_bits, shared by the generic code (through find_indexes.h) and by
+// the kernels, which include it inside their own namespace and target region
+// so that the hot loop is compiled for their instruction set. Deliberately no
+// include guard, and no #include.
+
+// flatten out values in 'bits' assuming that they are are to have values of idx
+// plus their position in the bitvector, and store these indexes at
+// base_ptr[base] incrementing base as we go
+// will potentially store extra values beyond end of valid bits, so base_ptr
+// needs to be large enough to handle this
+template <typename index_t>
+really_inline void flatten_bits(index_t *base_ptr, index_t &base,
+                                index_t idx, uint64_t bits) {
+  if (bits != 0u) {
+    uint32_t cnt = hamming(bits);
+    index_t next_base = base + cnt;
+    base_ptr[base + 0] = static_cast<index_t>(idx) + trailingzeroes(bits);
+    bits = bits & (bits - 1);
+    base_ptr[base + 1] = static_cast<index_t>(idx) + trailingzeroes(bits);
+    bits = bits & (bits - 1);
+    base_ptr[base + 2] = static_cast<index_t>(idx) + trailingzeroes(bits);
+    bits = bits & (bits - 1);
+    base_ptr[base + 3] = static_cast<index_t>(idx) + trailingzeroes(bits);
+    bits = bits & (bits - 1);
+    base_ptr[base + 4] = static_cast<index_t>(idx) + trailingzeroes(bits);
+    bits = bits & (bits - 1);
+    base_ptr[base + 5] = static_cast<index_t>(idx) + trailingzeroes(bits);
+    bits = bits & (bits - 1);
+    base_ptr[base + 6] = static_cast<index_t>(idx) + trailingzeroes(bits);
+    bits = bits & (bits - 1);
+    base_ptr[base + 7] = static_cast<index_t>(idx) + trailingzeroes(bits);
+    bits = bits & (bits - 1);
+    if (cnt > 8) {
+      base_ptr[base + 8] = static_cast<index_t>(idx) + trailingzeroes(bits);
+      bits = bits & (bits - 1);
+      base_ptr[base + 9] = static_cast<index_t>(idx) + trailingzeroes(bits);
+      bits = bits & (bits - 1);
+      base_ptr[base + 10] = static_cast<index_t>(idx) + trailingzeroes(bits);
+      bits = bits & (bits - 1);
+      base_ptr[base + 11] = static_cast<index_t>(idx) + trailingzeroes(bits);
+      bits = bits & (bits - 1);
+      base_ptr[base + 12] = static_cast<index_t>(idx) + trailingzeroes(bits);
+      bits = bits & (bits - 1);
+      base_ptr[base + 13] = static_cast<index_t>(idx) + trailingzeroes(bits);
+      bits = bits & (bits - 1);
+      base_ptr[base + 14] = static_cast<index_t>(idx) + trailingzeroes(bits);
+      bits = bits & (bits - 1);
+      base_ptr[base + 15] = static_cast<index_t>(idx) + trailingzeroes(bits);
+      bits = bits & (bits - 1);
+    }
+    if (cnt > 16) {
+      base += 16;
+      do {
+        base_ptr[base] = static_cast<index_t>(idx) + trailingzeroes(bits);
+        bits = bits & (bits - 1);
+        base++;
+      } while (bits != 0);
+    }
+    base = next_base;
+  }
+}
@@ -0,0 +1,367 @@
+#include "index_file.h"
+#include "portability.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>    // for open
+#include <sys/mman.h> // for mmap
+#include <sys/stat.h> // for stat
+#include <unistd.h>   // for close
+
+// The file is a sequence of 64-bit words, in the byte order of the machine
+// that wrote it: the header, the separators and the row offsets (each as
+// written by pack_sequence), then the checkpoints. The separators are
+// followed by the end of the data if the last row has no line ending, as in
+// BasicParsedCSV.
+namespace {
+
+const uint64_t index_magic = 0x4956534344534953ULL; // "SIMDCSVI"
+const uint64_t index_version = 2;
+
+struct IndexHeader {
+  uint64_t magic;
+  uint64_t version;
+  uint64_t csv_size;
+  uint64_t csv_mtime; // in nanoseconds
+  uint64_t csv_hash;  // see corpus_fingerprint
+  uint64_t dialect;   // delimiter, quote and crlf, a byte each
+  uint64_t rows_per_checkpoint;
+};
+
+const size_t header_words = sizeof(IndexHeader) / 8;
+
+uint64_t pack_dialect(const Dialect &d) {
+  return d.delimiter | (uint64_t(d.quote) << 8) | (uint64_t(d.crlf) << 16);
+}
+
+// the size and modification time of path; false if it cannot be stat'ed
+bool file_stamp(const std::string &path, uint64_t &size, uint64_t &mtime) {
+  struct stat st;
+  if (stat(path.c_str(), &st) == -1) {
+    return false;
+  }
+  size = st.st_size;
+#ifdef __APPLE__
+  mtime = uint64_t(st.st_mtimespec.tv_sec) * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+  mtime = uint64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+  return true;
+}
+
+uint64_t hash_bytes(uint64_t h, const uint8_t *p, size_t len) {
+  const uint64_t k = 0x9E3779B97F4A7C15ULL;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, p + i, 8);
+    h = (h ^ w) * k;
+    h ^= h >> 29;
+  }
+  for (; i < len; i++) {
+    h = (h ^ p[i]) * k;
+  }
+  return h ^ (h >> 32);
+}
+
+// width bits at bit position pos of bits
+really_inline uint64_t extract_bits(const uint64_t *bits, uint64_t pos,
+                                    uint64_t width) {
+  uint64_t mask = width == 64 ? UINT64_MAX : (1ULL << width) - 1;
+  size_t w = pos / 64;
+  unsigned s = pos % 64;
+  uint64_t v = bits[w] >> s;
+  if (s + width > 64) {
+    v |= bits[w + 1] << (64 - s);
+  }
+  return v & mask;
+}
+
+} // namespace
+
+const uint64_t *PackedSequence::attach(const uint64_t *words, size_t n_words) {
+  if (n_words < 4) {
+    return nullptr;
+  }
+  n = words[0];
+  block = words[1];
+  uint64_t n_blocks = words[2];
+  uint64_t n_bits = words[3];
+  if (block == 0 || n_blocks != (n + block - 1) / block ||
+      n_blocks > (n_words - 4) / 3 || n_bits > n_words - 4 - 3 * n_blocks) {
+    return nullptr;
+  }
+  blocks = words + 4;
+  bits = blocks + 3 * n_blocks;
+  // the deltas must be within the words
+  for (size_t b = 0; b < n_blocks; b++) {
+    const uint64_t *h = blocks + 3 * b;
+    size_t count = std::min(block, n - b * block);
+    if (h[2] > 64 || (h[1] + (count - 1) * h[2] + 63) / 64 + 1 > n_bits) {
+      return nullptr;
+    }
+  }
+  return bits + n_bits;
+}
+
+uint64_t PackedSequence::delta(const uint64_t *block_header, size_t j) const {
+  return extract_bits(bits, block_header[1] + (j - 1) * block_header[2],
+                      block_header[2]);
+}
+
+uint64_t PackedSequence::get(size_t i) const {
+  const uint64_t *h = blocks + 3 * (i / block);
+  uint64_t v = h[0];
+  for (size_t j = 1; j <= i % block; j++) {
+    v += delta(h, j);
+  }
+  return v;
+}
+
+void PackedSequence::decode_block(size_t b, uint64_t *out) const {
+  const uint64_t *h = blocks + 3 * b;
+  size_t count = std::min(block, n - b * block);
+  uint64_t v = h[0];
+  out[0] = v;
+  for (size_t j = 1; j < count; j++) {
+    v += delta(h, j);
+    out[j] = v;
+  }
+}
+
+void SequencePacker::pack_block() {
+  const uint64_t *v = pending.data();
+  size_t count = pending.size();
+  uint64_t largest = 0;
+  for (size_t j = 1; j < count; j++) {
+    largest = std::max(largest, v[j] - v[j - 1]);
+  }
+  uint64_t width = largest == 0 ? 0 : 64 - leadingzeroes(largest);
+  headers.push_back(v[0]);
+  headers.push_back(pos);
+  headers.push_back(width);
+  // one word more than the deltas need, for extract_bits
+  bits.resize((pos + (count - 1) * width + 63) / 64 + 1, 0);
+  for (size_t j = 1; j < count && width != 0; j++) {
+    uint64_t d = v[j] - v[j - 1];
+    size_t w = pos / 64;
+    unsigned s = pos % 64;
+    bits[w] |= d << s;
+    if (s + width > 64) {
+      bits[w + 1] |= d >> (64 - s);
+    }
+    pos += width;
+  }
+  pending.clear();
+}
+
+void SequencePacker::finish(std::vector<uint64_t> &out) {
+  if (!pending.empty()) {
+    pack_block();
+  }
+  if (bits.empty()) {
+    bits.push_back(0);
+  }
+  out.push_back(n);
+  out.push_back(block);
+  out.push_back(headers.size() / 3);
+  out.push_back(bits.size());
+  out.insert(out.end(), headers.begin(), headers.end());
+  out.insert(out.end(), bits.begin(), bits.end());
+}
+
+void pack_sequence(const uint64_t *values, size_t n, size_t block_size,
+                   std::vector<uint64_t> &out) {
+  SequencePacker packer(block_size);
+  for (size_t i = 0; i < n; i++) {
+    packer.push(values[i]);
+  }
+  packer.finish(out);
+}
+
+uint64_t corpus_fingerprint(const uint8_t *buf, size_t len) {
+  const size_t span = 64 << 10;
+  uint64_t h = hash_bytes(len, buf, std::min(len, span));
+  if (len > span) {
+    h = hash_bytes(h, buf + len - std::min(len - span, span),
+                   std::min(len - span, span));
+  }
+  return h;
+}
+
+IndexFile::~IndexFile() { close(); }
+
+void IndexFile::close() {
+  if (mapped != nullptr) {
+    munmap(mapped, mapped_size);
+    mapped = nullptr;
+    mapped_size = 0;
+  }
+}
+
+bool IndexFile::open(const std::string &index_path,
+                     const std::string &csv_path, const uint8_t *buf,
+                     size_t len, const Dialect &dialect) {
+  close();
+  uint64_t csv_size, csv_mtime;
+  if (!file_stamp(csv_path, csv_size, csv_mtime) || csv_size != len) {
+    return false;
+  }
+  int fd = ::open(index_path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    if (errno == ENOENT) {
+      return false;
+    }
+    throw std::runtime_error("could not open the index");
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    ::close(fd);
+    throw std::runtime_error("could not open the index");
+  }
+  size_t size = st.st_size;
+  if (size < sizeof(IndexHeader) || size % 8 != 0) {
+    ::close(fd);
+    return false;
+  }
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (addr == MAP_FAILED) {
+    throw std::runtime_error("could not map the index");
+  }
+  mapped = addr;
+  mapped_size = size;
+  const uint64_t *words = static_cast<const uint64_t *>(addr);
+  const uint64_t *end = words + size / 8;
+  IndexHeader header;
+  memcpy(&header, words, sizeof(header));
+  if (header.magic != index_magic || header.version != index_version ||
+      header.csv_size != csv_size || header.csv_mtime != csv_mtime ||
+      header.dialect != pack_dialect(dialect) ||
+      header.rows_per_checkpoint == 0 ||
+      header.csv_hash != corpus_fingerprint(buf, len)) {
+    close();
+    return false;
+  }
+  const uint64_t *p = words + header_words;
+  p = indexes.attach(p, end - p);
+  if (p != nullptr) {
+    p = row_offsets.attach(p, end - p);
+  }
+  if (p == nullptr || row_offsets.size() == 0 ||
+      row_offsets.block_size() != header.rows_per_checkpoint ||
+      static_cast<size_t>(end - p) != (n_rows() + row_offsets.block_size() - 1) /
+                                          row_offsets.block_size()) {
+    close();
+    return false;
+  }
+  checkpoints = p;
+  index_dialect = dialect;
+  data_size = csv_size;
+  return true;
+}
+
+void IndexFile::field(size_t r, size_t m, uint64_t &start,
+                      uint64_t &end) const {
+  size_t first = row_offsets.get(r);
+  size_t k = first + m;
+  start = k == 0 ? 0 : indexes.get(k - 1) + 1;
+  end = indexes.get(k);
+  // record ends point at the LF of the CR-LF pair, the end of the data of
+  // a last row without a line ending does not
+  if (index_dialect.crlf && k == row_offsets.get(r + 1) - 1 && end < data_size) {
+    end--;
+  }
+}
+
+uint64_t IndexFile::row_start(size_t r) const {
+  size_t k = row_offsets.get(r);
+  return k == 0 ? 0 : indexes.get(k - 1) + 1;
+}
+
+size_t IndexFile::first_row_at(uint64_t offset) const {
+  size_t k = row_offsets.block_size();
+  size_t n_checkpoints = (n_rows() + k - 1) / k;
+  // the first checkpoint at or after offset: the row is at most that one,
+  // and after the checkpoint before it
+  size_t c = std::lower_bound(checkpoints, checkpoints + n_checkpoints, offset) -
+             checkpoints;
+  size_t lo = c == 0 ? 0 : (c - 1) * k + 1;
+  size_t hi = c == n_checkpoints ? n_rows() : c * k;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (row_start(mid) < offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+IndexFileWriter::IndexFileWriter(size_t rows_per_checkpoint_in)
+    : rows_per_checkpoint(rows_per_checkpoint_in), indexes(128),
+      row_offsets(rows_per_checkpoint_in) {
+  row_offsets.push(0);
+}
+
+void IndexFileWriter::add(uint64_t offset, bool record_end) {
+  indexes.push(offset);
+  if (record_end) {
+    if (n_rows % rows_per_checkpoint == 0) {
+      checkpoints.push_back(row_start);
+    }
+    n_rows++;
+    row_offsets.push(indexes.size());
+    row_start = offset + 1;
+  }
+}
+
+void IndexFileWriter::write(const std::string &index_path,
+                            const std::string &csv_path, const uint8_t *buf,
+                            size_t len, const Dialect &dialect) {
+  if (row_start < len) {
+    add(len, true);
+  }
+  IndexHeader header;
+  header.magic = index_magic;
+  header.version = index_version;
+  if (!file_stamp(csv_path, header.csv_size, header.csv_mtime)) {
+    throw std::runtime_error("could not stat the data");
+  }
+  header.csv_hash = corpus_fingerprint(buf, len);
+  header.dialect = pack_dialect(dialect);
+  header.rows_per_checkpoint = rows_per_checkpoint;
+  std::vector<uint64_t> words(header_words);
+  memcpy(words.data(), &header, sizeof(header));
+  indexes.finish(words);
+  row_offsets.finish(words);
+  words.insert(words.end(), checkpoints.begin(), checkpoints.end());
+  std::string tmp = index_path + ".tmp";
+  std::FILE *fp = std::fopen(tmp.c_str(), "wb");
+  if (fp == nullptr) {
+    throw std::runtime_error("could not write the index");
+  }
+  size_t written = std::fwrite(words.data(), 8, words.size(), fp);
+  if (std::fclose(fp) != 0 || written != words.size() ||
+      std::rename(tmp.c_str(), index_path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    throw std::runtime_error("could not write the index");
+  }
+}
+
+void write_index_file(const std::string &index_path,
+                      const std::string &csv_path, const uint8_t *buf,
+                      size_t len, const ParsedCSV64 &pcsv,
+                      size_t rows_per_checkpoint) {
+  IndexFileWriter writer(rows_per_checkpoint);
+  for (size_t r = 0; r < pcsv.n_rows; r++) {
+    for (size_t k = pcsv.row_offsets[r]; k < pcsv.row_offsets[r + 1]; k++) {
+      writer.add(pcsv.indexes[k], k + 1 == pcsv.row_offsets[r + 1]);
+    }
+  }
+  writer.write(index_path, csv_path, buf, len, pcsv.dialect);
+}
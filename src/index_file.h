@@ -0,0 +1,222 @@
+#ifndef SIMDCSV_INDEX_FILE_H
+#define SIMDCSV_INDEX_FILE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "dialect.h"
+#include "find_indexes.h"
+
+// A persistent index: the separators and the row structure of a CSV file,
+// saved to a sidecar file so that later runs can map it and go straight to
+// row N, or to the rows of a byte range, without indexing the file again.
+//
+// Both the separator offsets and the row offsets only ever grow, so they
+// are stored as deltas, bit-packed in blocks: each block of a sequence has
+// its first value in full and the deltas of the others at the width of the
+// largest of them (a few bits for the separators of typical fields, rather
+// than 32 or 64). The row offsets are packed in blocks of K rows, and the
+// byte offset where every K-th row starts is kept as well: these are the
+// checkpoints a byte range is looked up in.
+//
+// The index is only used if the CSV file has not changed since it was
+// written: same size, same modification time, and same hash of its first
+// and last 64 KB (the whole file is not hashed, that would cost a scan).
+
+// a sequence of non-decreasing values as packed by pack_sequence, over the
+// words it was packed to
+class PackedSequence {
+public:
+  // the sequence at words[0, n_words); returns the words after it, or
+  // nullptr if there are not enough of them
+  const uint64_t *attach(const uint64_t *words, size_t n_words);
+
+  size_t size() const { return n; }
+
+  // value i, for i < size()
+  uint64_t get(size_t i) const;
+
+  // the values of block b (block_size of them, fewer for the last block)
+  // written to out
+  void decode_block(size_t b, uint64_t *out) const;
+
+  size_t block_size() const { return block; }
+
+private:
+  // delta j of the block with the given header
+  uint64_t delta(const uint64_t *block_header, size_t j) const;
+
+  size_t n{0};
+  size_t block{0};
+  const uint64_t *blocks{nullptr}; // first value, first bit, width
+  const uint64_t *bits{nullptr};
+};
+
+// packs a sequence of non-decreasing values as pack_sequence does, a value
+// at a time, holding no more than a block of them unpacked
+class SequencePacker {
+public:
+  explicit SequencePacker(size_t block_size) : block(block_size) {
+    pending.reserve(block_size);
+  }
+
+  void push(uint64_t value) {
+    pending.push_back(value);
+    n++;
+    if (pending.size() == block) {
+      pack_block();
+    }
+  }
+
+  size_t size() const { return n; }
+
+  // append the sequence, packed, to out
+  void finish(std::vector<uint64_t> &out);
+
+private:
+  void pack_block();
+
+  size_t block;
+  size_t n{0};
+  std::vector<uint64_t> pending; // the values of the last block, not packed
+  std::vector<uint64_t> headers; // first value, first bit, width
+  std::vector<uint64_t> bits;
+  uint64_t pos{0}; // in bits
+};
+
+// append the n values to out, packed in blocks of block_size
+void pack_sequence(const uint64_t *values, size_t n, size_t block_size,
+                   std::vector<uint64_t> &out);
+
+// a hash of the first and last 64 KB of buf
+uint64_t corpus_fingerprint(const uint8_t *buf, size_t len);
+
+// a persistent index, mapped from its file
+class IndexFile {
+public:
+  IndexFile() = default;
+  ~IndexFile();
+  IndexFile(const IndexFile &) = delete;
+  IndexFile &operator=(const IndexFile &) = delete;
+
+  // map index_path, the index of the CSV file csv_path (whose contents are
+  // buf[0, len)) parsed with dialect; returns false if there is no such
+  // index file, or if it is stale, was written for another dialect or is
+  // not an index file. Throws an exception if the index file exists but
+  // cannot be mapped.
+  bool open(const std::string &index_path, const std::string &csv_path,
+            const uint8_t *buf, size_t len, const Dialect &dialect);
+
+  size_t n_indexes() const { return indexes.size() - last_row_open(); }
+  size_t n_rows() const { return row_offsets.size() - 1; }
+  // does the last row end without a line ending? (see BasicParsedCSV)
+  bool last_row_open() const {
+    return indexes.size() != 0 && indexes.get(indexes.size() - 1) == data_size;
+  }
+  size_t file_size() const { return mapped_size; }
+
+  // separator k
+  uint64_t index(size_t k) const { return indexes.get(k); }
+
+  // number of fields of row r
+  size_t row_fields(size_t r) const {
+    return row_offsets.get(r + 1) - row_offsets.get(r);
+  }
+
+  // the bytes [start, end) of field m of row r, for m < row_fields(r)
+  void field(size_t r, size_t m, uint64_t &start, uint64_t &end) const;
+
+  // the byte row r starts at
+  uint64_t row_start(size_t r) const;
+
+  // the first row starting at or after byte offset, n_rows() if none does:
+  // the rows of the byte range [a, b) are first_row_at(a) up to
+  // first_row_at(b)
+  size_t first_row_at(uint64_t offset) const;
+
+  // the whole index, decoded into pcsv's arrays (with room for n_indexes()
+  // + 1 and n_rows() + 1 entries); returns false if it does not fit index_t
+  template <typename index_t>
+  bool decode(BasicParsedCSV<index_t> &pcsv) const;
+
+private:
+  void close();
+
+  void *mapped{nullptr};
+  size_t mapped_size{0};
+  Dialect index_dialect;
+  uint64_t data_size{0};
+  PackedSequence indexes;
+  PackedSequence row_offsets;
+  const uint64_t *checkpoints{nullptr}; // the start of every K-th row
+};
+
+// an index file built a separator at a time, in order, e.g. from the
+// batches of a StreamParser: only the packed index is held, a few bits per
+// separator, rather than the offsets of a BasicParsedCSV
+class IndexFileWriter {
+public:
+  explicit IndexFileWriter(size_t rows_per_checkpoint_in = 128);
+
+  // the next separator, at byte offset of the data; record_end if it ends a
+  // record (its LF), rather than a field
+  void add(uint64_t offset, bool record_end);
+
+  // write the index of the CSV file csv_path, whose contents are buf[0, len)
+  // parsed with dialect, to index_path, as write_index_file does. A last
+  // record without a line ending is closed at len. Throws an exception if
+  // it cannot be written.
+  void write(const std::string &index_path, const std::string &csv_path,
+             const uint8_t *buf, size_t len, const Dialect &dialect);
+
+private:
+  size_t rows_per_checkpoint;
+  SequencePacker indexes;
+  SequencePacker row_offsets;
+  std::vector<uint64_t> checkpoints; // the start of every K-th row
+  uint64_t row_start{0};
+  size_t n_rows{0};
+};
+
+// write the index pcsv, which must have the row structure, of the CSV file
+// csv_path (whose contents are buf[0, len)) to index_path, with a checkpoint
+// every rows_per_checkpoint rows. The file is written under a temporary
+// name and renamed, so readers never see half of it. Throws an exception if
+// it cannot be written.
+void write_index_file(const std::string &index_path,
+                      const std::string &csv_path, const uint8_t *buf,
+                      size_t len, const ParsedCSV64 &pcsv,
+                      size_t rows_per_checkpoint = 128);
+
+template <typename index_t>
+bool IndexFile::decode(BasicParsedCSV<index_t> &pcsv) const {
+  if (indexes.size() != 0 && indexes.get(indexes.size() - 1) >
+                                 std::numeric_limits<index_t>::max()) {
+    return false;
+  }
+  std::vector<uint64_t> values(std::max(indexes.block_size(),
+                                        row_offsets.block_size()));
+  for (size_t k = 0; k < indexes.size(); k += indexes.block_size()) {
+    indexes.decode_block(k / indexes.block_size(), values.data());
+    size_t n = std::min(indexes.block_size(), indexes.size() - k);
+    for (size_t j = 0; j < n; j++) {
+      pcsv.indexes[k + j] = static_cast<index_t>(values[j]);
+    }
+  }
+  for (size_t r = 0; r < row_offsets.size(); r += row_offsets.block_size()) {
+    row_offsets.decode_block(r / row_offsets.block_size(), values.data());
+    size_t n = std::min(row_offsets.block_size(), row_offsets.size() - r);
+    for (size_t j = 0; j < n; j++) {
+      pcsv.row_offsets[r + j] = static_cast<index_t>(values[j]);
+    }
+  }
+  pcsv.n_indexes = static_cast<index_t>(n_indexes());
+  pcsv.n_rows = static_cast<index_t>(n_rows());
+  pcsv.dialect = index_dialect;
+  return true;
+}
+
+#endif
@@ -3,6 +3,11 @@
 #include <cstring>
 #include <cstdlib>
 
+#include <fcntl.h>    // for open
+#include <sys/mman.h> // for mmap
+#include <sys/stat.h> // for fstat
+#include <unistd.h>   // for close, sysconf
+
 uint8_t * allocate_padded_buffer(size_t length, size_t padding) {
     // we could do a simple malloc
     //return (char *) malloc(length + padding);
@@ -29,7 +34,61 @@ std::basic_string_view<uint8_t> get_corpus(const std::string& filename, size_t p
       aligned_free(buf);
       throw  std::runtime_error("could not read the data");
     }
+    // nothing after the data may look like a separator to the last block
+    std::memset(buf + len, 0, padding);
     return std::basic_string_view<uint8_t>(buf, len+padding);
   }
   throw  std::runtime_error("could not load corpus");
 }
+
+std::basic_string_view<uint8_t> map_corpus(const std::string& filename, size_t padding,
+                                           int flags) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd == -1) {
+    throw  std::runtime_error("could not load corpus");
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    throw  std::runtime_error("could not load corpus");
+  }
+  size_t len = st.st_size;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t total = ROUNDUP_N(len + padding, page);
+  // reserve the whole range as zero pages, then put the file over the start
+  void *addr = mmap(nullptr, total, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    close(fd);
+    throw  std::runtime_error("could not allocate memory");
+  }
+  if (len > 0) {
+    int map_flags = MAP_PRIVATE | MAP_FIXED;
+#ifdef MAP_POPULATE
+    if (flags & CORPUS_MAP_POPULATE) {
+      map_flags |= MAP_POPULATE;
+    }
+#endif
+    if (mmap(addr, ROUNDUP_N(len, page), PROT_READ, map_flags, fd, 0) == MAP_FAILED) {
+      munmap(addr, total);
+      close(fd);
+      throw  std::runtime_error("could not map the data");
+    }
+  }
+  close(fd);
+  // advice is only a hint, failing to take it is not an error
+  if (flags & CORPUS_MAP_SEQUENTIAL) {
+    madvise(addr, total, MADV_SEQUENTIAL);
+  }
+#ifdef MADV_HUGEPAGE
+  if (flags & CORPUS_MAP_HUGEPAGE) {
+    madvise(addr, total, MADV_HUGEPAGE);
+  }
+#endif
+  return std::basic_string_view<uint8_t>(static_cast<uint8_t *>(addr), len + padding);
+}
+
+void unmap_corpus(std::basic_string_view<uint8_t> corpus) {
+  if (corpus.data() == nullptr) { return; }
+  size_t page = sysconf(_SC_PAGESIZE);
+  munmap(const_cast<uint8_t *>(corpus.data()), ROUNDUP_N(corpus.size(), page));
+}
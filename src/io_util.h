@@ -33,4 +33,24 @@ uint8_t * allocate_padded_buffer(size_t length, size_t padding);
 //      }
 std::basic_string_view<uint8_t>  get_corpus(const std::string& filename, size_t padding);
 
+// options for map_corpus, can be or'ed together
+enum {
+  CORPUS_MAP_SEQUENTIAL = 1, // madvise(MADV_SEQUENTIAL): aggressive read-ahead
+  CORPUS_MAP_HUGEPAGE = 2,   // madvise(MADV_HUGEPAGE), where the kernel can
+  CORPUS_MAP_POPULATE = 4,   // MAP_POPULATE: fault everything in up front
+};
+
+// map a file in memory instead of copying it...
+// same contract as get_corpus: the result is the data followed by 'padding'
+// readable bytes, which are all zero. The file is mapped read-only and
+// privately; the padding comes from the zero fill past the end of file in the
+// last page, and from anonymous zero pages when that is not enough.
+// caller is responsible to unmap (unmap_corpus(result))
+//
+// throws an exception if the file cannot be opened or mapped
+std::basic_string_view<uint8_t> map_corpus(const std::string& filename, size_t padding,
+                                           int flags = CORPUS_MAP_SEQUENTIAL);
+
+void unmap_corpus(std::basic_string_view<uint8_t> corpus);
+
 #endif
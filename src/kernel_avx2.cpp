@@ -0,0 +1,169 @@
+#include "simd_kernels.h"
+
+#if defined(__x86_64__)
+#include "compress_lut.h"
+#include "portability.h"
+#include "utf8.h"
+#include <cstring>
+#include <immintrin.h>
+
+SIMDCSV_TARGET_REGION("avx2,pclmul")
+namespace avx2 {
+
+struct simd_input {
+  __m256i lo;
+  __m256i hi;
+};
+
+really_inline simd_input fill_input(const uint8_t * ptr) {
+  struct simd_input in;
+  in.lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr + 0));
+  in.hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr + 32));
+  return in;
+}
+
+// a straightforward comparison of a mask against input. 5 uops; would be
+// cheaper in AVX512.
+really_inline uint64_t cmp_mask_against_input(simd_input in, uint8_t m) {
+  const __m256i mask = _mm256_set1_epi8(m);
+  __m256i cmp_res_0 = _mm256_cmpeq_epi8(in.lo, mask);
+  uint64_t res_0 = static_cast<uint32_t>(_mm256_movemask_epi8(cmp_res_0));
+  __m256i cmp_res_1 = _mm256_cmpeq_epi8(in.hi, mask);
+  uint64_t res_1 = _mm256_movemask_epi8(cmp_res_1);
+  return res_0 | (res_1 << 32);
+}
+
+// the bytes in [lo, hi], with a single unsigned compare each: byte - lo
+// wraps around below lo, so it is at most hi - lo only within the range
+// (there is no unsigned byte compare in AVX2: t <= u is min(t, u) == t)
+really_inline uint64_t range_mask_against_input(simd_input in, uint8_t lo,
+                                                uint8_t hi) {
+  const __m256i low = _mm256_set1_epi8(lo);
+  const __m256i width = _mm256_set1_epi8(hi - lo);
+  __m256i t0 = _mm256_sub_epi8(in.lo, low);
+  __m256i t1 = _mm256_sub_epi8(in.hi, low);
+  uint64_t res_0 = static_cast<uint32_t>(
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(t0, width), t0)));
+  uint64_t res_1 =
+      _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(t1, width), t1));
+  return res_0 | (res_1 << 32);
+}
+
+// return the quote mask of quote_bits, the quotes of a block (which is a
+// half-open mask that covers the first quote in a quote pair and everything
+// in the quote pair)
+// We also update the prev_iter_inside_quote value to
+// tell the next iteration whether we finished the final iteration inside a
+// quote pair; if so, this  inverts our behavior of  whether we're inside
+// quotes for the next iteration.
+really_inline uint64_t quote_mask_of_bits(uint64_t quote_bits,
+                                          uint64_t &prev_iter_inside_quote) {
+  uint64_t quote_mask = _mm_cvtsi128_si64(_mm_clmulepi64_si128(
+      _mm_set_epi64x(0ULL, quote_bits), _mm_set1_epi8(0xFF), 0));
+  quote_mask ^= prev_iter_inside_quote;
+
+  // right shift of a signed value expected to be well-defined and standard
+  // compliant as of C++20,
+  // John Regher from Utah U. says this is fine code
+  prev_iter_inside_quote =
+      static_cast<uint64_t>(static_cast<int64_t>(quote_mask) >> 63);
+  return quote_mask;
+}
+
+// the same, of the quotes of in
+really_inline uint64_t find_quote_mask(simd_input in, uint8_t quote,
+                                       uint64_t &prev_iter_inside_quote) {
+  return quote_mask_of_bits(cmp_mask_against_input(in, quote),
+                            prev_iter_inside_quote);
+}
+
+// the bytes of 'word' whose bit is set in 'keep' (see Kernel::unescape),
+// in order, to the first of the 8 bytes at out
+really_inline void compress8(uint64_t word, uint8_t keep, uint8_t *out) {
+  __m128i shuffle = _mm_loadl_epi64(
+      reinterpret_cast<const __m128i *>(compress_lut.shuffle[keep]));
+  _mm_storel_epi64(reinterpret_cast<__m128i *>(out),
+                   _mm_shuffle_epi8(_mm_cvtsi64_si128(word), shuffle));
+}
+
+// the flatteners of kernel_generic.h: FLATTEN_LUT widens the positions of
+// the set bits of each byte (see compress_lut.h) to 8 offsets at once
+const unsigned flatteners = (1u << FLATTEN_UNROLLED) |
+                            (1u << FLATTEN_BRANCHLESS) | (1u << FLATTEN_LUT);
+
+really_inline __m128i lut_positions(uint64_t bits, int b) {
+  return _mm_loadl_epi64(reinterpret_cast<const __m128i *>(
+      compress_lut.shuffle[static_cast<uint8_t>(bits >> (8 * b))]));
+}
+
+really_inline void flatten_bits_lut(uint32_t *base_ptr, uint32_t &base,
+                                    uint32_t idx, uint64_t bits) {
+  for (int b = 0; b < 8; b++) {
+    __m256i offsets = _mm256_add_epi32(_mm256_cvtepu8_epi32(lut_positions(bits, b)),
+                                       _mm256_set1_epi32(idx + 8 * b));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(base_ptr + base), offsets);
+    base += hamming(static_cast<uint8_t>(bits >> (8 * b)));
+  }
+}
+
+really_inline void flatten_bits_lut(uint64_t *base_ptr, uint64_t &base,
+                                    uint64_t idx, uint64_t bits) {
+  for (int b = 0; b < 8; b++) {
+    __m128i pos = lut_positions(bits, b);
+    __m256i start = _mm256_set1_epi64x(idx + 8 * b);
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(base_ptr + base),
+                        _mm256_add_epi64(_mm256_cvtepu8_epi64(pos), start));
+    _mm256_storeu_si256(
+        reinterpret_cast<__m256i *>(base_ptr + base + 4),
+        _mm256_add_epi64(_mm256_cvtepu8_epi64(_mm_srli_si128(pos, 4)), start));
+    base += hamming(static_cast<uint8_t>(bits >> (8 * b)));
+  }
+}
+
+// the primitives of utf8_lookup.h
+typedef __m256i utf8_vec;
+const int utf8_chunks = 2;
+really_inline utf8_vec chunk(simd_input in, int i) { return i == 0 ? in.lo : in.hi; }
+really_inline bool is_ascii(simd_input in) {
+  return _mm256_movemask_epi8(_mm256_or_si256(in.lo, in.hi)) == 0;
+}
+really_inline utf8_vec splat(uint8_t c) { return _mm256_set1_epi8(c); }
+really_inline utf8_vec vand(utf8_vec a, utf8_vec b) { return _mm256_and_si256(a, b); }
+really_inline utf8_vec vor(utf8_vec a, utf8_vec b) { return _mm256_or_si256(a, b); }
+really_inline utf8_vec vxor(utf8_vec a, utf8_vec b) { return _mm256_xor_si256(a, b); }
+really_inline utf8_vec subs(utf8_vec a, utf8_vec b) { return _mm256_subs_epu8(a, b); }
+really_inline utf8_vec shr4(utf8_vec a) {
+  return _mm256_and_si256(_mm256_srli_epi16(a, 4), _mm256_set1_epi8(0x0f));
+}
+really_inline utf8_vec lookup16(utf8_vec idx, const uint8_t *table) {
+  return _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_loadu_si128(
+                                 reinterpret_cast<const __m128i *>(table))),
+                             idx);
+}
+template <int N>
+really_inline utf8_vec prev(utf8_vec a, utf8_vec prev_a) {
+  return _mm256_alignr_epi8(a, _mm256_permute2x128_si256(prev_a, a, 0x21), 16 - N);
+}
+really_inline bool any(utf8_vec a) { return !_mm256_testz_si256(a, a); }
+
+#include "utf8_lookup.h"
+#include "kernel_generic.h"
+
+} // namespace avx2
+SIMDCSV_UNTARGET_REGION
+
+static bool avx2_supported() {
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("pclmul");
+}
+
+extern const Kernel avx2_kernel = {
+  "avx2", "AVX2 and CLMUL", avx2_supported, avx2::scan_blocks,
+  avx2::index_range32, avx2::index_range64,
+  avx2::quote_parity, avx2::unescape,
+  avx2::classify, avx2::flatteners
+#ifdef SIMDCSV_INSTRUMENT
+  , avx2::scan_stage, avx2::quote_mask_stage
+#endif
+};
+
+#endif // x86-64
@@ -0,0 +1,172 @@
+#include "simd_kernels.h"
+
+#if defined(__x86_64__)
+#include "compress_lut.h"
+#include "portability.h"
+#include "utf8.h"
+#include <cstring>
+#include <immintrin.h>
+
+SIMDCSV_TARGET_REGION("avx512f,avx512bw,avx2,pclmul")
+namespace avx512 {
+
+struct simd_input {
+  __m512i in;
+};
+
+really_inline simd_input fill_input(const uint8_t * ptr) {
+  struct simd_input in;
+  in.in = _mm512_loadu_si512(reinterpret_cast<const __m512i *>(ptr));
+  return in;
+}
+
+// the compare lands straight in a mask register: one uop, no movemask
+really_inline uint64_t cmp_mask_against_input(simd_input in, uint8_t m) {
+  return _mm512_cmpeq_epi8_mask(in.in, _mm512_set1_epi8(m));
+}
+
+// see the AVX2 kernel; AVX-512 has the unsigned compare
+really_inline uint64_t range_mask_against_input(simd_input in, uint8_t lo,
+                                                uint8_t hi) {
+  return _mm512_cmple_epu8_mask(_mm512_sub_epi8(in.in, _mm512_set1_epi8(lo)),
+                                _mm512_set1_epi8(hi - lo));
+}
+
+// see the AVX2 kernel
+really_inline uint64_t quote_mask_of_bits(uint64_t quote_bits,
+                                          uint64_t &prev_iter_inside_quote) {
+  uint64_t quote_mask = _mm_cvtsi128_si64(_mm_clmulepi64_si128(
+      _mm_set_epi64x(0ULL, quote_bits), _mm_set1_epi8(0xFF), 0));
+  quote_mask ^= prev_iter_inside_quote;
+  prev_iter_inside_quote =
+      static_cast<uint64_t>(static_cast<int64_t>(quote_mask) >> 63);
+  return quote_mask;
+}
+
+really_inline uint64_t find_quote_mask(simd_input in, uint8_t quote,
+                                       uint64_t &prev_iter_inside_quote) {
+  return quote_mask_of_bits(cmp_mask_against_input(in, quote),
+                            prev_iter_inside_quote);
+}
+
+// see the AVX2 kernel
+really_inline void compress8(uint64_t word, uint8_t keep, uint8_t *out) {
+  __m128i shuffle = _mm_loadl_epi64(
+      reinterpret_cast<const __m128i *>(compress_lut.shuffle[keep]));
+  _mm_storel_epi64(reinterpret_cast<__m128i *>(out),
+                   _mm_shuffle_epi8(_mm_cvtsi64_si128(word), shuffle));
+}
+
+// the flatteners of kernel_generic.h: FLATTEN_LUT as in the AVX2 kernel,
+// and FLATTEN_COMPRESS, which packs the set lanes of a vector of offsets with
+// vpcompressd (16 bits at a time) or vpcompressq (8), and stores just those
+const unsigned flatteners = (1u << FLATTEN_UNROLLED) |
+                            (1u << FLATTEN_BRANCHLESS) | (1u << FLATTEN_LUT) |
+                            (1u << FLATTEN_COMPRESS);
+
+really_inline __m128i lut_positions(uint64_t bits, int b) {
+  return _mm_loadl_epi64(reinterpret_cast<const __m128i *>(
+      compress_lut.shuffle[static_cast<uint8_t>(bits >> (8 * b))]));
+}
+
+really_inline void flatten_bits_lut(uint32_t *base_ptr, uint32_t &base,
+                                    uint32_t idx, uint64_t bits) {
+  for (int b = 0; b < 8; b++) {
+    __m256i offsets = _mm256_add_epi32(_mm256_cvtepu8_epi32(lut_positions(bits, b)),
+                                       _mm256_set1_epi32(idx + 8 * b));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(base_ptr + base), offsets);
+    base += hamming(static_cast<uint8_t>(bits >> (8 * b)));
+  }
+}
+
+really_inline void flatten_bits_lut(uint64_t *base_ptr, uint64_t &base,
+                                    uint64_t idx, uint64_t bits) {
+  for (int b = 0; b < 8; b++) {
+    // (the maskz form: GCC warns of the undefined source of the plain one)
+    __m512i pos = _mm512_maskz_cvtepu8_epi64(0xff, lut_positions(bits, b));
+    __m512i offsets = _mm512_add_epi64(pos, _mm512_set1_epi64(idx + 8 * b));
+    _mm512_storeu_si512(base_ptr + base, offsets);
+    base += hamming(static_cast<uint8_t>(bits >> (8 * b)));
+  }
+}
+
+really_inline void flatten_bits_compress(uint32_t *base_ptr, uint32_t &base,
+                                         uint32_t idx, uint64_t bits) {
+  const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+                                          11, 12, 13, 14, 15);
+  for (int b = 0; b < 4; b++) {
+    __mmask16 m = static_cast<__mmask16>(bits >> (16 * b));
+    __m512i offsets = _mm512_add_epi32(lanes, _mm512_set1_epi32(idx + 16 * b));
+    int n = hamming(m);
+    _mm512_mask_storeu_epi32(base_ptr + base, static_cast<__mmask16>((1u << n) - 1),
+                             _mm512_maskz_compress_epi32(m, offsets));
+    base += n;
+  }
+}
+
+really_inline void flatten_bits_compress(uint64_t *base_ptr, uint64_t &base,
+                                         uint64_t idx, uint64_t bits) {
+  const __m512i lanes = _mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7);
+  for (int b = 0; b < 8; b++) {
+    __mmask8 m = static_cast<__mmask8>(bits >> (8 * b));
+    __m512i offsets = _mm512_add_epi64(lanes, _mm512_set1_epi64(idx + 8 * b));
+    int n = hamming(m);
+    _mm512_mask_storeu_epi64(base_ptr + base, static_cast<__mmask8>((1u << n) - 1),
+                             _mm512_maskz_compress_epi64(m, offsets));
+    base += n;
+  }
+}
+
+// the primitives of utf8_lookup.h
+typedef __m512i utf8_vec;
+const int utf8_chunks = 1;
+really_inline utf8_vec chunk(simd_input in, int) { return in.in; }
+really_inline bool is_ascii(simd_input in) { return _mm512_movepi8_mask(in.in) == 0; }
+really_inline utf8_vec splat(uint8_t c) { return _mm512_set1_epi8(c); }
+really_inline utf8_vec vand(utf8_vec a, utf8_vec b) { return _mm512_and_si512(a, b); }
+really_inline utf8_vec vor(utf8_vec a, utf8_vec b) { return _mm512_or_si512(a, b); }
+really_inline utf8_vec vxor(utf8_vec a, utf8_vec b) { return _mm512_xor_si512(a, b); }
+really_inline utf8_vec subs(utf8_vec a, utf8_vec b) { return _mm512_subs_epu8(a, b); }
+really_inline utf8_vec shr4(utf8_vec a) {
+  return _mm512_and_si512(_mm512_srli_epi16(a, 4), _mm512_set1_epi8(0x0f));
+}
+really_inline utf8_vec lookup16(utf8_vec idx, const uint8_t *table) {
+  // the zero-masking form, as GCC warns about the undefined source of the
+  // plain one
+  return _mm512_shuffle_epi8(
+      _mm512_maskz_broadcast_i32x4(0xffff, _mm_loadu_si128(
+                                               reinterpret_cast<const __m128i *>(table))),
+      idx);
+}
+// alignr works within 128-bit lanes: each lane is first paired with the one
+// before it
+template <int N>
+really_inline utf8_vec prev(utf8_vec a, utf8_vec prev_a) {
+  return _mm512_alignr_epi8(
+      a, _mm512_permutex2var_epi64(prev_a, _mm512_set_epi64(13, 12, 11, 10, 9, 8, 7, 6), a),
+      16 - N);
+}
+really_inline bool any(utf8_vec a) { return _mm512_test_epi8_mask(a, a) != 0; }
+
+#include "utf8_lookup.h"
+#include "kernel_generic.h"
+
+} // namespace avx512
+SIMDCSV_UNTARGET_REGION
+
+static bool avx512_supported() {
+  return __builtin_cpu_supports("avx512f") &&
+         __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("pclmul");
+}
+
+extern const Kernel avx512_kernel = {
+  "avx512", "AVX-512BW and CLMUL", avx512_supported, avx512::scan_blocks,
+  avx512::index_range32, avx512::index_range64,
+  avx512::quote_parity, avx512::unescape,
+  avx512::classify, avx512::flatteners
+#ifdef SIMDCSV_INSTRUMENT
+  , avx512::scan_stage, avx512::quote_mask_stage
+#endif
+};
+
+#endif // x86-64
@@ -0,0 +1,463 @@
+// The body of a Kernel (see simd_kernels.h), included once per instruction
+// set inside that instruction set's namespace and target region, after
+// simd_input, fill_input, cmp_mask_against_input, quote_mask_of_bits,
+// find_quote_mask, compress8, a utf8_checker (utf8_init, utf8_check,
+// utf8_valid; see utf8_lookup.h) and 'flatteners', its Flatteners, with
+// flatten_bits_lut and flatten_bits_compress for those among them, have
+// been defined for it. Deliberately no include guard, and no #include other
+// than the equally guard-less flatten_bits.h.
+
+#include "flatten_bits.h"
+
+// the separators (unquoted delimiters and record ends) of the 64-byte block
+// in; the record ends alone are left in 'record_ends', the quote characters
+// in 'quotes' and the quoted bytes in 'quote_mask'. D is a Dialect or a
+// StaticDialect.
+template <typename D>
+really_inline uint64_t find_field_sep(simd_input in, const D & dialect,
+                                      ParseState & state,
+                                      uint64_t & record_ends, uint64_t & quotes,
+                                      uint64_t & quote_mask) {
+  quotes = cmp_mask_against_input(in, dialect.quote);
+  quote_mask = find_quote_mask(in, dialect.quote, state.prev_iter_inside_quote);
+  uint64_t sep = cmp_mask_against_input(in, dialect.delimiter);
+  uint64_t end;
+  if (dialect.crlf) {
+    uint64_t cr = cmp_mask_against_input(in, 0x0d);
+    uint64_t cr_adjusted = (cr << 1) | state.prev_iter_cr_end;
+    uint64_t lf = cmp_mask_against_input(in, 0x0a);
+    end = lf & cr_adjusted;
+    state.prev_iter_cr_end = cr >> 63;
+  } else {
+    end = cmp_mask_against_input(in, 0x0a);
+  }
+  // note - a bit of a high-wire act here with quotes
+  // we can't put something inside the quotes with the CR
+  // then outside the quotes with LF so it's OK to "and off"
+  // the quoted bits here. Some other quote convention would
+  // need to be thought about carefully
+  record_ends = end & ~quote_mask;
+  return (end | sep) & ~quote_mask;
+}
+
+// find_field_sep, doing the checks asked for (see Kernel) on the way: the
+// UTF-8 check here; the quote checks of strict mode are the caller's
+// (strict_check_quotes), on the quote masks this leaves
+template <unsigned checks, typename D>
+really_inline uint64_t check_field_sep(simd_input in, const D & dialect,
+                                       ParseState & state,
+                                       utf8_checker & checker,
+                                       uint64_t & record_ends, uint64_t & quotes,
+                                       uint64_t & quote_mask) {
+  if (checks & CHECK_UTF8) {
+    utf8_check(checker, in);
+  }
+  return find_field_sep(in, dialect, state, record_ends, quotes, quote_mask);
+}
+
+// calls f(d) with the StaticDialect equal to 'dialect' if it is one of the
+// common ones, so that the loop f instantiates compares against constants,
+// and with 'dialect' itself otherwise
+template <typename F>
+really_inline void with_dialect(const Dialect & dialect, F f) {
+  if (dialect.quote == '"') {
+    switch (dialect.delimiter) {
+    case ',':
+      return dialect.crlf ? f(StaticDialect<',', '"', true>())
+                          : f(StaticDialect<',', '"', false>());
+    case '\t':
+      return dialect.crlf ? f(StaticDialect<'\t', '"', true>())
+                          : f(StaticDialect<'\t', '"', false>());
+    case ';':
+      return dialect.crlf ? f(StaticDialect<';', '"', true>())
+                          : f(StaticDialect<';', '"', false>());
+    case '|':
+      return dialect.crlf ? f(StaticDialect<'|', '"', true>())
+                          : f(StaticDialect<'|', '"', false>());
+    }
+  }
+  f(dialect);
+}
+
+// calls f(std::integral_constant<unsigned, checks>()), so that the loop f
+// instantiates only does the checks asked for
+template <typename F>
+really_inline void with_checks(unsigned checks, F f) {
+  switch (checks & (CHECK_UTF8 | CHECK_STRICT)) {
+  case CHECK_UTF8:
+    return f(std::integral_constant<unsigned, CHECK_UTF8>());
+  case CHECK_STRICT:
+    return f(std::integral_constant<unsigned, CHECK_STRICT>());
+  case CHECK_UTF8 | CHECK_STRICT:
+    return f(std::integral_constant<unsigned, CHECK_UTF8 | CHECK_STRICT>());
+  }
+  f(std::integral_constant<unsigned, 0>());
+}
+
+// the loops work on a copy of the state, kept in registers since the stores
+// to their output could alias the original; the strict state is large, and
+// only copied in and out when checked
+template <unsigned checks>
+really_inline void copy_state(ParseState & to, const ParseState & from) {
+  to.prev_iter_inside_quote = from.prev_iter_inside_quote;
+  to.prev_iter_cr_end = from.prev_iter_cr_end;
+  to.utf8_tail = from.utf8_tail;
+  if (checks & CHECK_STRICT) {
+    to.strict = from.strict;
+  }
+}
+
+template <unsigned checks, typename D>
+really_inline bool scan_blocks(const uint8_t *buf, size_t idx, size_t n_blocks,
+                               const D &dialect, ParseState &state_in,
+                               uint64_t *seps, uint64_t *ends) {
+  ParseState state;
+  copy_state<checks>(state, state_in);
+  utf8_checker checker;
+  utf8_init(checker, state.utf8_tail);
+  // the quote checks of strict mode go by batches of this many blocks
+  const size_t batch = 8;
+  uint64_t quotes[batch];
+  uint64_t quote_mask[batch];
+  for (size_t b = 0; b < n_blocks; b++) {
+    size_t internal_idx = 64 * b + idx;
+#ifndef _MSC_VER
+    __builtin_prefetch(buf + internal_idx + 128);
+#endif
+    simd_input in = fill_input(buf + internal_idx);
+    seps[b] = check_field_sep<checks>(in, dialect, state, checker, ends[b],
+                                      quotes[b % batch], quote_mask[b % batch]);
+    if ((checks & CHECK_STRICT) && (b % batch == batch - 1 || b + 1 == n_blocks)) {
+      size_t first = b - b % batch;
+      strict_check_quotes(state.strict, 64 * first + idx, b - first + 1,
+                          dialect.crlf, quotes, quote_mask, seps + first,
+                          ends + first);
+    }
+  }
+  if ((checks & CHECK_UTF8) && n_blocks > 0) {
+    state.utf8_tail = utf8_tail(buf + idx + 64 * n_blocks);
+  }
+  copy_state<checks>(state_in, state);
+  return !(checks & CHECK_UTF8) || utf8_valid(checker);
+}
+
+bool scan_blocks(const uint8_t *buf, size_t idx, size_t n_blocks,
+                 const Dialect &dialect, ParseState &state, uint64_t *seps,
+                 uint64_t *ends, unsigned checks) {
+  bool valid = true;
+  with_dialect(dialect, [&](auto d) {
+    with_checks(checks, [&](auto c) {
+      valid = scan_blocks<decltype(c)::value>(buf, idx, n_blocks, d, state,
+                                              seps, ends);
+    });
+  });
+  return valid;
+}
+
+#ifdef SIMDCSV_INSTRUMENT
+template <ScanStage stage, typename D>
+really_inline uint64_t scan_stage(const uint8_t *buf, size_t n_blocks,
+                                  const D &dialect) {
+  ParseState state;
+  uint64_t sink = 0;
+  for (size_t b = 0; b < n_blocks; b++) {
+#ifndef _MSC_VER
+    __builtin_prefetch(buf + 64 * b + 128);
+#endif
+    simd_input in = fill_input(buf + 64 * b);
+    if (stage == SCAN_COMPARE) {
+      sink += cmp_mask_against_input(in, dialect.delimiter) ^
+              cmp_mask_against_input(in, dialect.quote) ^
+              cmp_mask_against_input(in, 0x0a);
+      if (dialect.crlf) {
+        sink ^= cmp_mask_against_input(in, 0x0d);
+      }
+    } else {
+      uint64_t record_ends, quotes, quote_mask;
+      sink += find_field_sep(in, dialect, state, record_ends, quotes, quote_mask);
+    }
+  }
+  return sink;
+}
+
+uint64_t scan_stage(const uint8_t *buf, size_t n_blocks, const Dialect &dialect,
+                    ScanStage stage) {
+  uint64_t sink = 0;
+  with_dialect(dialect, [&](auto d) {
+    sink = stage == SCAN_COMPARE ? scan_stage<SCAN_COMPARE>(buf, n_blocks, d)
+                                 : scan_stage<SCAN_SEPARATORS>(buf, n_blocks, d);
+  });
+  return sink;
+}
+
+uint64_t quote_mask_stage(const uint64_t *quote_bits, size_t n_blocks) {
+  uint64_t prev_iter_inside_quote = 0;
+  uint64_t sink = 0;
+  for (size_t b = 0; b < n_blocks; b++) {
+    sink += quote_mask_of_bits(quote_bits[b], prev_iter_inside_quote);
+  }
+  return sink;
+}
+#endif // SIMDCSV_INSTRUMENT
+
+//
+// This optimization option might be helpful
+// When it is OFF:
+// $ ./simdcsv ../examples/nfl.csv
+// Cycles per byte 0.694172
+// GB/s: 4.26847
+// When it is ON:
+// $ ./simdcsv ../examples/nfl.csv
+// Cycles per byte 0.55007
+// GB/s: 5.29778
+// Explanation: It slightly reduces cache misses, but that's probably irrelevant,
+// However, it seems to improve drastically the number of instructions per cycle.
+#define SIMDCSV_BUFFERING
+
+// FLATTEN_BRANCHLESS: a byte of bits at a time, the positions of its set
+// bits from compress_lut; all 8 entries are written whatever their number
+template <typename index_t>
+really_inline void flatten_bits_branchless(index_t *base_ptr, index_t &base,
+                                           index_t idx, uint64_t bits) {
+  for (int b = 0; b < 8; b++) {
+    uint8_t byte = static_cast<uint8_t>(bits >> (8 * b));
+    const uint8_t *pos = compress_lut.shuffle[byte];
+    index_t *out = base_ptr + base;
+    for (int j = 0; j < 8; j++) {
+      out[j] = idx + static_cast<index_t>(8 * b + pos[j]);
+    }
+    base += hamming(byte);
+  }
+}
+
+// flatten_bits by the Flattener F, which must be one of 'flatteners'
+template <Flattener F, typename index_t>
+really_inline void flatten(index_t *base_ptr, index_t &base, index_t idx,
+                           uint64_t bits) {
+  if constexpr (F == FLATTEN_BRANCHLESS) {
+    flatten_bits_branchless(base_ptr, base, idx, bits);
+  } else if constexpr (F == FLATTEN_LUT) {
+    flatten_bits_lut(base_ptr, base, idx, bits);
+  } else if constexpr (F == FLATTEN_COMPRESS) {
+    flatten_bits_compress(base_ptr, base, idx, bits);
+  } else {
+    flatten_bits(base_ptr, base, idx, bits);
+  }
+}
+
+// calls f(std::integral_constant<Flattener, active_flattener>()), or with
+// FLATTEN_UNROLLED if this kernel lacks the active flattener
+template <typename F>
+really_inline void with_flattener(F f) {
+  switch (active_flattener) {
+  case FLATTEN_BRANCHLESS:
+    if constexpr ((flatteners & (1u << FLATTEN_BRANCHLESS)) != 0) {
+      return f(std::integral_constant<Flattener, FLATTEN_BRANCHLESS>());
+    }
+    break;
+  case FLATTEN_LUT:
+    if constexpr ((flatteners & (1u << FLATTEN_LUT)) != 0) {
+      return f(std::integral_constant<Flattener, FLATTEN_LUT>());
+    }
+    break;
+  case FLATTEN_COMPRESS:
+    if constexpr ((flatteners & (1u << FLATTEN_COMPRESS)) != 0) {
+      return f(std::integral_constant<Flattener, FLATTEN_COMPRESS>());
+    }
+    break;
+  default:
+    break;
+  }
+  f(std::integral_constant<Flattener, FLATTEN_UNROLLED>());
+}
+
+template <unsigned checks, typename index_t, typename D,
+          Flattener F = FLATTEN_UNROLLED>
+really_inline bool index_range(const uint8_t * buf, size_t idx, size_t end,
+                               const D & dialect, ParseState & state_in,
+                               index_t *base_ptr, index_t & base) {
+  ParseState state;
+  copy_state<checks>(state, state_in);
+  utf8_checker checker;
+  utf8_init(checker, state.utf8_tail);
+  const size_t start = idx;
+  // only used in strict mode: the quote checks are done block by block as
+  // they are scanned, the field counts by the batch flattened (see
+  // strict_check.h)
+  uint64_t record_ends[4];
+  uint64_t quotes, quote_mask;
+  uint64_t k[5];
+#ifdef SIMDCSV_BUFFERING
+  // we do the index decoding in bulk for better pipelining.
+#define SIMDCSV_BUFFERSIZE 4 // it seems to be about the sweetspot.
+  uint64_t fields[SIMDCSV_BUFFERSIZE];
+  for (; idx + 64 * SIMDCSV_BUFFERSIZE <= end; idx += 64 * SIMDCSV_BUFFERSIZE) {
+    for(size_t b = 0; b < SIMDCSV_BUFFERSIZE; b++){
+      size_t internal_idx = 64 * b + idx;
+#ifndef _MSC_VER
+      __builtin_prefetch(buf + internal_idx + 128);
+#endif
+      simd_input in = fill_input(buf + internal_idx);
+      fields[b] = check_field_sep<checks>(in, dialect, state, checker,
+                                          record_ends[b], quotes, quote_mask);
+      if (checks & CHECK_STRICT) {
+        strict_check_quotes(state.strict, internal_idx, 1, dialect.crlf,
+                            &quotes, &quote_mask, fields + b, record_ends + b);
+      }
+    }
+    for(size_t b = 0; b < SIMDCSV_BUFFERSIZE; b++){
+      size_t internal_idx = 64 * b + idx;
+      k[b] = base;
+      flatten<F>(base_ptr, base, static_cast<index_t>(internal_idx), fields[b]);
+    }
+    if (checks & CHECK_STRICT) {
+      k[SIMDCSV_BUFFERSIZE] = base;
+      strict_check_ends(state.strict, idx, SIMDCSV_BUFFERSIZE, fields,
+                        record_ends, k);
+    }
+  }
+#undef SIMDCSV_BUFFERSIZE
+  // tail end will be unbuffered
+#endif // SIMDCSV_BUFFERING
+  for (; idx < end; idx += 64) {
+#ifndef _MSC_VER
+    __builtin_prefetch(buf + idx + 128);
+#endif
+    simd_input in = fill_input(buf + idx);
+    uint64_t field_sep = check_field_sep<checks>(in, dialect, state, checker,
+                                                 record_ends[0], quotes,
+                                                 quote_mask);
+    k[0] = base;
+    flatten<F>(base_ptr, base, static_cast<index_t>(idx), field_sep);
+    if (checks & CHECK_STRICT) {
+      k[1] = base;
+      strict_check_quotes(state.strict, idx, 1, dialect.crlf, &quotes,
+                          &quote_mask, &field_sep, record_ends);
+      strict_check_ends(state.strict, idx, 1, &field_sep, record_ends, k);
+    }
+  }
+  if ((checks & CHECK_UTF8) && idx > start) {
+    state.utf8_tail = utf8_tail(buf + idx);
+  }
+  copy_state<checks>(state_in, state);
+  return !(checks & CHECK_UTF8) || utf8_valid(checker);
+}
+
+bool index_range32(const uint8_t *buf, size_t idx, size_t end,
+                   const Dialect &dialect, ParseState &state,
+                   uint32_t *base_ptr, uint32_t &base, unsigned checks) {
+  bool valid = true;
+  with_dialect(dialect, [&](auto d) {
+    with_checks(checks, [&](auto c) {
+      if constexpr (decltype(c)::value == 0) {
+        // the flatteners are compared on the plain index alone
+        with_flattener([&](auto f) {
+          valid = index_range<0, uint32_t, decltype(d), decltype(f)::value>(
+              buf, idx, end, d, state, base_ptr, base);
+        });
+      } else {
+        valid = index_range<decltype(c)::value>(buf, idx, end, d, state,
+                                                base_ptr, base);
+      }
+    });
+  });
+  return valid;
+}
+
+bool index_range64(const uint8_t *buf, size_t idx, size_t end,
+                   const Dialect &dialect, ParseState &state,
+                   uint64_t *base_ptr, uint64_t &base, unsigned checks) {
+  bool valid = true;
+  with_dialect(dialect, [&](auto d) {
+    with_checks(checks, [&](auto c) {
+      if constexpr (decltype(c)::value == 0) {
+        // the flatteners are compared on the plain index alone
+        with_flattener([&](auto f) {
+          valid = index_range<0, uint64_t, decltype(d), decltype(f)::value>(
+              buf, idx, end, d, state, base_ptr, base);
+        });
+      } else {
+        valid = index_range<decltype(c)::value>(buf, idx, end, d, state,
+                                                base_ptr, base);
+      }
+    });
+  });
+  return valid;
+}
+
+#undef SIMDCSV_BUFFERING
+
+uint64_t quote_parity(const uint8_t *buf, size_t n_blocks, uint8_t quote) {
+  uint64_t parity = 0;
+  for (size_t b = 0; b < n_blocks; b++) {
+    parity ^= cmp_mask_against_input(fill_input(buf + 64 * b), quote);
+  }
+  return parity;
+}
+
+// the drop mask of a block is the second quote of each pair: the quote mask
+// is set on the first and cleared on the second. Whole groups of 8 go
+// through compress8, which writes no further than the end of the group it
+// reads, so that dst may be src.
+really_inline uint8_t *unescape_block(const uint8_t *block, size_t len,
+                                      uint64_t drop, uint8_t *out) {
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    memcpy(&word, block + i, 8);
+    uint8_t keep = static_cast<uint8_t>(~drop >> i);
+    compress8(word, keep, out);
+    out += hamming(keep);
+  }
+  for (; i < len; i++) {
+    if (!((drop >> i) & 1)) {
+      *out++ = block[i];
+    }
+  }
+  return out;
+}
+
+size_t unescape(const uint8_t *src, size_t len, uint8_t quote, uint8_t *dst) {
+  uint64_t inside_quote = 0;
+  uint8_t *out = dst;
+  size_t idx = 0;
+  for (; idx + 64 <= len; idx += 64) {
+    simd_input in = fill_input(src + idx);
+    uint64_t quotes = cmp_mask_against_input(in, quote);
+    uint64_t drop = quotes & ~find_quote_mask(in, quote, inside_quote);
+    if (drop == 0) {
+      if (out != src + idx) {
+        memmove(out, src + idx, 64);
+      }
+      out += 64;
+    } else {
+      out = unescape_block(src + idx, 64, drop, out);
+    }
+  }
+  if (idx < len) {
+    // the tail goes through a copy, so as not to read past src + len
+    uint8_t tail[64] = {0};
+    memcpy(tail, src + idx, len - idx);
+    simd_input in = fill_input(tail);
+    uint64_t quotes = cmp_mask_against_input(in, quote);
+    uint64_t drop = quotes & ~find_quote_mask(in, quote, inside_quote);
+    out = unescape_block(tail, len - idx, drop, out);
+  }
+  return out - dst;
+}
+
+void classify(const uint8_t *buf, size_t n_blocks, uint64_t *masks) {
+  for (size_t b = 0; b < n_blocks; b++) {
+    simd_input in = fill_input(buf + 64 * b);
+    uint64_t *m = masks + N_CHAR_CLASSES * b;
+    m[CLASS_DIGIT] = range_mask_against_input(in, '0', '9');
+    m[CLASS_MINUS] = cmp_mask_against_input(in, '-');
+    m[CLASS_PLUS] = cmp_mask_against_input(in, '+');
+    m[CLASS_DOT] = cmp_mask_against_input(in, '.');
+    m[CLASS_EXPONENT] = cmp_mask_against_input(in, 'e') |
+                        cmp_mask_against_input(in, 'E');
+    m[CLASS_SLASH] = cmp_mask_against_input(in, '/');
+    m[CLASS_COLON] = cmp_mask_against_input(in, ':');
+    m[CLASS_SPACE] = cmp_mask_against_input(in, ' ');
+  }
+}
@@ -0,0 +1,170 @@
+#include "simd_kernels.h"
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include "compress_lut.h"
+#include "portability.h"
+#include "utf8.h"
+#include <cstring>
+#include <arm_neon.h>
+
+namespace neon {
+
+struct simd_input {
+  uint8x16_t i0;
+  uint8x16_t i1;
+  uint8x16_t i2;
+  uint8x16_t i3;
+};
+
+really_inline simd_input fill_input(const uint8_t * ptr) {
+  struct simd_input in;
+  in.i0 = vld1q_u8(ptr + 0);
+  in.i1 = vld1q_u8(ptr + 16);
+  in.i2 = vld1q_u8(ptr + 32);
+  in.i3 = vld1q_u8(ptr + 48);
+  return in;
+}
+
+really_inline uint64_t neonmovemask_bulk(uint8x16_t p0, uint8x16_t p1,
+                                         uint8x16_t p2, uint8x16_t p3) {
+  const uint8x16_t bitmask = {0x01, 0x02, 0x4, 0x8, 0x10, 0x20, 0x40, 0x80,
+                              0x01, 0x02, 0x4, 0x8, 0x10, 0x20, 0x40, 0x80};
+  uint8x16_t t0 = vandq_u8(p0, bitmask);
+  uint8x16_t t1 = vandq_u8(p1, bitmask);
+  uint8x16_t t2 = vandq_u8(p2, bitmask);
+  uint8x16_t t3 = vandq_u8(p3, bitmask);
+  uint8x16_t sum0 = vpaddq_u8(t0, t1);
+  uint8x16_t sum1 = vpaddq_u8(t2, t3);
+  sum0 = vpaddq_u8(sum0, sum1);
+  sum0 = vpaddq_u8(sum0, sum0);
+  return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+}
+
+really_inline uint64_t cmp_mask_against_input(simd_input in, uint8_t m) {
+  const uint8x16_t mask = vmovq_n_u8(m);
+  uint8x16_t cmp_res_0 = vceqq_u8(in.i0, mask);
+  uint8x16_t cmp_res_1 = vceqq_u8(in.i1, mask);
+  uint8x16_t cmp_res_2 = vceqq_u8(in.i2, mask);
+  uint8x16_t cmp_res_3 = vceqq_u8(in.i3, mask);
+  return neonmovemask_bulk(cmp_res_0, cmp_res_1, cmp_res_2, cmp_res_3);
+}
+
+// see the AVX2 kernel; NEON has the unsigned compare
+really_inline uint64_t range_mask_against_input(simd_input in, uint8_t lo,
+                                                uint8_t hi) {
+  const uint8x16_t low = vmovq_n_u8(lo);
+  const uint8x16_t width = vmovq_n_u8(hi - lo);
+  return neonmovemask_bulk(vcleq_u8(vsubq_u8(in.i0, low), width),
+                           vcleq_u8(vsubq_u8(in.i1, low), width),
+                           vcleq_u8(vsubq_u8(in.i2, low), width),
+                           vcleq_u8(vsubq_u8(in.i3, low), width));
+}
+
+// see the AVX2 kernel
+really_inline uint64_t quote_mask_of_bits(uint64_t quote_bits,
+                                          uint64_t &prev_iter_inside_quote) {
+#ifdef __ARM_FEATURE_CRYPTO
+  uint64_t quote_mask = vmull_p64( -1ULL, quote_bits);
+#else
+  uint64_t quote_mask = quote_bits;
+  quote_mask ^= quote_mask << 1;
+  quote_mask ^= quote_mask << 2;
+  quote_mask ^= quote_mask << 4;
+  quote_mask ^= quote_mask << 8;
+  quote_mask ^= quote_mask << 16;
+  quote_mask ^= quote_mask << 32;
+#endif
+  quote_mask ^= prev_iter_inside_quote;
+  prev_iter_inside_quote =
+      static_cast<uint64_t>(static_cast<int64_t>(quote_mask) >> 63);
+  return quote_mask;
+}
+
+really_inline uint64_t find_quote_mask(simd_input in, uint8_t quote,
+                                       uint64_t &prev_iter_inside_quote) {
+  return quote_mask_of_bits(cmp_mask_against_input(in, quote),
+                            prev_iter_inside_quote);
+}
+
+// see the AVX2 kernel
+really_inline void compress8(uint64_t word, uint8_t keep, uint8_t *out) {
+  vst1_u8(out, vtbl1_u8(vcreate_u8(word), vld1_u8(compress_lut.shuffle[keep])));
+}
+
+// see the AVX2 kernel; the positions widened with vmovl
+const unsigned flatteners = (1u << FLATTEN_UNROLLED) |
+                            (1u << FLATTEN_BRANCHLESS) | (1u << FLATTEN_LUT);
+
+really_inline void flatten_bits_lut(uint32_t *base_ptr, uint32_t &base,
+                                    uint32_t idx, uint64_t bits) {
+  for (int b = 0; b < 8; b++) {
+    uint8_t byte = static_cast<uint8_t>(bits >> (8 * b));
+    uint16x8_t pos = vmovl_u8(vld1_u8(compress_lut.shuffle[byte]));
+    uint32x4_t start = vdupq_n_u32(idx + 8 * b);
+    vst1q_u32(base_ptr + base, vaddq_u32(vmovl_u16(vget_low_u16(pos)), start));
+    vst1q_u32(base_ptr + base + 4, vaddq_u32(vmovl_u16(vget_high_u16(pos)), start));
+    base += hamming(byte);
+  }
+}
+
+really_inline void flatten_bits_lut(uint64_t *base_ptr, uint64_t &base,
+                                    uint64_t idx, uint64_t bits) {
+  for (int b = 0; b < 8; b++) {
+    uint8_t byte = static_cast<uint8_t>(bits >> (8 * b));
+    uint16x8_t pos = vmovl_u8(vld1_u8(compress_lut.shuffle[byte]));
+    uint32x4_t lo = vmovl_u16(vget_low_u16(pos));
+    uint32x4_t hi = vmovl_u16(vget_high_u16(pos));
+    uint64x2_t start = vdupq_n_u64(idx + 8 * b);
+    uint64_t *out = base_ptr + base;
+    vst1q_u64(out, vaddq_u64(vmovl_u32(vget_low_u32(lo)), start));
+    vst1q_u64(out + 2, vaddq_u64(vmovl_u32(vget_high_u32(lo)), start));
+    vst1q_u64(out + 4, vaddq_u64(vmovl_u32(vget_low_u32(hi)), start));
+    vst1q_u64(out + 6, vaddq_u64(vmovl_u32(vget_high_u32(hi)), start));
+    base += hamming(byte);
+  }
+}
+
+// the primitives of utf8_lookup.h
+typedef uint8x16_t utf8_vec;
+const int utf8_chunks = 4;
+really_inline utf8_vec chunk(simd_input in, int i) {
+  return i == 0 ? in.i0 : i == 1 ? in.i1 : i == 2 ? in.i2 : in.i3;
+}
+really_inline bool is_ascii(simd_input in) {
+  return vmaxvq_u8(vorrq_u8(vorrq_u8(in.i0, in.i1), vorrq_u8(in.i2, in.i3))) < 0x80;
+}
+really_inline utf8_vec splat(uint8_t c) { return vmovq_n_u8(c); }
+really_inline utf8_vec vand(utf8_vec a, utf8_vec b) { return vandq_u8(a, b); }
+really_inline utf8_vec vor(utf8_vec a, utf8_vec b) { return vorrq_u8(a, b); }
+really_inline utf8_vec vxor(utf8_vec a, utf8_vec b) { return veorq_u8(a, b); }
+really_inline utf8_vec subs(utf8_vec a, utf8_vec b) { return vqsubq_u8(a, b); }
+really_inline utf8_vec shr4(utf8_vec a) { return vshrq_n_u8(a, 4); }
+really_inline utf8_vec lookup16(utf8_vec idx, const uint8_t *table) {
+  return vqtbl1q_u8(vld1q_u8(table), idx);
+}
+template <int N>
+really_inline utf8_vec prev(utf8_vec a, utf8_vec prev_a) {
+  return vextq_u8(prev_a, a, 16 - N);
+}
+really_inline bool any(utf8_vec a) { return vmaxvq_u8(a) != 0; }
+
+#include "utf8_lookup.h"
+#include "kernel_generic.h"
+
+} // namespace neon
+
+static bool neon_supported() {
+  return true; // part of the base aarch64 instruction set
+}
+
+extern const Kernel neon_kernel = {
+  "neon", "ARM NEON", neon_supported, neon::scan_blocks,
+  neon::index_range32, neon::index_range64,
+  neon::quote_parity, neon::unescape,
+  neon::classify, neon::flatteners
+#ifdef SIMDCSV_INSTRUMENT
+  , neon::scan_stage, neon::quote_mask_stage
+#endif
+};
+
+#endif // aarch64
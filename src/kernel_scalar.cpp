@@ -0,0 +1,133 @@
+#include "simd_kernels.h"
+
+#include <cstring>
+
+#include "compress_lut.h"
+#include "portability.h"
+#include "utf8.h"
+
+// the fallback for CPUs without any of the instruction sets below: the same
+// algorithm in plain 64-bit registers (SWAR), eight bytes at a time
+namespace scalar {
+
+struct simd_input {
+  uint64_t w[8];
+};
+
+really_inline simd_input fill_input(const uint8_t * ptr) {
+  struct simd_input in;
+  memcpy(in.w, ptr, 64);
+  return in;
+}
+
+really_inline uint64_t cmp_mask_against_input(simd_input in, uint8_t m) {
+  const uint64_t lows = 0x7f7f7f7f7f7f7f7fULL;
+  const uint64_t broadcast = 0x0101010101010101ULL * m;
+  uint64_t res = 0;
+  for (int i = 0; i < 8; i++) {
+    uint64_t x = in.w[i] ^ broadcast;
+    // the high bit of each byte is set iff the byte was equal to m
+    uint64_t eq = ~(((x & lows) + lows) | x | lows);
+    // gather the eight high bits into one byte
+    res |= ((eq >> 7) * 0x0102040810204080ULL >> 56) << (8 * i);
+  }
+  return res;
+}
+
+// the bytes in [lo, hi], hi < 0x80: with the high bit of each byte cleared,
+// adding 0x80 - lo sets it again from lo up, and adding 0x7f - hi from
+// past hi, without a carry into the next byte
+really_inline uint64_t range_mask_against_input(simd_input in, uint8_t lo,
+                                                uint8_t hi) {
+  const uint64_t lows = 0x7f7f7f7f7f7f7f7fULL;
+  const uint64_t from_lo = 0x0101010101010101ULL * (0x80 - lo);
+  const uint64_t past_hi = 0x0101010101010101ULL * (0x7f - hi);
+  uint64_t res = 0;
+  for (int i = 0; i < 8; i++) {
+    uint64_t x = in.w[i];
+    uint64_t in_range = ((x & lows) + from_lo) & ~((x & lows) + past_hi) & ~x &
+                        ~lows;
+    res |= ((in_range >> 7) * 0x0102040810204080ULL >> 56) << (8 * i);
+  }
+  return res;
+}
+
+// see the AVX2 kernel; the carry-less multiply by all ones is a prefix xor
+really_inline uint64_t quote_mask_of_bits(uint64_t quote_bits,
+                                          uint64_t &prev_iter_inside_quote) {
+  uint64_t quote_mask = quote_bits;
+  quote_mask ^= quote_mask << 1;
+  quote_mask ^= quote_mask << 2;
+  quote_mask ^= quote_mask << 4;
+  quote_mask ^= quote_mask << 8;
+  quote_mask ^= quote_mask << 16;
+  quote_mask ^= quote_mask << 32;
+  quote_mask ^= prev_iter_inside_quote;
+  prev_iter_inside_quote =
+      static_cast<uint64_t>(static_cast<int64_t>(quote_mask) >> 63);
+  return quote_mask;
+}
+
+really_inline uint64_t find_quote_mask(simd_input in, uint8_t quote,
+                                       uint64_t &prev_iter_inside_quote) {
+  return quote_mask_of_bits(cmp_mask_against_input(in, quote),
+                            prev_iter_inside_quote);
+}
+
+// see the AVX2 kernel; no byte shuffles here, a byte per bit set
+really_inline void compress8(uint64_t word, uint8_t keep, uint8_t *out) {
+  for (; keep != 0; keep &= keep - 1) {
+    *out++ = static_cast<uint8_t>(word >> (8 * trailingzeroes(keep)));
+  }
+}
+
+// the flatteners of kernel_generic.h that need no vector registers
+const unsigned flatteners = (1u << FLATTEN_UNROLLED) | (1u << FLATTEN_BRANCHLESS);
+
+// no lookup tables in plain registers: blocks that are not pure ASCII are
+// validated by the scalar code of utf8.h
+struct utf8_checker {
+  uint32_t tail;
+  bool valid;
+};
+
+really_inline void utf8_init(utf8_checker &c, uint32_t tail) {
+  c.tail = tail;
+  c.valid = true;
+}
+
+really_inline void utf8_check(utf8_checker &c, simd_input in) {
+  uint64_t high = 0;
+  for (int i = 0; i < 8; i++) {
+    high |= in.w[i];
+  }
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(in.w);
+  if ((high & 0x8080808080808080ULL) == 0) {
+    c.valid &= utf8_incomplete_tail(c.tail) == 0;
+  } else {
+    c.valid &= utf8_first_error(bytes, 64, c.tail) == 64;
+  }
+  c.tail = utf8_tail(bytes + 64);
+}
+
+really_inline bool utf8_valid(const utf8_checker &c) {
+  return c.valid;
+}
+
+#include "kernel_generic.h"
+
+} // namespace scalar
+
+static bool scalar_supported() {
+  return true;
+}
+
+extern const Kernel scalar_kernel = {
+  "scalar", "portable 64-bit code", scalar_supported, scalar::scan_blocks,
+  scalar::index_range32, scalar::index_range64,
+  scalar::quote_parity, scalar::unescape,
+  scalar::classify, scalar::flatteners
+#ifdef SIMDCSV_INSTRUMENT
+  , scalar::scan_stage, scalar::quote_mask_stage
+#endif
+};
@@ -0,0 +1,163 @@
+#include "simd_kernels.h"
+
+#if defined(__x86_64__)
+#include "compress_lut.h"
+#include "portability.h"
+#include "utf8.h"
+#include <cstring>
+#include <immintrin.h>
+
+SIMDCSV_TARGET_REGION("sse4.2,pclmul")
+namespace sse42 {
+
+struct simd_input {
+  __m128i v0;
+  __m128i v1;
+  __m128i v2;
+  __m128i v3;
+};
+
+really_inline simd_input fill_input(const uint8_t * ptr) {
+  struct simd_input in;
+  in.v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr + 0));
+  in.v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr + 16));
+  in.v2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr + 32));
+  in.v3 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr + 48));
+  return in;
+}
+
+really_inline uint64_t cmp_mask_against_input(simd_input in, uint8_t m) {
+  const __m128i mask = _mm_set1_epi8(m);
+  uint64_t res_0 = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(in.v0, mask)));
+  uint64_t res_1 = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(in.v1, mask)));
+  uint64_t res_2 = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(in.v2, mask)));
+  uint64_t res_3 = static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(in.v3, mask)));
+  return res_0 | (res_1 << 16) | (res_2 << 32) | (res_3 << 48);
+}
+
+// see the AVX2 kernel
+really_inline uint64_t range_mask_against_input(simd_input in, uint8_t lo,
+                                                uint8_t hi) {
+  const __m128i low = _mm_set1_epi8(lo);
+  const __m128i width = _mm_set1_epi8(hi - lo);
+  auto in_range = [&](__m128i v) {
+    __m128i t = _mm_sub_epi8(v, low);
+    return static_cast<uint64_t>(static_cast<uint16_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(t, width), t))));
+  };
+  return in_range(in.v0) | (in_range(in.v1) << 16) | (in_range(in.v2) << 32) |
+         (in_range(in.v3) << 48);
+}
+
+// see the AVX2 kernel
+really_inline uint64_t quote_mask_of_bits(uint64_t quote_bits,
+                                          uint64_t &prev_iter_inside_quote) {
+  uint64_t quote_mask = _mm_cvtsi128_si64(_mm_clmulepi64_si128(
+      _mm_set_epi64x(0ULL, quote_bits), _mm_set1_epi8(0xFF), 0));
+  quote_mask ^= prev_iter_inside_quote;
+  prev_iter_inside_quote =
+      static_cast<uint64_t>(static_cast<int64_t>(quote_mask) >> 63);
+  return quote_mask;
+}
+
+really_inline uint64_t find_quote_mask(simd_input in, uint8_t quote,
+                                       uint64_t &prev_iter_inside_quote) {
+  return quote_mask_of_bits(cmp_mask_against_input(in, quote),
+                            prev_iter_inside_quote);
+}
+
+// see the AVX2 kernel
+really_inline void compress8(uint64_t word, uint8_t keep, uint8_t *out) {
+  __m128i shuffle = _mm_loadl_epi64(
+      reinterpret_cast<const __m128i *>(compress_lut.shuffle[keep]));
+  _mm_storel_epi64(reinterpret_cast<__m128i *>(out),
+                   _mm_shuffle_epi8(_mm_cvtsi64_si128(word), shuffle));
+}
+
+// see the AVX2 kernel; four offsets to a register
+const unsigned flatteners = (1u << FLATTEN_UNROLLED) |
+                            (1u << FLATTEN_BRANCHLESS) | (1u << FLATTEN_LUT);
+
+really_inline __m128i lut_positions(uint64_t bits, int b) {
+  return _mm_loadl_epi64(reinterpret_cast<const __m128i *>(
+      compress_lut.shuffle[static_cast<uint8_t>(bits >> (8 * b))]));
+}
+
+really_inline void flatten_bits_lut(uint32_t *base_ptr, uint32_t &base,
+                                    uint32_t idx, uint64_t bits) {
+  for (int b = 0; b < 8; b++) {
+    __m128i pos = lut_positions(bits, b);
+    __m128i start = _mm_set1_epi32(idx + 8 * b);
+    __m128i *out = reinterpret_cast<__m128i *>(base_ptr + base);
+    _mm_storeu_si128(out, _mm_add_epi32(_mm_cvtepu8_epi32(pos), start));
+    _mm_storeu_si128(out + 1, _mm_add_epi32(
+                                  _mm_cvtepu8_epi32(_mm_srli_si128(pos, 4)), start));
+    base += hamming(static_cast<uint8_t>(bits >> (8 * b)));
+  }
+}
+
+really_inline void flatten_bits_lut(uint64_t *base_ptr, uint64_t &base,
+                                    uint64_t idx, uint64_t bits) {
+  for (int b = 0; b < 8; b++) {
+    __m128i pos = lut_positions(bits, b);
+    __m128i start = _mm_set1_epi64x(idx + 8 * b);
+    __m128i *out = reinterpret_cast<__m128i *>(base_ptr + base);
+    _mm_storeu_si128(out, _mm_add_epi64(_mm_cvtepu8_epi64(pos), start));
+    _mm_storeu_si128(out + 1, _mm_add_epi64(
+                                  _mm_cvtepu8_epi64(_mm_srli_si128(pos, 2)), start));
+    _mm_storeu_si128(out + 2, _mm_add_epi64(
+                                  _mm_cvtepu8_epi64(_mm_srli_si128(pos, 4)), start));
+    _mm_storeu_si128(out + 3, _mm_add_epi64(
+                                  _mm_cvtepu8_epi64(_mm_srli_si128(pos, 6)), start));
+    base += hamming(static_cast<uint8_t>(bits >> (8 * b)));
+  }
+}
+
+// the primitives of utf8_lookup.h
+typedef __m128i utf8_vec;
+const int utf8_chunks = 4;
+really_inline utf8_vec chunk(simd_input in, int i) {
+  return i == 0 ? in.v0 : i == 1 ? in.v1 : i == 2 ? in.v2 : in.v3;
+}
+really_inline bool is_ascii(simd_input in) {
+  return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(in.v0, in.v1),
+                                        _mm_or_si128(in.v2, in.v3))) == 0;
+}
+really_inline utf8_vec splat(uint8_t c) { return _mm_set1_epi8(c); }
+really_inline utf8_vec vand(utf8_vec a, utf8_vec b) { return _mm_and_si128(a, b); }
+really_inline utf8_vec vor(utf8_vec a, utf8_vec b) { return _mm_or_si128(a, b); }
+really_inline utf8_vec vxor(utf8_vec a, utf8_vec b) { return _mm_xor_si128(a, b); }
+really_inline utf8_vec subs(utf8_vec a, utf8_vec b) { return _mm_subs_epu8(a, b); }
+really_inline utf8_vec shr4(utf8_vec a) {
+  return _mm_and_si128(_mm_srli_epi16(a, 4), _mm_set1_epi8(0x0f));
+}
+really_inline utf8_vec lookup16(utf8_vec idx, const uint8_t *table) {
+  return _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(table)), idx);
+}
+template <int N>
+really_inline utf8_vec prev(utf8_vec a, utf8_vec prev_a) {
+  return _mm_alignr_epi8(a, prev_a, 16 - N);
+}
+really_inline bool any(utf8_vec a) { return !_mm_testz_si128(a, a); }
+
+#include "utf8_lookup.h"
+#include "kernel_generic.h"
+
+} // namespace sse42
+SIMDCSV_UNTARGET_REGION
+
+static bool sse42_supported() {
+  return __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul");
+}
+
+extern const Kernel sse42_kernel = {
+  "sse42", "SSE4.2 and CLMUL", sse42_supported, sse42::scan_blocks,
+  sse42::index_range32, sse42::index_range64,
+  sse42::quote_parity, sse42::unescape,
+  sse42::classify, sse42::flatteners
+#ifdef SIMDCSV_INSTRUMENT
+  , sse42::scan_stage, sse42::quote_mask_stage
+#endif
+};
+
+#endif // x86-64
@@ -1,265 +1,374 @@
 #include <unistd.h> // for getopt
 
+#include <cstring>
 #include <iostream>
+#include <string>
 #include <vector>
 
-#include "common_defs.h"
-#include "csv_defs.h"
-#include "io_util.h"
+#include "cli.h"
+#include "decompress.h"
+#include "dialect.h"
+#include "simd_kernels.h"
 #include "timing.h"
-#include "mem_util.h"
-#include "portability.h"
+#include "typed_columns.h"
 using namespace std;
 
-
-struct ParsedCSV {
-  uint32_t n_indexes{0};
-  uint32_t *indexes; 
-};
-
-struct simd_input {
-#ifdef __AVX2__
-  __m256i lo;
-  __m256i hi;
-#elif defined(__ARM_NEON)
-  uint8x16_t i0;
-  uint8x16_t i1;
-  uint8x16_t i2;
-  uint8x16_t i3;
-#else
-#error "It's called SIMDcsv for a reason, bro"
-#endif
-};
-
-really_inline simd_input fill_input(const uint8_t * ptr) {
-  struct simd_input in;
-#ifdef __AVX2__
-  in.lo = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr + 0));
-  in.hi = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ptr + 32));
-#elif defined(__ARM_NEON)
-  in.i0 = vld1q_u8(ptr + 0);
-  in.i1 = vld1q_u8(ptr + 16);
-  in.i2 = vld1q_u8(ptr + 32);
-  in.i3 = vld1q_u8(ptr + 48);
-#endif
-  return in;
+// a delimiter or quote given on the command line: a single character, or
+// "\t" or "tab" for a tab; returns false if it is neither
+static bool parse_dialect_char(const char *arg, uint8_t &c) {
+  if (strcmp(arg, "\\t") == 0 || strcmp(arg, "tab") == 0) {
+    c = '\t';
+    return true;
+  }
+  if (strlen(arg) != 1) {
+    return false;
+  }
+  c = static_cast<uint8_t>(arg[0]);
+  return true;
 }
 
-// a straightforward comparison of a mask against input. 5 uops; would be
-// cheaper in AVX512.
-really_inline uint64_t cmp_mask_against_input(simd_input in, uint8_t m) {
-#ifdef __AVX2__
-  const __m256i mask = _mm256_set1_epi8(m);
-  __m256i cmp_res_0 = _mm256_cmpeq_epi8(in.lo, mask);
-  uint64_t res_0 = static_cast<uint32_t>(_mm256_movemask_epi8(cmp_res_0));
-  __m256i cmp_res_1 = _mm256_cmpeq_epi8(in.hi, mask);
-  uint64_t res_1 = _mm256_movemask_epi8(cmp_res_1);
-  return res_0 | (res_1 << 32);
-#elif defined(__ARM_NEON)
-  const uint8x16_t mask = vmovq_n_u8(m); 
-  uint8x16_t cmp_res_0 = vceqq_u8(in.i0, mask); 
-  uint8x16_t cmp_res_1 = vceqq_u8(in.i1, mask); 
-  uint8x16_t cmp_res_2 = vceqq_u8(in.i2, mask); 
-  uint8x16_t cmp_res_3 = vceqq_u8(in.i3, mask); 
-  return neonmovemask_bulk(cmp_res_0, cmp_res_1, cmp_res_2, cmp_res_3);
-#endif
+// a comma-separated list of column:type, the type being i (int64) or d
+// (double), for -T; returns false if it is not one
+static bool parse_schema(const char *arg, vector<ColumnSpec> &schema) {
+  const char *s = arg;
+  while (*s != '\0') {
+    char *after;
+    size_t column = strtoull(s, &after, 10);
+    if (after == s || after[0] != ':' || (after[1] != 'i' && after[1] != 'd')) {
+      return false;
+    }
+    schema.push_back({column, after[1] == 'i' ? COLUMN_INT64 : COLUMN_DOUBLE});
+    s = after + 2;
+    if (*s == ',') {
+      s++;
+    } else if (*s != '\0') {
+      return false;
+    }
+  }
+  return !schema.empty();
 }
 
-
-// return the quote mask (which is a half-open mask that covers the first
-// quote in a quote pair and everything in the quote pair) 
-// We also update the prev_iter_inside_quote value to
-// tell the next iteration whether we finished the final iteration inside a
-// quote pair; if so, this  inverts our behavior of  whether we're inside
-// quotes for the next iteration.
-
-really_inline uint64_t find_quote_mask(simd_input in, uint64_t &prev_iter_inside_quote) {
-  uint64_t quote_bits = cmp_mask_against_input(in, '"');
-
-#ifdef __AVX2__
-  uint64_t quote_mask = _mm_cvtsi128_si64(_mm_clmulepi64_si128(
-      _mm_set_epi64x(0ULL, quote_bits), _mm_set1_epi8(0xFF), 0));
-#elif defined(__ARM_NEON)
-  uint64_t quote_mask = vmull_p64( -1ULL, quote_bits);
-#endif
-  quote_mask ^= prev_iter_inside_quote;
-
-  // right shift of a signed value expected to be well-defined and standard
-  // compliant as of C++20,
-  // John Regher from Utah U. says this is fine code
-  prev_iter_inside_quote =
-      static_cast<uint64_t>(static_cast<int64_t>(quote_mask) >> 63);
-  return quote_mask;
+// the options, for -h and for a command line that cannot be run
+static void usage(ostream &out, const char *program) {
+  out << "Usage: " << program << " [options] <csvfile>\n"
+      << "       " << program << " -D [-i <n>] [-k <kernel>]\n"
+      << "\n"
+      << "The default mode indexes the whole file and reports its speed; the\n"
+      << "others are picked with one of:\n"
+      << "  -S <bytes>    index a window of that many bytes at a time (<csvfile>\n"
+      << "                may then be -, standard input)\n"
+      << "  -P            with -S, read the windows on a thread of their own\n"
+      << "  -x <file>     write the index to a sidecar file, or reopen it\n"
+      << "  -b            build a BitmapIndex and time random row lookups\n"
+      << "  -o            count the records and fields, without an index\n"
+      << "  -y <n>        check <n> split points against the whole index\n"
+      << "  -z <bytes>    cut the file into pieces of that size, parse each\n"
+      << "  -G json|csv   profile the stages of indexing (SIMDCSV_INSTRUMENT)\n"
+      << "  -D            index synthetic data with each flattener\n"
+      << "  -c <columns>  index only those (0-based) columns, e.g. 0,3\n"
+      << "  -A            write the fields into Arrow-like column buffers\n"
+      << "\n"
+      << "Indexing:\n"
+      << "  -r            record the rows\n"
+      << "  -t <n>        index with <n> threads\n"
+      << "  -n            index the data in place, without padding\n"
+      << "  -w            64-bit offsets\n"
+      << "  -u            validate UTF-8\n"
+      << "  -R            check the RFC 4180 structure\n"
+      << "  -U            unescape the fields\n"
+      << "  -T <schema>   convert columns to numbers, e.g. 1:i,4:d, or auto\n"
+      << "  -N            with -T, the first row is a header\n"
+      << "  -I            sniff the dialect, header and column types\n"
+      << "\n"
+      << "Dialect:\n"
+      << "  -F <char>     the delimiter (default ,)\n"
+      << "  -Q <char>     the quote (default \")\n"
+      << "  -C            CR-LF line endings\n"
+      << "\n"
+      << "Input:\n"
+      << "  -m            map the file instead of reading it\n"
+      << "  -p            map it and populate the mapping\n"
+      << "  -H            map it with huge pages (with -z: the parser buffers)\n"
+      << "\n"
+      << "Measurement:\n"
+      << "  -i <n>        iterations (default 100)\n"
+      << "  -k <kernel>   force a kernel: avx512, avx2, sse42, neon, scalar\n"
+      << "  -f <name>     force a flattener: unrolled, branchless, lut, compress\n"
+      << "  -E <events>   the perf events to count, e.g. cycles,instructions\n"
+      << "  -v            verbose\n"
+      << "  -d            dump the separators (or fields) found\n"
+      << "  -h            this help\n";
 }
 
+// the options each mode takes, its own among them (-h and -s go with any):
+// any other is refused rather than silently ignored, and so is a second
+// mode
+static const struct {
+  char mode; // 0 for the default, the whole file indexed
+  const char *options;
+} mode_options[] = {
+    {'D', "vikD"},
+    {'z', "vikfFQCrHz"},
+    {'G', "vikfFQCEG"},
+    {'y', "vkfFQCy"},
+    {'o', "vikFQCo"},
+    {'b', "vikdFQCb"},
+    {'x', "vkfdFQCx"},
+    {'S', "vikfdFQCSPuR"},
+    {'c', "vikdFQCwmpHEIc"},
+    {'A', "vikdFQCwmpHEIA"},
+    {0, "vikfdFQCtwmpHruRUTNInE"},
+};
 
-// flatten out values in 'bits' assuming that they are are to have values of idx
-// plus their position in the bitvector, and store these indexes at
-// base_ptr[base] incrementing base as we go
-// will potentially store extra values beyond end of valid bits, so base_ptr
-// needs to be large enough to handle this
-really_inline void flatten_bits(uint32_t *base_ptr, uint32_t &base,
-                                uint32_t idx, uint64_t bits) {
-  if (bits != 0u) {
-    uint32_t cnt = hamming(bits);
-    uint32_t next_base = base + cnt;
-    base_ptr[base + 0] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-    bits = bits & (bits - 1);
-    base_ptr[base + 1] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-    bits = bits & (bits - 1);
-    base_ptr[base + 2] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-    bits = bits & (bits - 1);
-    base_ptr[base + 3] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-    bits = bits & (bits - 1);
-    base_ptr[base + 4] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-    bits = bits & (bits - 1);
-    base_ptr[base + 5] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-    bits = bits & (bits - 1);
-    base_ptr[base + 6] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-    bits = bits & (bits - 1);
-    base_ptr[base + 7] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-    bits = bits & (bits - 1);
-    if (cnt > 8) {
-      base_ptr[base + 8] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-      bits = bits & (bits - 1);
-      base_ptr[base + 9] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-      bits = bits & (bits - 1);
-      base_ptr[base + 10] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-      bits = bits & (bits - 1);
-      base_ptr[base + 11] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-      bits = bits & (bits - 1);
-      base_ptr[base + 12] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-      bits = bits & (bits - 1);
-      base_ptr[base + 13] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-      bits = bits & (bits - 1);
-      base_ptr[base + 14] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-      bits = bits & (bits - 1);
-      base_ptr[base + 15] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-      bits = bits & (bits - 1);
+// exits unless every option given goes with mode; as names the mode
+static void check_options(const string &given, char mode, const string &as) {
+  for (const auto &m : mode_options) {
+    if (m.mode != mode) {
+      continue;
     }
-    if (cnt > 16) {
-      base += 16;
-      do {
-        base_ptr[base] = static_cast<uint32_t>(idx) + trailingzeroes(bits);
-        bits = bits & (bits - 1);
-        base++;
-      } while (bits != 0);
-    }
-    base = next_base;
-  }
-}
-
-//
-// This optimization option might be helpful
-// When it is OFF:
-// $ ./simdcsv ../examples/nfl.csv
-// Cycles per byte 0.694172
-// GB/s: 4.26847
-// When it is ON:
-// $ ./simdcsv ../examples/nfl.csv
-// Cycles per byte 0.55007
-// GB/s: 5.29778
-// Explanation: It slightly reduces cache misses, but that's probably irrelevant,
-// However, it seems to improve drastically the number of instructions per cycle.
-#define SIMDCSV_BUFFERING 
-bool find_indexes(const uint8_t * buf, size_t len, ParsedCSV & pcsv) {
-  // does the previous iteration end inside a double-quote pair?
-  uint64_t prev_iter_inside_quote = 0ULL;  // either all zeros or all ones
-#ifdef CRLF
-  uint64_t prev_iter_cr_end = 0ULL; 
-#endif
-  size_t lenminus64 = len < 64 ? 0 : len - 64;
-  size_t idx = 0;
-  uint32_t *base_ptr = pcsv.indexes;
-  uint32_t base = 0;
-#ifdef SIMDCSV_BUFFERING
-  // we do the index decoding in bulk for better pipelining.
-#define SIMDCSV_BUFFERSIZE 4 // it seems to be about the sweetspot.
-  if(lenminus64 > 64 * SIMDCSV_BUFFERSIZE) {
-    uint64_t fields[SIMDCSV_BUFFERSIZE];
-    for (; idx < lenminus64 - 64 * SIMDCSV_BUFFERSIZE + 1; idx += 64 * SIMDCSV_BUFFERSIZE) {
-      for(size_t b = 0; b < SIMDCSV_BUFFERSIZE; b++){
-        size_t internal_idx = 64 * b + idx;
-#ifndef _MSC_VER
-        __builtin_prefetch(buf + internal_idx + 128);
-#endif
-        simd_input in = fill_input(buf+internal_idx);
-        uint64_t quote_mask = find_quote_mask(in, prev_iter_inside_quote);
-        uint64_t sep = cmp_mask_against_input(in, ',');
-#ifdef CRLF
-        uint64_t cr = cmp_mask_against_input(in, 0x0d);
-        uint64_t cr_adjusted = (cr << 1) | prev_iter_cr_end;
-        uint64_t lf = cmp_mask_against_input(in, 0x0a);
-        uint64_t end = lf & cr_adjusted;
-        prev_iter_cr_end = cr >> 63;
-#else
-        uint64_t end = cmp_mask_against_input(in, 0x0a);
-#endif
-        fields[b] = (end | sep) & ~quote_mask;
-      }
-      for(size_t b = 0; b < SIMDCSV_BUFFERSIZE; b++){
-        size_t internal_idx = 64 * b + idx;
-        flatten_bits(base_ptr, base, internal_idx, fields[b]);
+    for (char c : given) {
+      if (c != 'h' && c != 's' && strchr(m.options, c) == nullptr) {
+        cerr << "-" << c << " cannot be used " << as << endl;
+        exit(1);
       }
     }
   }
-  // tail end will be unbuffered
-#endif // SIMDCSV_BUFFERING
-  for (; idx < lenminus64; idx += 64) {
-#ifndef _MSC_VER
-      __builtin_prefetch(buf + idx + 128);
-#endif
-      simd_input in = fill_input(buf+idx);
-      uint64_t quote_mask = find_quote_mask(in, prev_iter_inside_quote);
-      uint64_t sep = cmp_mask_against_input(in, ',');
-#ifdef CRLF
-      uint64_t cr = cmp_mask_against_input(in, 0x0d);
-      uint64_t cr_adjusted = (cr << 1) | prev_iter_cr_end;
-      uint64_t lf = cmp_mask_against_input(in, 0x0a);
-      uint64_t end = lf & cr_adjusted;
-      prev_iter_cr_end = cr >> 63;
-#else
-      uint64_t end = cmp_mask_against_input(in, 0x0a);
-#endif
-    // note - a bit of a high-wire act here with quotes
-    // we can't put something inside the quotes with the CR
-    // then outside the quotes with LF so it's OK to "and off"
-    // the quoted bits here. Some other quote convention would
-    // need to be thought about carefully
-      uint64_t field_sep = (end | sep) & ~quote_mask;
-      flatten_bits(base_ptr, base, idx, field_sep);
-  }
-#undef SIMDCSV_BUFFERSIZE
-  pcsv.n_indexes = base;
-  return true;
 }
 
 int main(int argc, char * argv[]) {
   int c; 
-  bool verbose = false;
-  bool dump = false;
-  size_t iterations = 100;
+  CliOptions o;
+  string given; // the options, each once
   //bool squash_counters = false; // unused.
 
-  while ((c = getopt(argc, argv, "vdi:s")) != -1){
+  while ((c = getopt(argc, argv, "vdi:st:wS:PmpHrc:k:f:Dnboy:E:G:F:Q:CuRUT:NhAIx:z:")) != -1){
+    if (given.find(char(c)) == string::npos) {
+      given += char(c);
+    }
     switch (c) {
     case 'v':
-      verbose = true;
+      o.verbose = true;
       break;
     case 'd':
-      dump = true;
+      o.dump = true;
       break;
     case 'i':
-      iterations = atoi(optarg);
+      o.iterations = atoi(optarg);
+      break;
+    case 't':
+      o.threads = atoi(optarg);
+      break;
+    case 'w':
+      o.wide = true;
+      break;
+    case 'S':
+      o.window = strtoull(optarg, nullptr, 10);
+      break;
+    case 'P':
+      o.pipelined = true;
+      break;
+    case 'm':
+      o.map = true;
+      break;
+    case 'p':
+      o.map = true;
+      o.map_flags |= CORPUS_MAP_POPULATE;
+      break;
+    case 'H':
+      o.map = true;
+      o.map_flags |= CORPUS_MAP_HUGEPAGE;
+      break;
+    case 'r':
+      o.rows = true;
+      break;
+    case 'c': {
+      // comma-separated list of the (0-based) columns to keep
+      char *s = optarg;
+      while (*s != '\0') {
+        o.columns.push_back(strtoull(s, &s, 10));
+        if (*s == ',') {
+          s++;
+        } else if (*s != '\0') {
+          cerr << "bad column list " << optarg << endl;
+          exit(1);
+        }
+      }
+      break;
+    }
+    case 'k':
+      if (!select_kernel(optarg)) {
+        cerr << "kernel " << optarg << " is not available, try one of:";
+        for (const Kernel *k : all_kernels()) {
+          if (k->supported()) {
+            cerr << " " << k->name;
+          }
+        }
+        cerr << endl;
+        exit(1);
+      }
+      break;
+    case 'f':
+      if (!select_flattener(optarg)) {
+        cerr << "flattener " << optarg << " is not available, try one of:";
+        for (unsigned f = 0; f < N_FLATTENERS; f++) {
+          if (active_kernel->flatteners & (1u << f)) {
+            cerr << " " << flattener_name(Flattener(f));
+          }
+        }
+        cerr << endl;
+        exit(1);
+      }
+      break;
+    case 'D':
+      o.sweep = true;
+      break;
+    case 'n':
+      o.unpadded = true;
+      break;
+    case 'b':
+      o.bitmap = true;
+      break;
+    case 'o':
+      o.count_only = true;
+      break;
+    case 'y':
+      o.split_points = strtoull(optarg, nullptr, 10);
+      break;
+    case 'E': {
+#ifdef __linux__
+      string bad;
+      if (!parse_perf_events(optarg, o.perf_events, bad)) {
+        cerr << "unknown perf event " << bad << endl;
+        exit(1);
+      }
+#else
+      cerr << "perf events are only counted on Linux" << endl;
+      exit(1);
+#endif
+      break;
+    }
+    case 'G':
+      if (strcmp(optarg, "json") != 0 && strcmp(optarg, "csv") != 0) {
+        cerr << "bad profile format " << optarg << " (json or csv)" << endl;
+        exit(1);
+      }
+      o.profile_format = optarg;
+      break;
+    case 'F':
+      if (!parse_dialect_char(optarg, o.dialect.delimiter)) {
+        cerr << "bad delimiter " << optarg << endl;
+        exit(1);
+      }
+      break;
+    case 'Q':
+      if (!parse_dialect_char(optarg, o.dialect.quote)) {
+        cerr << "bad quote " << optarg << endl;
+        exit(1);
+      }
+      break;
+    case 'C':
+      o.dialect.crlf = true;
+      break;
+    case 'u':
+      o.utf8 = true;
+      break;
+    case 'R':
+      o.strict = true;
+      break;
+    case 'U':
+      o.unescape = true;
+      break;
+    case 'T':
+      if (strcmp(optarg, "auto") == 0) {
+        // the numeric columns, as sniffed
+        o.sniff = o.sniff_schema_columns = true;
+      } else if (!parse_schema(optarg, o.schema)) {
+        cerr << "bad schema " << optarg << " (expected e.g. 1:i,4:d)" << endl;
+        exit(1);
+      }
+      o.rows = true; // the columns come from the row structure
+      break;
+    case 'N':
+      o.header_rows = 1;
+      break;
+    case 'h':
+      usage(cout, argv[0]);
+      return EXIT_SUCCESS;
+    case 'A':
+      o.columnar = true;
+      break;
+    case 'I':
+      o.sniff = true;
+      break;
+    case 'x':
+      o.index_path = optarg;
+      break;
+    case 'z':
+      o.piece = strtoull(optarg, nullptr, 10);
       break;
     case 's':
       //squash_counters = true;
       cerr << "unused parameter?" << endl;
       break;
+    default: // getopt has said what is wrong
+      usage(cerr, argv[0]);
+      exit(1);
     }
   }
+  // the mode: one of the options of mode_options, or none
+  char mode = 0;
+  for (char g : given) {
+    for (const auto &m : mode_options) {
+      if (m.mode == 0 || m.mode != g) {
+        continue;
+      }
+      if (mode != 0) {
+        cerr << "-" << mode << " and -" << g << " cannot be used together"
+             << endl;
+        exit(1);
+      }
+      mode = g;
+    }
+  }
+  check_options(given, mode,
+                mode == 0 ? string("in the default mode")
+                          : string("with -") + mode);
+  if (given.find('N') != string::npos && given.find('T') == string::npos) {
+    cerr << "-N needs -T" << endl;
+    exit(1);
+  }
+  if (given.find('n') != string::npos && given.find('t') != string::npos) {
+    cerr << "-n cannot be used with -t" << endl;
+    exit(1);
+  }
+  // the sizes that pick a mode cannot be zero
+  if (given.find('S') != string::npos && o.window == 0) {
+    cerr << "bad window size for -S" << endl;
+    exit(1);
+  }
+  if (given.find('z') != string::npos && o.piece == 0) {
+    cerr << "bad piece size for -z" << endl;
+    exit(1);
+  }
+  if (given.find('y') != string::npos && o.split_points == 0) {
+    cerr << "bad number of split points for -y" << endl;
+    exit(1);
+  }
+  if (o.sweep) {
+    // no input file: the data is synthetic
+    if (o.verbose) {
+      cout << "[verbose] kernel " << active_kernel->name << " ("
+           << active_kernel->description << ")" << endl;
+    }
+    return density_sweep(o.iterations, o.verbose);
+  }
   if (optind >= argc) {
-    cerr << "Usage: " << argv[0] << " <csvfile>" << endl;
+    usage(cerr, argv[0]);
+    exit(1);
+  }
+
+  if (!valid_dialect(o.dialect)) {
+    cerr << "the delimiter and the quote must differ and cannot be CR or LF" << endl;
     exit(1);
   }
 
@@ -268,101 +377,62 @@ int main(int argc, char * argv[]) {
     cerr << "warning: ignoring everything after " << argv[optind + 1] << endl;
   }
 
-  if (verbose) {
-    cout << "[verbose] loading " << filename << endl;
+  if (o.verbose) {
+    cout << "[verbose] kernel " << active_kernel->name << " ("
+         << active_kernel->description << "), flattener "
+         << flattener_name(active_flattener) << endl;
   }
-  std::basic_string_view<uint8_t> p;
-  try {
-    p = get_corpus(filename, CSV_PADDING);
-  } catch (const std::exception &e) { // caught by reference to base
-    std::cout << "Could not load the file " << filename << std::endl;
-    return EXIT_FAILURE;
+  // compressed inputs can only be streamed, decompressed on the way
+  Compression compression = COMPRESSION_NONE;
+  if (strcmp(filename, "-") != 0) {
+    try {
+      compression = detect_compression(filename);
+    } catch (const std::exception &e) {
+      std::cout << "Could not load the file " << filename << std::endl;
+      return EXIT_FAILURE;
+    }
   }
-  if (verbose) {
-    cout << "[verbose] loaded " << filename << " (" << p.size() << " bytes)" << endl;
+  if (compression != COMPRESSION_NONE) {
+    if (!compression_supported(compression)) {
+      cerr << filename << " is " << compression_name(compression)
+           << " compressed, which this build cannot read" << endl;
+      return EXIT_FAILURE;
+    }
+    // every other mode works on the whole file, loaded as it is on disk
+    check_options(given, 'S', "on a compressed file, which is only streamed");
+    if (o.verbose) {
+      cout << "[verbose] " << filename << " is " << compression_name(compression)
+           << " compressed, streaming it" << endl;
+    }
+    if (o.window == 0) {
+      o.window = 1 << 20;
+    }
+    o.pipelined = true;
   }
-#ifdef __linux__
-  vector<int> evts;
-  evts.push_back(PERF_COUNT_HW_CPU_CYCLES);
-  evts.push_back(PERF_COUNT_HW_INSTRUCTIONS);
-  evts.push_back(PERF_COUNT_HW_BRANCH_MISSES);
-  evts.push_back(PERF_COUNT_HW_CACHE_REFERENCES);
-  evts.push_back(PERF_COUNT_HW_CACHE_MISSES);
-  evts.push_back(PERF_COUNT_HW_REF_CPU_CYCLES);
-#endif //__linux__
-
-  ParsedCSV pcsv;
-  pcsv.indexes = new (std::nothrow) uint32_t[p.size()]; // can't have more indexes than we have data
-  if(pcsv.indexes == nullptr) {
-    cerr << "You are running out of memory." << endl;
-    return EXIT_FAILURE;
+  if (o.piece != 0) {
+    return small_files_benchmark(filename, o.piece, o.iterations, o.dialect,
+                                 o.rows, o.map_flags & CORPUS_MAP_HUGEPAGE,
+                                 o.verbose);
   }
-
-#ifdef __linux__
-  TimingAccumulator ta(2, evts);
-#endif // __linux__
-  double total = 0; // naive accumulator
-  for (size_t i = 0; i < iterations; i++) {
-      clock_t start = clock(); // brutally portable
-#ifdef __linux__
-      {TimingPhase p1(ta, 0);
-#endif // __linux__
-      find_indexes(p.data(), p.size(), pcsv);
-#ifdef __linux__
-      }{TimingPhase p2(ta, 1);} // the scoping business is an instance of C++ extreme programming
-#endif // __linux__
-      total += clock() - start; // brutally portable 
+  if (o.profile_format != nullptr) {
+    return profile_corpus(filename, o);
   }
-
-  if (dump) {
-    for (size_t i = 0; i < pcsv.n_indexes; i++) {
-      cout << pcsv.indexes[i] << ": ";
-      if (i != pcsv.n_indexes-1) {
-        for (size_t j = pcsv.indexes[i]; j < pcsv.indexes[i+1]; j++) {
-          cout << p[j];
-        }
-      }
-      cout << "\n";
-    }
-  } 
-  if(verbose) {
-    cout << "number of indexes found    : " << pcsv.n_indexes << endl;
-    cout << "number of bytes per index : " << p.size() / double(pcsv.n_indexes) << endl;
+  if (o.split_points != 0) {
+    return split_corpus(filename, o.split_points, o.dialect, o.verbose);
   }
-  double volume = iterations * p.size();
-  double time_in_s = total / CLOCKS_PER_SEC;
-  if(verbose) {
-    cout << "Total time in (s)          = " << time_in_s << endl;
-    cout << "Number of iterations       = " << volume << endl;
+  if (o.count_only) {
+    return count_corpus(filename, o.iterations, o.dialect, o.verbose);
   }
-#ifdef __linux__
-  if(verbose) {
-    cout << "Number of cycles                   = " << ta.results[0] << endl;
-    cout << "Number of cycles per byte          = " << ta.results[0] / volume << endl;
-    cout << "Number of cycles (ref)             = " << ta.results[5] << endl;
-    cout << "Number of cycles (ref) per byte    = " << ta.results[5] / volume << endl;
-    cout << "Number of instructions             = " << ta.results[1] << endl;
-    cout << "Number of instructions per byte    = " << ta.results[1] / volume << endl;
-    cout << "Number of instructions per cycle   = " << double(ta.results[1]) / ta.results[0] << endl;
-    cout << "Number of branch misses            = " << ta.results[2] << endl;
-    cout << "Number of branch misses per byte   = " << ta.results[2] / volume << endl;
-    cout << "Number of cache references         = " << ta.results[3] << endl;
-    cout << "Number of cache references per b.  = " << ta.results[3] / volume << endl;
-    cout << "Number of cache misses             = " << ta.results[4] << endl;
-    cout << "Number of cache misses per byte    = " << ta.results[4] / volume << endl;
-    cout << "CPU freq (effective)               = " << ta.results[0] / time_in_s / (1000 * 1000 * 1000) << endl; 
-    cout << "CPU freq (base)                    = " << ta.results[5] / time_in_s / (1000 * 1000 * 1000) << endl; 
-   } else {
-    ta.dump();
+  if (o.bitmap) {
+    return bitmap_corpus(filename, o.iterations, o.dialect, o.dump, o.verbose);
   }
-  cout << "Cycles per byte " << (1.0*ta.results[0])/volume << "\n";
-#endif
-  cout << " GB/s: " << volume / time_in_s / (1024 * 1024 * 1024) << endl;
-  if (verbose) {
-    cout << "[verbose] done " << endl;
+  if (o.index_path != nullptr) {
+    return index_file_corpus(filename, o.index_path, o.dialect, o.dump,
+                             o.verbose);
+  }
+  if (o.window != 0) {
+    return stream_corpus(filename, o.window, o.iterations, o.dialect, o.utf8,
+                         o.strict, o.dump, o.verbose, o.pipelined);
   }
-  delete[] pcsv.indexes;
-  aligned_free((void*)p.data());
-  return EXIT_SUCCESS;
+  return index_corpus(filename, o);
 }
-
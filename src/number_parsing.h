@@ -0,0 +1,260 @@
+#ifndef SIMDCSV_NUMBER_PARSING_H
+#define SIMDCSV_NUMBER_PARSING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "common_defs.h"
+#include "portability.h"
+#include "power_of_five.h"
+
+// Numbers out of fields, without strtoll/strtod. Digits are taken up to
+// eight at a time in a 64-bit register (SWAR): the bytes are turned into
+// digit values, the length of the run of digits is found from a mask, and
+// the run converted with three multiplications. Decimal to binary64 goes
+// through Clinger's fast path when the mantissa and the power of ten are
+// both exact doubles, through Eisel-Lemire (a 128-bit product with a
+// truncated power of five) otherwise, and only falls back to strtod beyond
+// 19 significant digits.
+//
+// The fields are [p, end) of a buffer that is readable at least 8 bytes
+// past end, as any buffer with CSV_PADDING is. Integers are an optional
+// sign and digits; floats also have an optional fraction and exponent. No
+// spaces, no "inf" or "nan", no hexadecimal.
+
+really_inline uint64_t read8(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, 8);
+  return v;
+}
+
+// the value of 8 digits, given as bytes 0 to 9, the first the most
+// significant
+really_inline uint32_t eight_digits_value(uint64_t val) {
+  const uint64_t mask = 0x000000FF000000FFULL;
+  const uint64_t mul1 = 0x000F424000000064ULL; // 100 + (1000000 << 32)
+  const uint64_t mul2 = 0x0000271000000001ULL; // 1 + (10000 << 32)
+  val = (val * 10) + (val >> 8);
+  val = (((val & mask) * mul1) + (((val >> 16) & mask) * mul2)) >> 32;
+  return static_cast<uint32_t>(val);
+}
+
+const uint64_t powers_of_ten_u64[] = {1ULL, 10ULL, 100ULL, 1000ULL,
+                                      10000ULL, 100000ULL, 1000000ULL,
+                                      10000000ULL, 100000000ULL};
+
+// the digits at p (before end) appended to w, count counting them: w is
+// exact as long as there are at most 19 of them in all. Returns what
+// follows them.
+really_inline const uint8_t *parse_digits(const uint8_t *p, const uint8_t *end,
+                                          uint64_t &w, size_t &count) {
+  while (p < end) {
+    uint64_t t = read8(p) ^ 0x3030303030303030ULL;
+    // the high bit of each byte that is not a digit (t >= 10); a carry out
+    // of a byte only ever corrupts the bytes after the first non-digit
+    uint64_t non_digits = ((t + 0x7676767676767676ULL) | t) & 0x8080808080808080ULL;
+    size_t n = non_digits == 0 ? 8 : trailingzeroes(non_digits) / 8;
+    if (n > static_cast<size_t>(end - p)) {
+      n = end - p;
+    }
+    if (n == 0) {
+      break;
+    }
+    // the digits to the top of the register, zeros (leading zeros of the
+    // number) below them
+    w = w * powers_of_ten_u64[n] + eight_digits_value(t << (8 * (8 - n)));
+    count += n;
+    p += n;
+    if (n < 8) {
+      break;
+    }
+  }
+  return p;
+}
+
+// returns false if [p, end) is not an integer that fits int64_t
+really_inline bool parse_int64(const uint8_t *p, const uint8_t *end,
+                               int64_t &out) {
+  bool negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+')) {
+    p++;
+  }
+  const uint8_t *digits = p;
+  uint64_t w = 0;
+  size_t count = 0;
+  p = parse_digits(p, end, w, count);
+  if (p != end || count == 0) {
+    return false;
+  }
+  if (count > 19) {
+    // leading zeros do not count
+    while (digits < end && *digits == '0') {
+      digits++;
+      count--;
+    }
+    if (count > 19) {
+      return false;
+    }
+  }
+  // 19 digits fit in 64 bits, not necessarily in 63
+  if (w > static_cast<uint64_t>(INT64_MAX) + negative) {
+    return false;
+  }
+  out = negative ? static_cast<int64_t>(0 - w) : static_cast<int64_t>(w);
+  return true;
+}
+
+// the high and low halves of a * b
+really_inline void full_multiplication(uint64_t a, uint64_t b, uint64_t &high,
+                                       uint64_t &low) {
+#ifdef _MSC_VER
+  low = _umul128(a, b, &high);
+#else
+  __uint128_t r = static_cast<__uint128_t>(a) * b;
+  high = static_cast<uint64_t>(r >> 64);
+  low = static_cast<uint64_t>(r);
+#endif
+}
+
+// the binary64 closest to w * 10^q (ties to even), w having at most 19
+// digits: Eisel-Lemire, as in fast_float, whose proof shows the 128-bit
+// product is always enough. Returns the bits of the double, sign aside.
+really_inline uint64_t eisel_lemire(int64_t q, uint64_t w) {
+  const int mantissa_bits = 52;
+  const int minimum_exponent = -1023;
+  const uint64_t infinite_power = 0x7FF;
+  if (w == 0 || q < smallest_power_of_five) {
+    return 0;
+  }
+  if (q > largest_power_of_five) {
+    return infinite_power << mantissa_bits;
+  }
+  int lz = leadingzeroes(w);
+  w <<= lz;
+  // the product with the power of five, to 55 bits of precision (the
+  // mantissa, a rounding bit, and one for the leading bit to move)
+  size_t index = 2 * static_cast<size_t>(q - smallest_power_of_five);
+  uint64_t high, low;
+  full_multiplication(w, power_of_five_128[index], high, low);
+  const uint64_t precision_mask = UINT64_MAX >> (mantissa_bits + 3);
+  if ((high & precision_mask) == precision_mask) {
+    uint64_t high2, low2;
+    full_multiplication(w, power_of_five_128[index + 1], high2, low2);
+    low += high2;
+    if (high2 > low) {
+      high++;
+    }
+  }
+  int upperbit = static_cast<int>(high >> 63);
+  int shift = upperbit + 64 - mantissa_bits - 3;
+  uint64_t mantissa = high >> shift;
+  // floor(log2(10^q)) + 63, as floor(q * log2(10)) in fixed point
+  int64_t power2 = (((152170 + 65536) * q) >> 16) + 63 + upperbit - lz -
+                   minimum_exponent;
+  if (power2 <= 0) {
+    // a subnormal, or zero
+    if (-power2 + 1 >= 64) {
+      return 0;
+    }
+    mantissa >>= -power2 + 1;
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    // rounding up may have made it normal
+    power2 = mantissa < (1ULL << mantissa_bits) ? 0 : 1;
+    return (static_cast<uint64_t>(power2) << mantissa_bits) |
+           (mantissa & ~(1ULL << mantissa_bits));
+  }
+  // exactly halfway between two doubles, only possible when 5^q fits in
+  // 64 bits: round to even rather than up
+  if (low <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 &&
+      (mantissa << shift) == high) {
+    mantissa &= ~1ULL;
+  }
+  mantissa += mantissa & 1;
+  mantissa >>= 1;
+  if (mantissa >= (2ULL << mantissa_bits)) {
+    mantissa = 1ULL << mantissa_bits;
+    power2++;
+  }
+  mantissa &= ~(1ULL << mantissa_bits);
+  if (power2 >= static_cast<int64_t>(infinite_power)) {
+    return infinite_power << mantissa_bits;
+  }
+  return (static_cast<uint64_t>(power2) << mantissa_bits) | mantissa;
+}
+
+const double exact_powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// returns false if [p, end) is not a decimal number
+really_inline bool parse_double(const uint8_t *p, const uint8_t *end,
+                                double &out) {
+  const uint8_t *start = p;
+  bool negative = p < end && *p == '-';
+  if (p < end && (*p == '-' || *p == '+')) {
+    p++;
+  }
+  const uint8_t *digits = p;
+  uint64_t w = 0;
+  size_t count = 0;
+  p = parse_digits(p, end, w, count);
+  int64_t exponent = 0;
+  if (p < end && *p == '.') {
+    p++;
+    const uint8_t *fraction = p;
+    p = parse_digits(p, end, w, count);
+    exponent = fraction - p;
+  }
+  if (count == 0) {
+    return false;
+  }
+  if (p < end && (*p | 0x20) == 'e') {
+    p++;
+    bool negative_exponent = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+')) {
+      p++;
+    }
+    if (p == end) {
+      return false;
+    }
+    int64_t e = 0;
+    for (; p < end && static_cast<uint8_t>(*p - '0') < 10; p++) {
+      // beyond any exponent that could matter
+      if (e < 0x10000000) {
+        e = 10 * e + (*p - '0');
+      }
+    }
+    exponent += negative_exponent ? -e : e;
+  }
+  if (p != end) {
+    return false;
+  }
+  if (count > 19) {
+    // leading zeros do not count
+    for (const uint8_t *z = digits; z < end && (*z == '0' || *z == '.'); z++) {
+      count -= *z == '0';
+    }
+    if (count > 19) {
+      std::string copy(reinterpret_cast<const char *>(start), end - start);
+      out = strtod(copy.c_str(), nullptr);
+      return true;
+    }
+  }
+  // Clinger: both exact, so a single rounding
+  if (exponent >= -22 && exponent <= 22 && w <= (1ULL << 53)) {
+    double d = static_cast<double>(w);
+    d = exponent < 0 ? d / exact_powers_of_ten[-exponent]
+                     : d * exact_powers_of_ten[exponent];
+    out = negative ? -d : d;
+    return true;
+  }
+  uint64_t bits = eisel_lemire(exponent, w) | (static_cast<uint64_t>(negative) << 63);
+  memcpy(&out, &bits, 8);
+  return true;
+}
+
+#endif
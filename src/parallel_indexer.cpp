@@ -0,0 +1,275 @@
+#include "parallel_indexer.h"
+
+#include <algorithm>
+#include <cstring>
+
+// below this many bytes per thread, waking the workers costs more than it saves
+#define SIMDCSV_MIN_CHUNK (64 * 1024)
+
+// strict mode: the number of fields of the first record (0 if there is no
+// record end), which the chunks need before their first own record ends
+static uint64_t first_record_fields(const uint8_t *buf, size_t end,
+                                    const Dialect &dialect) {
+  const size_t batch = 8;
+  uint64_t seps[batch];
+  uint64_t ends[batch];
+  ParseState state;
+  state.strict.limit = end;
+  for (size_t idx = 0; idx < end && state.strict.expected_fields == 0 &&
+                       state.strict.error.code == CSV_OK;
+       idx += 64 * batch) {
+    size_t n_blocks = std::min(batch, (end - idx + 63) / 64);
+    active_kernel->scan_blocks(buf, idx, n_blocks, dialect, state, seps, ends,
+                               CHECK_STRICT);
+    strict_count_ends(state.strict, idx, n_blocks, seps, ends);
+  }
+  return state.strict.expected_fields;
+}
+
+// strict mode: carry on the state 'merged' has after the chunks before with
+// the state a chunk ended in, as if it had been scanned in one go
+static void strict_merge(StrictState &merged, const StrictState &c) {
+  if (merged.error.code != CSV_OK) {
+    return;
+  }
+  merged.last_open = std::max(merged.last_open, c.last_open);
+  if (c.error.code != CSV_OK &&
+      (c.head_pending || c.error.offset < c.head_end)) {
+    strict_fail(merged, c.error.code, c.error.offset, merged.row);
+    return;
+  }
+  if (c.head_pending) {
+    // no record ends in the chunk
+    merged.row_fields += c.row_fields;
+    return;
+  }
+  uint64_t fields = merged.row_fields + c.head_fields;
+  if (merged.expected_fields == 0) {
+    merged.expected_fields = fields;
+  } else if (fields != merged.expected_fields) {
+    strict_fail(merged, CSV_RAGGED_ROW, c.head_end, merged.row);
+    return;
+  }
+  if (c.error.code != CSV_OK) {
+    strict_fail(merged, c.error.code, c.error.offset, merged.row + c.error.row);
+    return;
+  }
+  merged.row += c.row;
+  merged.row_fields = c.row_fields;
+  merged.row_start = c.row_start;
+}
+
+template <typename index_t>
+BasicParallelIndexer<index_t>::BasicParallelIndexer(size_t n_threads_in)
+    : n_threads(n_threads_in == 0 ? 1 : n_threads_in) {
+  chunks.resize(n_threads);
+  for (size_t t = 1; t < n_threads; t++) {
+    workers.emplace_back(&BasicParallelIndexer::worker_loop, this, t);
+  }
+}
+
+template <typename index_t>
+BasicParallelIndexer<index_t>::~BasicParallelIndexer() {
+  run_phase(PHASE_EXIT);
+  for (auto &w : workers) {
+    w.join();
+  }
+}
+
+template <typename index_t>
+void BasicParallelIndexer<index_t>::run_phase(Phase p) {
+  {
+    std::lock_guard<std::mutex> lock(m);
+    phase = p;
+    pending = workers.size();
+    generation++;
+  }
+  work_cv.notify_all();
+  if (p == PHASE_EXIT) {
+    return;
+  }
+  do_work(0);
+  std::unique_lock<std::mutex> lock(m);
+  done_cv.wait(lock, [this] { return pending == 0; });
+}
+
+template <typename index_t>
+void BasicParallelIndexer<index_t>::worker_loop(size_t t) {
+  uint64_t seen = 0;
+  while (true) {
+    Phase p;
+    {
+      std::unique_lock<std::mutex> lock(m);
+      work_cv.wait(lock, [&] { return generation != seen; });
+      seen = generation;
+      p = phase;
+    }
+    if (p == PHASE_EXIT) {
+      return;
+    }
+    do_work(t);
+    {
+      std::lock_guard<std::mutex> lock(m);
+      if (--pending == 0) {
+        done_cv.notify_one();
+      }
+    }
+  }
+}
+
+template <typename index_t>
+void BasicParallelIndexer<index_t>::do_work(size_t t) {
+  if (t >= n_chunks) {
+    return;
+  }
+  Chunk &c = chunks[t];
+  switch (phase) {
+  case PHASE_PARITY: {
+    // nobody needs to know what the last chunk ends in
+    if (t == n_chunks - 1) {
+      return;
+    }
+    uint64_t parity = active_kernel->quote_parity(
+        cur_buf + c.start, (c.end - c.start) / 64, cur_dialect.quote);
+    c.quote_parity = hamming(parity) & 1;
+    break;
+  }
+  case PHASE_INDEX: {
+    index_t *out = t == 0 ? cur_pcsv->indexes : c.segment.data();
+    index_t base = 0;
+    ParseState state = c.state;
+    unsigned checks = cur_pcsv->checks();
+    bool valid;
+    if (cur_pcsv->row_offsets != nullptr) {
+      index_t *rows = t == 0 ? cur_pcsv->row_offsets + 1 : c.row_segment.data();
+      index_t n_rows = 0;
+      valid = find_indexes_range<index_t, true>(cur_buf, c.start, c.end,
+                                                cur_dialect, state, out, base,
+                                                rows, n_rows, checks);
+      c.n_rows = n_rows;
+    } else {
+      valid = find_indexes_range(cur_buf, c.start, c.end, cur_dialect, state,
+                                 out, base, checks);
+    }
+    c.n_indexes = base;
+    c.end_state = state;
+    c.utf8_error = valid ? SIZE_MAX
+                         : utf8_range_error(cur_buf, c.start, c.end,
+                                            c.state.utf8_tail);
+    break;
+  }
+  case PHASE_STITCH:
+    if (t != 0) {
+      memcpy(cur_pcsv->indexes + c.offset, c.segment.data(),
+             c.n_indexes * sizeof(index_t));
+      if (cur_pcsv->row_offsets != nullptr) {
+        index_t *rows = cur_pcsv->row_offsets + 1 + c.row_offset;
+        for (size_t i = 0; i < c.n_rows; i++) {
+          rows[i] = c.row_segment[i] + c.offset;
+        }
+      }
+    }
+    break;
+  case PHASE_EXIT:
+    break;
+  }
+}
+
+template <typename index_t>
+bool BasicParallelIndexer<index_t>::find_indexes(const uint8_t *buf, size_t len,
+                                                 BasicParsedCSV<index_t> &pcsv,
+                                                 const Dialect &dialect) {
+  if (!fits_index_type<index_t>(len)) {
+    return false;
+  }
+  size_t lenminus64 = len < 64 ? 0 : len - 64;
+  size_t wanted = std::min(n_threads, lenminus64 / SIMDCSV_MIN_CHUNK);
+  if (wanted <= 1) {
+    return ::find_indexes(buf, len, pcsv, dialect);
+  }
+  size_t chunk_size = ROUNDUP_N((lenminus64 + wanted - 1) / wanted, 64);
+  n_chunks = (lenminus64 + chunk_size - 1) / chunk_size;
+  for (size_t t = 0; t < n_chunks; t++) {
+    Chunk &c = chunks[t];
+    c.start = t * chunk_size;
+    c.end = std::min(c.start + chunk_size, lenminus64);
+    // the last block of the last chunk may run 63 bytes past c.end and
+    // flatten_bits may overshoot by up to 15 entries
+    size_t capacity = c.end - c.start + 128;
+    if (t != 0 && c.segment.size() < capacity) {
+      c.segment.resize(capacity);
+    }
+    if (t != 0 && pcsv.row_offsets != nullptr && c.row_segment.size() < capacity) {
+      c.row_segment.resize(capacity);
+    }
+  }
+  cur_buf = buf;
+  cur_pcsv = &pcsv;
+  cur_dialect = dialect;
+
+  run_phase(PHASE_PARITY);
+  uint64_t expected_fields =
+      pcsv.strict ? first_record_fields(buf, lenminus64, dialect) : 0;
+  uint64_t inside_quote = 0;
+  for (size_t t = 0; t < n_chunks; t++) {
+    Chunk &c = chunks[t];
+    c.state = ParseState();
+    c.state.prev_iter_inside_quote = inside_quote ? ~0ULL : 0ULL;
+    c.state.prev_iter_cr_end =
+        dialect.crlf && c.start > 0 && buf[c.start - 1] == 0x0d;
+    c.state.utf8_tail = c.start > 0 ? utf8_tail(buf + c.start) : 0;
+    c.state.strict.limit = lenminus64;
+    if (pcsv.strict && t > 0) {
+      c.state.strict.expected_fields = expected_fields;
+      strict_chunk_start(c.state.strict, buf, c.start, inside_quote != 0,
+                         dialect);
+    }
+    inside_quote ^= c.quote_parity;
+  }
+
+  run_phase(PHASE_INDEX);
+  index_t total = 0;
+  index_t total_rows = 0;
+  for (size_t t = 0; t < n_chunks; t++) {
+    chunks[t].offset = total;
+    total += chunks[t].n_indexes;
+    if (pcsv.row_offsets != nullptr) {
+      chunks[t].row_offset = total_rows;
+      total_rows += chunks[t].n_rows;
+    }
+  }
+
+  run_phase(PHASE_STITCH);
+  pcsv.n_indexes = total;
+  if (pcsv.row_offsets != nullptr) {
+    pcsv.row_offsets[0] = 0;
+    pcsv.n_rows = total_rows;
+    close_last_row(pcsv, lenminus64);
+  }
+  pcsv.dialect = dialect;
+  if (pcsv.validate_utf8) {
+    // the first chunk in error holds the first error
+    pcsv.utf8_error = SIZE_MAX;
+    for (size_t t = 0; t < n_chunks && pcsv.utf8_error == SIZE_MAX; t++) {
+      pcsv.utf8_error = chunks[t].utf8_error;
+    }
+    if (pcsv.utf8_error == SIZE_MAX) {
+      size_t end = ROUNDUP_N(lenminus64, 64);
+      pcsv.utf8_error = utf8_end_error(end, utf8_tail(buf + end));
+    }
+  }
+  if (pcsv.strict) {
+    StrictState merged = chunks[0].end_state.strict;
+    for (size_t t = 1; t < n_chunks; t++) {
+      strict_merge(merged, chunks[t].end_state.strict);
+    }
+    strict_finish(merged, lenminus64,
+                  chunks[n_chunks - 1].end_state.prev_iter_inside_quote != 0);
+    pcsv.error = merged.error;
+    return pcsv.error.code == CSV_OK;
+  }
+  return true;
+}
+
+template class BasicParallelIndexer<uint32_t>;
+template class BasicParallelIndexer<uint64_t>;
@@ -0,0 +1,92 @@
+#ifndef SIMDCSV_PARALLEL_INDEXER_H
+#define SIMDCSV_PARALLEL_INDEXER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "find_indexes.h"
+
+// Multi-threaded find_indexes. The input is cut into one 64-byte aligned
+// chunk per thread and resolved in three phases:
+//
+// 1) every thread computes the parity of the quote characters in its chunk;
+//    a prefix xor over these tells each chunk whether it starts inside a
+//    quoted field (the CR state is just a look at the byte before the chunk).
+//    This prepass is a compare and a xor per block, so it runs at memory
+//    speed, and unlike speculation (Ge et al.) it is never wrong.
+// 2) every thread runs find_indexes_range over its chunk from that state into
+//    its own index segment (thread 0 writes straight into the output).
+// 3) the segments are copied, in parallel, to their final offsets (row
+//    offsets, if requested, are rebased onto the stitched index array).
+//
+// UTF-8 validation, if requested, is done in phase 2; every chunk starts
+// from the bytes just before it. So are the checks of strict mode, but for
+// the field count of the first record, found up front, and those of the
+// records straddling two chunks, pieced together afterwards.
+//
+// The worker threads are kept around between calls; the calling thread does
+// the work of thread 0. Results are identical to find_indexes.
+template <typename index_t>
+class BasicParallelIndexer {
+public:
+  explicit BasicParallelIndexer(size_t n_threads_in);
+  ~BasicParallelIndexer();
+
+  BasicParallelIndexer(const BasicParallelIndexer &) = delete;
+  BasicParallelIndexer &operator=(const BasicParallelIndexer &) = delete;
+
+  // same contract as find_indexes: pcsv.indexes must hold len entries
+  bool find_indexes(const uint8_t *buf, size_t len, BasicParsedCSV<index_t> &pcsv,
+                    const Dialect &dialect = Dialect());
+
+  size_t thread_count() const { return n_threads; }
+
+private:
+  enum Phase { PHASE_PARITY, PHASE_INDEX, PHASE_STITCH, PHASE_EXIT };
+
+  struct Chunk {
+    size_t start;
+    size_t end;
+    ParseState state;
+    uint64_t quote_parity;
+    index_t n_indexes;
+    index_t offset; // where the segment goes in the output
+    std::vector<index_t> segment;
+    // only used when the row structure is wanted, relative to the segment
+    index_t n_rows;
+    index_t row_offset;
+    std::vector<index_t> row_segment;
+    // only used when validating UTF-8, SIZE_MAX if the chunk is valid
+    size_t utf8_error;
+    // only used in strict mode, where the chunk left off
+    ParseState end_state;
+  };
+
+  void run_phase(Phase p);
+  void worker_loop(size_t t);
+  void do_work(size_t t);
+
+  size_t n_threads;
+  size_t n_chunks{0};
+  std::vector<Chunk> chunks;
+  std::vector<std::thread> workers;
+
+  // current job, only changed while all the workers are idle
+  const uint8_t *cur_buf{nullptr};
+  BasicParsedCSV<index_t> *cur_pcsv{nullptr};
+  Dialect cur_dialect;
+  Phase phase{PHASE_PARITY};
+
+  std::mutex m;
+  std::condition_variable work_cv;
+  std::condition_variable done_cv;
+  uint64_t generation{0};
+  size_t pending{0};
+};
+
+typedef BasicParallelIndexer<uint32_t> ParallelIndexer;
+typedef BasicParallelIndexer<uint64_t> ParallelIndexer64;
+
+#endif
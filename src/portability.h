@@ -80,5 +80,16 @@ static inline int hamming(uint64_t input_num) {
 
 #endif // _MSC_VER
 
+/* position of the k-th (from 0) set bit of input_num, k < hamming(input_num) */
+static inline int select_bit(uint64_t input_num, int k) {
+#ifdef __BMI2__
+	return trailingzeroes(_pdep_u64(1ULL << k, input_num));
+#else
+	for (int i = 0; i < k; i++) {
+		input_num &= input_num - 1;
+	}
+	return trailingzeroes(input_num);
+#endif
+}
 
 #endif // _PORTABILITY_H
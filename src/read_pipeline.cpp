@@ -0,0 +1,134 @@
+#include "read_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "csv_defs.h"
+#include "decompress.h"
+#include "io_util.h"
+#include "mem_util.h"
+
+ReadPipeline::ReadPipeline(size_t window_size_in, size_t n_buffers)
+    : window_len(ROUNDUP_N(window_size_in == 0 ? 64 : window_size_in, 64)) {
+  for (size_t i = 0; i < std::max<size_t>(n_buffers, 2); i++) {
+    uint8_t *b = allocate_padded_buffer(window_len, CSV_PADDING);
+    if (b == nullptr) {
+      for (uint8_t *p : buffers) {
+        aligned_free(p);
+      }
+      throw std::runtime_error("could not allocate memory");
+    }
+    buffers.push_back(b);
+  }
+}
+
+ReadPipeline::~ReadPipeline() {
+  for (uint8_t *b : buffers) {
+    aligned_free(b);
+  }
+}
+
+uint64_t ReadPipeline::run(const char *filename, const Callback &callback) {
+  std::unique_ptr<ByteSource> source = open_source(filename);
+  const size_t n = buffers.size();
+  // the length of the window in each buffer, or free
+  const size_t free_slot = SIZE_MAX;
+  std::vector<size_t> lengths(n, free_slot);
+  std::mutex mutex;
+  std::condition_variable filled, emptied;
+  bool stop = false;           // the caller gave up
+  size_t n_windows = SIZE_MAX; // once the reader is done
+  std::exception_ptr read_error;
+  double reader_wait_sum = 0;
+
+  std::thread reader([&]() {
+    for (size_t i = 0;; i++) {
+      size_t slot = i % n;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto start = std::chrono::steady_clock::now();
+        emptied.wait(lock, [&] { return stop || lengths[slot] == free_slot; });
+        reader_wait_sum += std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        if (stop) {
+          return;
+        }
+      }
+      uint8_t *b = buffers[slot];
+      size_t len = 0;
+      std::exception_ptr failed;
+      try {
+        len = source->read(b, window_len);
+      } catch (...) {
+        failed = std::current_exception();
+      }
+      // the last block is scanned in full
+      memset(b + len, 0, ROUNDUP_N(len, 64) - len);
+      std::lock_guard<std::mutex> lock(mutex);
+      read_error = failed;
+      if (failed || len < window_len) {
+        lengths[slot] = failed ? 0 : len;
+        n_windows = i + 1;
+        filled.notify_one();
+        return;
+      }
+      lengths[slot] = len;
+      filled.notify_one();
+    }
+  });
+
+  uint64_t total = 0;
+  double consumer_wait_sum = 0;
+  std::exception_ptr consume_error;
+  for (size_t i = 0;; i++) {
+    size_t slot = i % n;
+    size_t len;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      auto start = std::chrono::steady_clock::now();
+      filled.wait(lock, [&] { return lengths[slot] != free_slot || i >= n_windows; });
+      consumer_wait_sum += std::chrono::duration<double>(
+          std::chrono::steady_clock::now() - start).count();
+      if (i >= n_windows || read_error) {
+        break;
+      }
+      len = lengths[slot];
+    }
+    try {
+      if (len > 0) {
+        callback(buffers[slot], len);
+      }
+    } catch (...) {
+      consume_error = std::current_exception();
+    }
+    total += len;
+    std::lock_guard<std::mutex> lock(mutex);
+    lengths[slot] = free_slot;
+    if (consume_error) {
+      stop = true;
+    }
+    emptied.notify_one();
+    if (consume_error) {
+      break;
+    }
+  }
+  reader.join();
+  consumer_wait_time = consumer_wait_sum;
+  reader_wait_time = reader_wait_sum;
+  input_bytes = source->bytes_in();
+  garbage_bytes = source->trailing_garbage();
+  if (consume_error) {
+    std::rethrow_exception(consume_error);
+  }
+  if (read_error) {
+    std::rethrow_exception(read_error);
+  }
+  return total;
+}
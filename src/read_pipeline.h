@@ -0,0 +1,66 @@
+#ifndef SIMDCSV_READ_PIPELINE_H
+#define SIMDCSV_READ_PIPELINE_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Reads a file a window at a time on a thread of its own, so that the read
+// of the next windows overlaps the parse of the current one: a ring of
+// buffers (two, by default: double buffering) goes around between the
+// reader, which fills them with pread, and the caller, which is handed each
+// window in turn and gives the buffer back when its callback returns.
+//
+// The buffers come from allocate_padded_buffer: 64-byte aligned, with
+// CSV_PADDING readable bytes after the window. A window is a whole number of
+// 64-byte blocks, but for the last one, which is zeroed up to the next block
+// so that it can be scanned in full; see StreamParser::feed_window.
+//
+// A compressed file (gzip or zstd; see decompress.h) is decompressed by the
+// reader thread, so that decompression overlaps the parse just the same.
+//
+// (io_uring would save the thread, not the overlap; a blocking pread on a
+// thread works everywhere.)
+class ReadPipeline {
+public:
+  // the window is passed to the callback on the calling thread, which must
+  // not keep it past the call
+  typedef std::function<void(const uint8_t *window, size_t len)> Callback;
+
+  // the window size is rounded up to a multiple of 64 bytes
+  // throws an exception if the buffers cannot be allocated
+  explicit ReadPipeline(size_t window_size_in, size_t n_buffers = 2);
+  ~ReadPipeline();
+  ReadPipeline(const ReadPipeline &) = delete;
+  ReadPipeline &operator=(const ReadPipeline &) = delete;
+
+  // read filename to its end, a window at a time, calling callback for each
+  // in order. Returns the number of bytes read (decompressed). Throws an
+  // exception if the file cannot be opened, read or decompressed, and passes
+  // on those of the callback.
+  uint64_t run(const char *filename, const Callback &callback);
+
+  size_t window_size() const { return window_len; }
+
+  // of the last run, in seconds: how long the caller waited for the reader
+  // (the I/O not hidden behind the parse), and the reader for the caller
+  double consumer_wait() const { return consumer_wait_time; }
+  double reader_wait() const { return reader_wait_time; }
+
+  // of the last run: the bytes read from the file, compressed if it is
+  uint64_t bytes_in() const { return input_bytes; }
+
+  // of the last run: the bytes after the compressed data, left out (see
+  // ByteSource::trailing_garbage)
+  uint64_t trailing_garbage() const { return garbage_bytes; }
+
+private:
+  size_t window_len;
+  std::vector<uint8_t *> buffers;
+  double consumer_wait_time{0};
+  double reader_wait_time{0};
+  uint64_t input_bytes{0};
+  uint64_t garbage_bytes{0};
+};
+
+#endif
@@ -0,0 +1,86 @@
+#include "simd_kernels.h"
+
+#include <cstdlib>
+
+#if defined(__x86_64__)
+extern const Kernel avx512_kernel;
+extern const Kernel avx2_kernel;
+extern const Kernel sse42_kernel;
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+extern const Kernel neon_kernel;
+#endif
+extern const Kernel scalar_kernel;
+
+const std::vector<const Kernel *> &all_kernels() {
+  static const std::vector<const Kernel *> kernels = {
+#if defined(__x86_64__)
+    &avx512_kernel,
+    &avx2_kernel,
+    &sse42_kernel,
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    &neon_kernel,
+#endif
+    &scalar_kernel,
+  };
+  return kernels;
+}
+
+static const Kernel *find_kernel(const std::string &name) {
+  for (const Kernel *k : all_kernels()) {
+    if (name == k->name && k->supported()) {
+      return k;
+    }
+  }
+  return nullptr;
+}
+
+// the first supported kernel, unless SIMDCSV_KERNEL names another one
+static const Kernel *pick_kernel() {
+#if defined(__x86_64__)
+  __builtin_cpu_init(); // we may run before the constructor that does it
+#endif
+  const char *forced = std::getenv("SIMDCSV_KERNEL");
+  if (forced != nullptr) {
+    const Kernel *k = find_kernel(forced);
+    if (k != nullptr) {
+      return k;
+    }
+  }
+  for (const Kernel *k : all_kernels()) {
+    if (k->supported()) {
+      return k;
+    }
+  }
+  return &scalar_kernel;
+}
+
+const Kernel *active_kernel = pick_kernel();
+
+bool select_kernel(const std::string &name) {
+  const Kernel *k = find_kernel(name);
+  if (k == nullptr) {
+    return false;
+  }
+  active_kernel = k;
+  return true;
+}
+
+Flattener active_flattener = FLATTEN_UNROLLED;
+
+const char *flattener_name(Flattener f) {
+  static const char *names[] = {"unrolled", "branchless", "lut", "compress"};
+  return f < N_FLATTENERS ? names[f] : "unknown";
+}
+
+bool select_flattener(const std::string &name) {
+  for (unsigned f = 0; f < N_FLATTENERS; f++) {
+    if (name == flattener_name(Flattener(f)) &&
+        (active_kernel->flatteners & (1u << f))) {
+      active_flattener = Flattener(f);
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,154 @@
+#ifndef SIMDCSV_SIMD_KERNELS_H
+#define SIMDCSV_SIMD_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "common_defs.h"
+#include "dialect.h"
+#include "strict_check.h"
+
+// everything find_indexes carries from one 64-byte block to the next.
+// Resuming a scan part-way through a buffer (from another thread, or on the
+// next window of a stream) only requires reconstructing this.
+struct ParseState {
+  // does the previous iteration end inside a double-quote pair?
+  uint64_t prev_iter_inside_quote{0ULL};  // either all zeros or all ones
+  // does the previous iteration end with a CR? (only used for CR-LF dialects)
+  uint64_t prev_iter_cr_end{0ULL};
+  // the last three bytes of the previous iteration (see utf8.h), only kept
+  // up to date when validating UTF-8
+  uint32_t utf8_tail{0};
+  // only kept up to date in strict mode
+  StrictState strict;
+};
+
+// what the scanning functions of a Kernel check on the way, or'ed together
+const unsigned CHECK_UTF8 = 1 << 0;   // the input is UTF-8
+const unsigned CHECK_STRICT = 1 << 1; // the input is well-formed RFC 4180
+                                      // (see strict_check.h)
+
+// the character classes of Kernel::classify, for the sniffer; a byte is in
+// at most one of them
+enum CharClass {
+  CLASS_DIGIT,
+  CLASS_MINUS,
+  CLASS_PLUS,
+  CLASS_DOT,
+  CLASS_EXPONENT, // e or E
+  CLASS_SLASH,
+  CLASS_COLON,
+  CLASS_SPACE,
+  N_CHAR_CLASSES
+};
+
+// how the kernels turn the separator mask of a block into offsets; all give
+// the same offsets, and may write up to 15 entries past the last one
+enum Flattener {
+  FLATTEN_UNROLLED,   // a tzcnt/blsr chain unrolled 8 and 16 deep (flatten_bits)
+  FLATTEN_BRANCHLESS, // a byte at a time: 8 offsets from a 256-entry table
+  FLATTEN_LUT,        // likewise, the bytes widened to offsets in registers
+  FLATTEN_COMPRESS,   // AVX-512 vpcompressd/vpcompressq, 16 or 8 bits at a time
+  N_FLATTENERS
+};
+
+#ifdef SIMDCSV_INSTRUMENT
+// see Kernel::scan_stage
+enum ScanStage { SCAN_COMPARE, SCAN_SEPARATORS };
+#endif
+
+// The only instruction-set specific part of the parser: turning 64-byte
+// blocks into bitmasks. Each kernel is compiled for its own instruction set
+// (see SIMDCSV_TARGET_REGION) whatever the flags of the build, and the best
+// one the CPU supports is picked once, at startup. The decoding of the masks
+// (rows, projection...) is shared, except on the hot path of the plain index,
+// where scanning and flattening are interleaved within the kernel.
+struct Kernel {
+  const char *name;
+  const char *description;
+  bool (*supported)();
+
+  // Both scanning functions can check the input on the fly, on the very
+  // registers the blocks were loaded into. With CHECK_UTF8, they return
+  // false if the blocks were not valid UTF-8 (utf8_first_error tells where),
+  // leaving aside a sequence the last block leaves unfinished; they return
+  // true otherwise. With CHECK_STRICT, index_range32 and index_range64 leave
+  // the first structural error in state.strict; scan_blocks only does the
+  // quote checks, the field counts being left to its caller, which has the
+  // separators (strict_check_rows_ends, or strict_count_ends).
+
+  // for each of the n_blocks 64-byte blocks at buf + idx, the separators
+  // (unquoted delimiters and record ends) in seps[i] and the record ends
+  // alone in ends[i]
+  bool (*scan_blocks)(const uint8_t *buf, size_t idx, size_t n_blocks,
+                      const Dialect &dialect, ParseState &state,
+                      uint64_t *seps, uint64_t *ends, unsigned checks);
+
+  // find_indexes_range without rows, for either width of index: the blocks
+  // starting at buf + idx, buf + idx + 64, ... below end are scanned and
+  // their separators appended to base_ptr[base]
+  bool (*index_range32)(const uint8_t *buf, size_t idx, size_t end,
+                        const Dialect &dialect, ParseState &state,
+                        uint32_t *base_ptr, uint32_t &base, unsigned checks);
+  bool (*index_range64)(const uint8_t *buf, size_t idx, size_t end,
+                        const Dialect &dialect, ParseState &state,
+                        uint64_t *base_ptr, uint64_t &base, unsigned checks);
+
+  // the xor of the quote bits of the n_blocks 64-byte blocks at buf: its
+  // parity is the parity of the number of quotes
+  uint64_t (*quote_parity)(const uint8_t *buf, size_t n_blocks, uint8_t quote);
+
+  // the inside of a quoted field, src[0, len) without its enclosing quotes,
+  // with each doubled quote collapsed into one, to dst; returns the length
+  // written. dst needs room for len bytes, and may be src itself. Only the
+  // len bytes at src are read.
+  size_t (*unescape)(const uint8_t *src, size_t len, uint8_t quote,
+                     uint8_t *dst);
+
+  // for each of the n_blocks 64-byte blocks at buf, a mask of the bytes in
+  // each CharClass: that of class c of block b in masks[N_CHAR_CLASSES * b + c]
+  void (*classify)(const uint8_t *buf, size_t n_blocks, uint64_t *masks);
+
+  // the Flatteners it has (1 << f for each); the others fall back to
+  // FLATTEN_UNROLLED. index_range32 and index_range64 use active_flattener,
+  // when not checking the input.
+  unsigned flatteners;
+
+#ifdef SIMDCSV_INSTRUMENT
+  // the first stages of the scan alone, for the stage profile (see
+  // stage_profile.h): the n_blocks blocks at buf loaded and compared against
+  // the dialect's characters (SCAN_COMPARE), or their separators found as
+  // well, the quote mask included (SCAN_SEPARATORS). Returns a value that
+  // depends on all of the work, so that none of it is optimized away.
+  uint64_t (*scan_stage)(const uint8_t *buf, size_t n_blocks,
+                         const Dialect &dialect, ScanStage stage);
+  // the quote masks alone (the carry-less multiply, where there is one),
+  // from the quote bits of n_blocks blocks computed beforehand
+  uint64_t (*quote_mask_stage)(const uint64_t *quote_bits, size_t n_blocks);
+#endif
+};
+
+// in order of preference; those not compiled for this platform are left out
+const std::vector<const Kernel *> &all_kernels();
+
+// the kernel used by find_indexes and friends
+extern const Kernel *active_kernel;
+
+// force a kernel by name (for benchmarking); returns false, leaving the
+// active kernel alone, if there is no such kernel or the CPU lacks it
+bool select_kernel(const std::string &name);
+
+// the flattener of the kernels' plain index, FLATTEN_UNROLLED by default
+extern Flattener active_flattener;
+
+const char *flattener_name(Flattener f);
+
+// select a flattener by name (for benchmarking); returns false, leaving the
+// active flattener alone, if there is no such flattener or the active
+// kernel lacks it
+bool select_flattener(const std::string &name);
+
+#endif
@@ -0,0 +1,360 @@
+#ifndef SIMDCSV_SNIFFER_H
+#define SIMDCSV_SNIFFER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+#include "dialect.h"
+#include "find_indexes.h"
+#include "number_parsing.h"
+#include "typed_columns.h"
+#include "unescape.h"
+
+// Schema sniffing: the dialect, the header and the column types of an input
+// guessed from a sample of its first bytes, before it is parsed for real.
+//
+// The line ending is CR-LF when most of the record ends of the sample have
+// a CR before them. The sample is then indexed by the kernel once per
+// candidate delimiter, and the delimiter whose records most consistently
+// have the same number of fields (more than one) wins. The fields of that index are then typed from the
+// character classes of their bytes (see Kernel::classify): how many digits,
+// signs, dots, exponents, slashes, colons and spaces each has, and how many
+// other bytes, counted with popcounts over the class masks of the blocks.
+// Those counts alone tell most fields apart; the few that look numeric are
+// confirmed with the parsers of number_parsing.h, the dates and booleans
+// with a look at their bytes.
+//
+// A column's type is the narrowest that all of its non-empty fields in the
+// sample have: an integer column with a decimal becomes a float column, and
+// any other mix a string column. The first record is a header when it does
+// not fit the types the records after it give its columns.
+
+enum FieldType : uint8_t {
+  FIELD_EMPTY,    // no field seen, or only empty ones
+  FIELD_BOOL,     // true/false, yes/no, t/f, y/n, in any case
+  FIELD_INT,      // see parse_int64
+  FIELD_FLOAT,    // see parse_double
+  FIELD_DATE,     // YYYY-MM-DD, YYYY/MM/DD, MM/DD/YYYY
+  FIELD_DATETIME, // YYYY-MM-DD HH:MM:SS
+  FIELD_STRING,
+};
+
+inline const char *field_type_name(FieldType t) {
+  static const char *names[] = {"empty", "bool", "int", "float",
+                                "date", "datetime", "string"};
+  return names[t];
+}
+
+struct SniffedSchema {
+  Dialect dialect;
+  bool header{false};
+  size_t n_columns{0};
+  std::vector<FieldType> types; // one per column
+  size_t rows_sampled{0};       // header included
+  double consistency{0};        // the share of rows with n_columns fields
+};
+
+// the delimiters tried, in order of preference when they tie
+const uint8_t sniff_delimiters[] = {',', '\t', ';', '|'};
+
+const size_t default_sniff_size = 64 << 10;
+
+// the length of the sample: the first sample_size bytes of buf, cut after
+// their last line ending unless that would leave nothing
+inline size_t sniff_sample_length(const uint8_t *buf, size_t len,
+                                  size_t sample_size) {
+  if (len <= sample_size) {
+    return len;
+  }
+  size_t n = sample_size;
+  while (n > 0 && buf[n - 1] != '\n') {
+    n--;
+  }
+  return n == 0 ? sample_size : n;
+}
+
+// the number of bytes of each class in buf[start, end), from masks (see
+// Kernel::classify)
+really_inline void count_classes(const uint64_t *masks, size_t start,
+                                 size_t end, uint32_t counts[N_CHAR_CLASSES]) {
+  std::fill(counts, counts + N_CHAR_CLASSES, 0);
+  for (size_t b = start / 64; b * 64 < end; b++) {
+    uint64_t range = UINT64_MAX;
+    if (b == start / 64) {
+      range &= UINT64_MAX << (start % 64);
+    }
+    if ((b + 1) * 64 > end) {
+      range &= UINT64_MAX >> (64 - end % 64);
+    }
+    const uint64_t *m = masks + N_CHAR_CLASSES * b;
+    for (int c = 0; c < N_CHAR_CLASSES; c++) {
+      counts[c] += hamming(m[c] & range);
+    }
+  }
+}
+
+really_inline bool is_digit(uint8_t c) { return static_cast<uint8_t>(c - '0') < 10; }
+
+// are the bytes of p at each of the positions separators, and digits elsewhere?
+really_inline bool digits_around(const uint8_t *p, size_t len,
+                                 std::initializer_list<size_t> positions) {
+  size_t n = 0;
+  for (size_t pos : positions) {
+    for (; n < pos; n++) {
+      if (!is_digit(p[n])) {
+        return false;
+      }
+    }
+    n++;
+  }
+  for (; n < len; n++) {
+    if (!is_digit(p[n])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline bool is_bool_token(const uint8_t *p, size_t len) {
+  static const char *tokens[] = {"true", "false", "yes", "no", "t", "f", "y", "n"};
+  for (const char *t : tokens) {
+    if (strlen(t) != len) {
+      continue;
+    }
+    size_t i = 0;
+    while (i < len && (p[i] | 0x20) == t[i]) {
+      i++;
+    }
+    if (i == len) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// the type of field buf[start, end), its quotes already taken off
+really_inline FieldType sniff_field(const uint8_t *buf, size_t start,
+                                    size_t end, const uint64_t *masks) {
+  size_t len = end - start;
+  if (len == 0) {
+    return FIELD_EMPTY;
+  }
+  const uint8_t *p = buf + start;
+  uint32_t n[N_CHAR_CLASSES];
+  count_classes(masks, start, end, n);
+  size_t classified = 0;
+  for (int c = 0; c < N_CHAR_CLASSES; c++) {
+    classified += n[c];
+  }
+  size_t other = len - classified;
+  if (n[CLASS_DIGIT] == 0) {
+    // only letters, if anything, can make a boolean
+    return other + n[CLASS_EXPONENT] == len && len <= 5 && is_bool_token(p, len)
+               ? FIELD_BOOL
+               : FIELD_STRING;
+  }
+  if (other != 0) {
+    return FIELD_STRING;
+  }
+  if (n[CLASS_DIGIT] + n[CLASS_MINUS] + n[CLASS_PLUS] == len) {
+    int64_t i;
+    double d;
+    if (parse_int64(p, buf + end, i)) {
+      return FIELD_INT;
+    }
+    // too many digits for an int64_t
+    if (n[CLASS_MINUS] + n[CLASS_PLUS] <= 1 && parse_double(p, buf + end, d)) {
+      return FIELD_FLOAT;
+    }
+  }
+  if (len == 10 && n[CLASS_DIGIT] == 8) {
+    if ((n[CLASS_MINUS] == 2 || n[CLASS_SLASH] == 2) && p[4] == p[7] &&
+        digits_around(p, len, {4, 7})) {
+      return FIELD_DATE;
+    }
+    if (n[CLASS_SLASH] == 2 && p[2] == '/' && p[5] == '/' &&
+        digits_around(p, len, {2, 5})) {
+      return FIELD_DATE;
+    }
+  }
+  if (len == 19 && n[CLASS_DIGIT] == 14 && n[CLASS_MINUS] == 2 &&
+      n[CLASS_COLON] == 2 && n[CLASS_SPACE] == 1 && p[4] == '-' &&
+      p[7] == '-' && p[10] == ' ' && p[13] == ':' && p[16] == ':' &&
+      digits_around(p, len, {4, 7, 10, 13, 16})) {
+    return FIELD_DATETIME;
+  }
+  double d;
+  if (n[CLASS_SLASH] + n[CLASS_COLON] + n[CLASS_SPACE] == 0 &&
+      parse_double(p, buf + end, d)) {
+    return FIELD_FLOAT;
+  }
+  return FIELD_STRING;
+}
+
+// the narrowest type of both a and b
+really_inline FieldType merge_types(FieldType a, FieldType b) {
+  if (a == b || b == FIELD_EMPTY) {
+    return a;
+  }
+  if (a == FIELD_EMPTY) {
+    return b;
+  }
+  if ((a == FIELD_INT && b == FIELD_FLOAT) || (a == FIELD_FLOAT && b == FIELD_INT)) {
+    return FIELD_FLOAT;
+  }
+  return FIELD_STRING;
+}
+
+// the number of fields most rows of pcsv have, and how many have it
+inline size_t modal_width(const ParsedCSV &pcsv, size_t &n_modal) {
+  std::vector<size_t> widths(pcsv.n_rows);
+  for (uint32_t r = 0; r < pcsv.n_rows; r++) {
+    widths[r] = pcsv.row_fields(r);
+  }
+  std::sort(widths.begin(), widths.end());
+  size_t width = 0;
+  n_modal = 0;
+  for (size_t i = 0; i < widths.size();) {
+    size_t j = i;
+    while (j < widths.size() && widths[j] == widths[i]) {
+      j++;
+    }
+    if (j - i > n_modal) {
+      n_modal = j - i;
+      width = widths[i];
+    }
+    i = j;
+  }
+  return width;
+}
+
+// sniff the first sample_size bytes of the len bytes of data at buf, len
+// leaving out the CSV_PADDING bytes of padding that must follow them. Only
+// the records that end within the sample count (a last record without a
+// line ending does, if the sample is all of the data); with none, the
+// schema has no columns and the default dialect. Throws an exception if it cannot
+// allocate memory.
+inline SniffedSchema sniff_schema(const uint8_t *buf, size_t len,
+                                  size_t sample_size = default_sniff_size) {
+  SniffedSchema schema;
+  size_t n = sniff_sample_length(buf, len, sample_size);
+  // the blocks of the sample are all indexed (see find_indexes): those past
+  // it are either more of buf or its padding
+  std::vector<uint32_t> indexes(n + 64);
+  std::vector<uint32_t> row_offsets(n + 65);
+  ParsedCSV pcsv;
+  pcsv.indexes = indexes.data();
+  pcsv.row_offsets = row_offsets.data();
+  // CR-LF if most of the record ends within the sample have a CR before
+  // them: the record ends do not depend on the delimiter or line ending
+  find_indexes(buf, n + 64, pcsv, schema.dialect);
+  size_t n_ends = 0, n_crlf = 0;
+  for (uint32_t r = 0; r < pcsv.n_rows; r++) {
+    uint32_t k = pcsv.row_offsets[r + 1] - 1;
+    if (k < pcsv.n_indexes && pcsv.indexes[k] < n) {
+      uint32_t end = pcsv.indexes[k];
+      n_ends++;
+      n_crlf += end > 0 && buf[end - 1] == '\r';
+    }
+  }
+  schema.dialect.crlf = 2 * n_crlf > n_ends;
+  // the rows ending past the sample are left out, as is the last one if the
+  // sample cuts it short; a sample of all of the data cuts nothing short
+  auto complete_rows = [&]() {
+    if (n == len) {
+      return;
+    }
+    uint32_t rows = pcsv.n_rows;
+    while (rows > 0 && pcsv.indexes[pcsv.row_offsets[rows] - 1] >= n) {
+      rows--;
+    }
+    pcsv.n_rows = rows;
+  };
+  double best_consistency = 0;
+  size_t best_width = 0;
+  Dialect d = schema.dialect;
+  for (uint8_t delimiter : sniff_delimiters) {
+    d.delimiter = delimiter;
+    find_indexes(buf, n + 64, pcsv, d);
+    complete_rows();
+    if (pcsv.n_rows == 0) {
+      continue;
+    }
+    size_t n_modal;
+    size_t width = modal_width(pcsv, n_modal);
+    double consistency = static_cast<double>(n_modal) / pcsv.n_rows;
+    if (width > 1 && (consistency > best_consistency ||
+                      (consistency == best_consistency && width > best_width))) {
+      best_consistency = consistency;
+      best_width = width;
+      schema.dialect.delimiter = delimiter;
+    }
+  }
+  find_indexes(buf, n + 64, pcsv, schema.dialect);
+  complete_rows();
+  if (pcsv.n_rows == 0) {
+    return schema;
+  }
+  size_t n_modal;
+  schema.rows_sampled = pcsv.n_rows;
+  schema.n_columns = modal_width(pcsv, n_modal);
+  schema.consistency = static_cast<double>(n_modal) / pcsv.n_rows;
+
+  size_t n_blocks = ROUNDUP_N(n, 64) / 64;
+  std::vector<uint64_t> masks(N_CHAR_CLASSES * n_blocks);
+  active_kernel->classify(buf, n_blocks, masks.data());
+  // the first row apart, for the header
+  std::vector<FieldType> first(schema.n_columns, FIELD_EMPTY);
+  schema.types.assign(schema.n_columns, FIELD_EMPTY);
+  for (uint32_t r = 0; r < pcsv.n_rows; r++) {
+    uint32_t n_fields = std::min<uint32_t>(pcsv.row_fields(r), schema.n_columns);
+    for (uint32_t m = 0; m < n_fields; m++) {
+      uint32_t start, end;
+      pcsv.field(r, m, start, end);
+      size_t s = start, e = end;
+      quoted_field_inside(buf, s, e, schema.dialect.quote);
+      FieldType t = sniff_field(buf, s, e, masks.data());
+      if (r == 0) {
+        first[m] = t;
+      } else {
+        schema.types[m] = merge_types(schema.types[m], t);
+      }
+    }
+  }
+  // each typed column votes: for a header if its first field does not fit
+  // its type, against if it does
+  int votes = 0;
+  for (size_t m = 0; m < schema.n_columns; m++) {
+    FieldType t = schema.types[m];
+    if (t == FIELD_EMPTY || t == FIELD_STRING || first[m] == FIELD_EMPTY) {
+      continue;
+    }
+    votes += merge_types(t, first[m]) == t ? -1 : 1;
+  }
+  schema.header = votes > 0;
+  if (!schema.header) {
+    for (size_t m = 0; m < schema.n_columns; m++) {
+      schema.types[m] = merge_types(schema.types[m], first[m]);
+    }
+  }
+  return schema;
+}
+
+// the numeric columns of a sniffed schema, for decode_columns (with the
+// header, if any, left out: first_row = schema.header)
+inline std::vector<ColumnSpec> numeric_columns(const SniffedSchema &schema) {
+  std::vector<ColumnSpec> specs;
+  for (size_t m = 0; m < schema.types.size(); m++) {
+    if (schema.types[m] == FIELD_INT) {
+      specs.push_back({m, COLUMN_INT64});
+    } else if (schema.types[m] == FIELD_FLOAT) {
+      specs.push_back({m, COLUMN_DOUBLE});
+    }
+  }
+  return specs;
+}
+
+#endif
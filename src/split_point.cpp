@@ -0,0 +1,167 @@
+#include "split_point.h"
+
+#include <algorithm>
+
+#include "common_defs.h"
+#include "portability.h"
+#include "simd_kernels.h"
+
+const char *split_confidence_name(SplitConfidence c) {
+  switch (c) {
+  case SPLIT_NONE:
+    return "none";
+  case SPLIT_MALFORMED:
+    return "malformed";
+  case SPLIT_ASSUMED:
+    return "assumed";
+  case SPLIT_PROVEN:
+    return "proven";
+  case SPLIT_EXACT:
+    return "exact";
+  }
+  return "unknown";
+}
+
+namespace {
+
+// one of the two readings of the window
+struct Reading {
+  ParseState state;
+  uint64_t split{UINT64_MAX}; // the first record start at or after offset
+
+  bool failed() const { return state.strict.error.code != CSV_OK; }
+  bool found() const { return split != UINT64_MAX; }
+};
+
+} // namespace
+
+SplitPoint find_split_point(const uint8_t *buf, size_t len, size_t offset,
+                            const Dialect &dialect, size_t lookback,
+                            size_t lookahead) {
+  size_t lenminus64 = len < 64 ? 0 : len - 64;
+  SplitPoint sp;
+  offset = std::min(offset, lenminus64);
+  if (offset == 0) {
+    sp.confidence = SPLIT_EXACT;
+    return sp;
+  }
+  // at least the byte before offset, which may be a record end;
+  // strict_chunk_start looks two bytes back
+  size_t start = offset > lookback ? offset - lookback : 0;
+  start = std::min(start, offset - 1);
+  if (start < 2) {
+    start = 0;
+  }
+  size_t end = lenminus64 - offset > lookahead ? offset + lookahead : lenminus64;
+  // from the start of the input, there is only the one reading
+  size_t n_readings = start == 0 ? 1 : 2;
+  unsigned checks = start == 0 ? 0 : CHECK_STRICT;
+  Reading readings[2];
+  for (size_t h = 0; h < n_readings; h++) {
+    ParseState &state = readings[h].state;
+    state.prev_iter_inside_quote = h == 1 ? ~0ULL : 0ULL;
+    state.prev_iter_cr_end = dialect.crlf && start > 0 && buf[start - 1] == 0x0d;
+    state.strict.limit = lenminus64;
+    if (start > 0) {
+      strict_chunk_start(state.strict, buf, start, h == 1, dialect);
+    }
+  }
+  Reading &outside = readings[0];
+  Reading &inside = readings[1];
+
+  const size_t batch = 64;
+  uint64_t seps[batch];
+  uint64_t ends[batch];
+  // a record end at offset - 1 or after starts a record at offset or after
+  size_t first_end = offset - 1;
+  size_t idx = start;
+  for (; idx < end; idx += 64 * batch) {
+    size_t n_blocks = std::min(batch, (end - idx + 63) / 64);
+    for (size_t h = 0; h < n_readings; h++) {
+      Reading &r = readings[h];
+      if (r.failed()) {
+        continue;
+      }
+      active_kernel->scan_blocks(buf, idx, n_blocks, dialect, r.state, seps,
+                                 ends, checks);
+      if (checks != 0) {
+        strict_count_ends(r.state.strict, idx, n_blocks, seps, ends);
+      }
+      for (size_t b = 0; b < n_blocks && !r.found(); b++) {
+        size_t pos = idx + 64 * b;
+        uint64_t e = ends[b];
+        if (pos + 64 <= first_end) {
+          continue;
+        }
+        if (pos < first_end) {
+          e &= ~0ULL << (first_end - pos);
+        }
+        if (e != 0) {
+          r.split = pos + trailingzeroes(e) + 1;
+        }
+      }
+    }
+    // enough to decide?
+    if (n_readings == 1) {
+      if (outside.found()) {
+        break;
+      }
+    } else if (outside.failed() && inside.failed()) {
+      break;
+    } else if ((outside.failed() && inside.found()) ||
+               (inside.failed() && outside.found())) {
+      break;
+    }
+  }
+  if (idx >= end && end == lenminus64) {
+    // the whole input after start was read by the readings still standing:
+    // the end of the data is a record start, and no quoted field may be
+    // left open there
+    for (size_t h = 0; h < n_readings; h++) {
+      Reading &r = readings[h];
+      if (r.failed()) {
+        continue;
+      }
+      if (checks != 0) {
+        strict_finish(r.state.strict, lenminus64,
+                      r.state.prev_iter_inside_quote != 0);
+      }
+      if (!r.found()) {
+        r.split = lenminus64;
+      }
+    }
+  }
+
+  if (n_readings == 1) {
+    sp.offset = outside.split;
+    sp.confidence = outside.found() ? SPLIT_EXACT : SPLIT_NONE;
+    return sp;
+  }
+  const Reading *kept = &outside;
+  const Reading *other = &inside;
+  if (outside.failed() && inside.failed()) {
+    sp.confidence = SPLIT_MALFORMED;
+    if (inside.state.strict.error.offset > outside.state.strict.error.offset) {
+      std::swap(kept, other);
+    }
+  } else if (outside.failed() || inside.failed()) {
+    sp.confidence = SPLIT_PROVEN;
+    if (outside.failed()) {
+      std::swap(kept, other);
+    }
+  } else {
+    sp.confidence = SPLIT_ASSUMED;
+  }
+  // a record start both readings agree on (the end of the data: a line
+  // ending is a record end in one reading or the other, never both) holds
+  // whatever the quotes before
+  if (outside.found() && outside.split == inside.split) {
+    sp.confidence = SPLIT_EXACT;
+  }
+  sp.offset = kept->split;
+  sp.contradiction = other->state.strict.error;
+  if (!kept->found()) {
+    sp.confidence = SPLIT_NONE;
+  }
+  return sp;
+}
@@ -0,0 +1,57 @@
+#ifndef SIMDCSV_SPLIT_POINT_H
+#define SIMDCSV_SPLIT_POINT_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "dialect.h"
+#include "strict_check.h"
+
+// Split points, for parsing a file by byte ranges on workers that do not
+// read it from the start: the first record start at or after an offset.
+// Whether a line ending ends a record depends on the quotes before it, all
+// the way back to the start of the input, which a worker does not see (the
+// parallel indexer reads it all for that, see parallel_indexer.h).
+//
+// Instead, the bytes around the offset are scanned twice, from a point some
+// way before it: once as if that point were outside a quoted field, once as
+// if it were inside one. The two readings have their quote masks the other
+// way round, and so their record ends too. In well-formed input (see
+// strict_check.h), the wrong reading soon runs into a structural error: a
+// quote within an unquoted field, or text after a closing quote, typically
+// within the first quoted field it meets. That error is the proof the split
+// point is right, short of the input being malformed there.
+//
+// Each worker then parses [split(start), split(end)) on its own, with
+// find_indexes_unpadded, the last one up to the end of the input.
+
+// how sure a split point is, from least to most
+enum SplitConfidence : uint8_t {
+  SPLIT_NONE,      // no record starts within the look-ahead
+  SPLIT_MALFORMED, // both readings run into an error: the later one is kept
+  SPLIT_ASSUMED,   // neither does: taken to start outside a quoted field
+  SPLIT_PROVEN,    // the other reading runs into 'contradiction'
+  SPLIT_EXACT,     // the look-back reaches the start of the input
+};
+
+const char *split_confidence_name(SplitConfidence c);
+
+struct SplitPoint {
+  uint64_t offset{0}; // the record start found, if any
+  SplitConfidence confidence{SPLIT_NONE};
+  // the first error of the reading that was not kept (SPLIT_PROVEN and
+  // SPLIT_MALFORMED)
+  StructureError contradiction;
+};
+
+// the first record start at or after offset in buf, len counting the
+// padding as for find_indexes: the bytes from offset - lookback up to
+// offset + lookahead are scanned, at most. A record start is 0 or the byte
+// after a record end; the end of the data is one, if it follows a record
+// end. The dialect must be valid (see valid_dialect).
+SplitPoint find_split_point(const uint8_t *buf, size_t len, size_t offset,
+                            const Dialect &dialect = Dialect(),
+                            size_t lookback = 64 * 1024,
+                            size_t lookahead = 64 * 1024);
+
+#endif
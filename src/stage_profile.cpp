@@ -0,0 +1,207 @@
+#include "stage_profile.h"
+
+#if defined(SIMDCSV_INSTRUMENT) && defined(__linux__)
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "csv_defs.h"
+#include "find_indexes.h"
+#include "io_util.h"
+#include "mem_util.h"
+#include "simd_kernels.h"
+
+const char *stage_name(ProfileStage stage) {
+  static const char *names[] = {"io", "load_compare", "quote_mask",
+                                "separators", "flatten"};
+  return stage < N_STAGES ? names[stage] : "unknown";
+}
+
+namespace {
+
+// the passes, each timed as a phase of its own
+enum Pass {
+  PASS_IO,
+  PASS_COMPARE,
+  PASS_QUOTE_MASK,
+  PASS_SEPARATORS,
+  PASS_INDEX,
+  N_PASSES
+};
+
+// what each stage is charged: weights[stage][pass] times each pass
+const int weights[N_STAGES][N_PASSES] = {
+    {1, 0, 0, 0, 0},   // io
+    {0, 1, 0, 0, 0},   // load_compare
+    {0, 0, 1, 0, 0},   // quote_mask
+    {0, -1, -1, 1, 0}, // separators
+    {0, 0, 0, -1, 1},  // flatten
+};
+
+// the sum of the values of each iteration, and its standard deviation
+// given how much they vary
+template <typename T>
+void sum_and_noise(const std::vector<double> &values, T &sum, double &noise) {
+  double total = 0;
+  for (double v : values) {
+    total += v;
+  }
+  size_t n = values.size();
+  double square = 0;
+  for (double v : values) {
+    square += (v - total / n) * (v - total / n);
+  }
+  sum = static_cast<T>(total);
+  noise = n < 2 ? 0 : std::sqrt(square / (n - 1) * n);
+}
+
+} // namespace
+
+StageProfile profile_stages(const char *filename, const Dialect &dialect,
+                            const std::vector<PerfEvent> &events,
+                            size_t iterations) {
+  TimingAccumulator ta(N_PASSES, events);
+  iterations = std::max<size_t>(iterations, 1);
+  // of each pass, in each iteration
+  std::vector<std::vector<double>> pass_seconds(N_PASSES);
+  std::vector<std::vector<std::vector<double>>> pass_counts(
+      N_PASSES, std::vector<std::vector<double>>(ta.num_events));
+  auto timed = [&](int pass, auto f) {
+    std::vector<uint64_t> before(ta.num_events);
+    for (int e = 0; e < ta.num_events; e++) {
+      before[e] = ta.count(pass, e);
+    }
+    auto start = std::chrono::steady_clock::now();
+    {
+      TimingPhase phase(ta, pass);
+      f();
+    }
+    pass_seconds[pass].push_back(std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count());
+    for (int e = 0; e < ta.num_events; e++) {
+      pass_counts[pass][e].push_back(double(ta.count(pass, e) - before[e]));
+    }
+  };
+  std::basic_string_view<uint8_t> p = get_corpus(filename, CSV_PADDING);
+  size_t len = p.size() - CSV_PADDING;
+  size_t n_blocks = (len + 63) / 64;
+  uint32_t *indexes = new uint32_t[p.size()];
+  // the quote bits of each block, for the quote mask on its own
+  uint64_t *quote_bits = new uint64_t[n_blocks];
+  for (size_t b = 0; b < n_blocks; b++) {
+    uint64_t bits = 0;
+    for (size_t i = 0; i < 64; i++) {
+      bits |= uint64_t(p[64 * b + i] == dialect.quote) << i;
+    }
+    quote_bits[b] = bits;
+  }
+  volatile uint64_t sink = 0;
+  try {
+    for (size_t i = 0; i < iterations; i++) {
+      timed(PASS_IO, [&]() {
+        // p stays the old copy until the new one is there, so that it is
+        // freed exactly once if the read throws
+        std::basic_string_view<uint8_t> fresh = get_corpus(filename, CSV_PADDING);
+        aligned_free((void *)p.data());
+        p = fresh;
+      });
+      timed(PASS_COMPARE, [&]() {
+        sink = sink + active_kernel->scan_stage(p.data(), n_blocks, dialect, SCAN_COMPARE);
+      });
+      timed(PASS_QUOTE_MASK, [&]() {
+        sink = sink + active_kernel->quote_mask_stage(quote_bits, n_blocks);
+      });
+      timed(PASS_SEPARATORS, [&]() {
+        sink = sink + active_kernel->scan_stage(p.data(), n_blocks, dialect, SCAN_SEPARATORS);
+      });
+      timed(PASS_INDEX, [&]() {
+        ParsedCSV pcsv;
+        pcsv.indexes = indexes;
+        find_indexes(p.data(), p.size(), pcsv, dialect);
+      });
+    }
+  } catch (...) {
+    delete[] quote_bits;
+    delete[] indexes;
+    aligned_free((void *)p.data());
+    throw;
+  }
+  delete[] quote_bits;
+  delete[] indexes;
+  aligned_free((void *)p.data());
+
+  StageProfile profile;
+  profile.kernel = active_kernel->name;
+  profile.bytes = len;
+  profile.iterations = iterations;
+  profile.events = ta.event_names;
+  profile.counted = ta.working;
+  profile.counts.resize(N_STAGES);
+  profile.count_noise.resize(N_STAGES);
+  profile.seconds.resize(N_STAGES);
+  profile.seconds_noise.resize(N_STAGES);
+  // the value of a stage in each iteration, from those of the passes
+  auto charged = [&](int s, auto pass_value) {
+    std::vector<double> values(iterations, 0);
+    for (size_t i = 0; i < iterations; i++) {
+      for (int q = 0; q < N_PASSES; q++) {
+        values[i] += weights[s][q] * pass_value(q, i);
+      }
+    }
+    return values;
+  };
+  for (int s = 0; s < N_STAGES; s++) {
+    for (int e = 0; e < ta.num_events; e++) {
+      std::vector<double> values = charged(
+          s, [&](int q, size_t i) { return pass_counts[q][e][i]; });
+      profile.counts[s].emplace_back();
+      profile.count_noise[s].emplace_back();
+      sum_and_noise(values, profile.counts[s].back(), profile.count_noise[s].back());
+    }
+    std::vector<double> values =
+        charged(s, [&](int q, size_t i) { return pass_seconds[q][i]; });
+    sum_and_noise(values, profile.seconds[s], profile.seconds_noise[s]);
+  }
+  return profile;
+}
+
+void write_profile_json(std::ostream &out, const StageProfile &profile) {
+  double volume = double(profile.bytes) * profile.iterations;
+  out << "{\n  \"kernel\": \"" << profile.kernel << "\",\n  \"bytes\": "
+      << profile.bytes << ",\n  \"iterations\": " << profile.iterations
+      << ",\n  \"perf_events\": " << (profile.counted ? "true" : "false")
+      << ",\n  \"stages\": [";
+  for (int s = 0; s < N_STAGES; s++) {
+    out << (s == 0 ? "\n" : ",\n") << "    {\"stage\": \""
+        << stage_name(ProfileStage(s)) << "\", \"seconds\": " << profile.seconds[s]
+        << ", \"seconds_noise\": " << profile.seconds_noise[s] << ", \"events\": {";
+    for (size_t e = 0; e < profile.events.size() && profile.counted; e++) {
+      out << (e == 0 ? "" : ", ") << "\"" << profile.events[e]
+          << "\": {\"count\": " << profile.counts[s][e]
+          << ", \"per_byte\": " << profile.counts[s][e] / volume
+          << ", \"noise\": " << profile.count_noise[s][e] << "}";
+    }
+    out << "}}";
+  }
+  out << "\n  ]\n}" << std::endl;
+}
+
+void write_profile_csv(std::ostream &out, const StageProfile &profile) {
+  double volume = double(profile.bytes) * profile.iterations;
+  out << "kernel,stage,event,count,per_byte,noise\n";
+  for (int s = 0; s < N_STAGES; s++) {
+    const char *stage = stage_name(ProfileStage(s));
+    out << profile.kernel << "," << stage << ",seconds," << profile.seconds[s]
+        << "," << profile.seconds[s] / volume << ","
+        << profile.seconds_noise[s] << "\n";
+    for (size_t e = 0; e < profile.events.size() && profile.counted; e++) {
+      out << profile.kernel << "," << stage << "," << profile.events[e] << ","
+          << profile.counts[s][e] << "," << profile.counts[s][e] / volume << ","
+          << profile.count_noise[s][e] << "\n";
+    }
+  }
+  out.flush();
+}
+
+#endif // SIMDCSV_INSTRUMENT && __linux__
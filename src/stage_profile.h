@@ -0,0 +1,68 @@
+#ifndef SIMDCSV_STAGE_PROFILE_H
+#define SIMDCSV_STAGE_PROFILE_H
+
+// Where the cycles of indexing go, stage by stage; only built with
+// SIMDCSV_INSTRUMENT (cmake -DSIMDCSV_INSTRUMENT=ON), on Linux.
+//
+// Reading the counters block by block would cost more than the blocks, so
+// each stage is measured over the whole input, in passes of its own: reading
+// the file (I/O), loading the blocks and comparing them against the dialect's
+// characters, the quote mask (the carry-less multiply alone, over quote bits
+// found beforehand), finding the separators, and the full index. The first
+// three stand alone; the separators are charged their pass less the two
+// before, and flattening the full index less the separators pass. These
+// differences are signed: a stage that costs less than the noise between
+// passes may come out below zero. Each figure comes with its noise, the
+// spread of its value from one iteration to the next (the standard deviation
+// of the sum over the iterations). The real loop overlaps the stages more
+// than the passes can, so the shares are an estimate; those of the stages
+// after the I/O add up to the cost of the full index.
+#if defined(SIMDCSV_INSTRUMENT) && defined(__linux__)
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "common_defs.h"
+#include "dialect.h"
+#include "timing.h"
+
+enum ProfileStage {
+  STAGE_IO,
+  STAGE_LOAD_COMPARE,
+  STAGE_QUOTE_MASK,
+  STAGE_SEPARATORS,
+  STAGE_FLATTEN,
+  N_STAGES
+};
+
+const char *stage_name(ProfileStage stage);
+
+struct StageProfile {
+  std::string kernel;
+  uint64_t bytes{0}; // of the input, read and indexed 'iterations' times
+  size_t iterations{0};
+  std::vector<std::string> events;
+  bool counted{false}; // false if the events could not be opened
+  // summed over the iterations, for each stage: the count of each event
+  // (counts[stage][event]) and the seconds, with their noise
+  std::vector<std::vector<int64_t>> counts;
+  std::vector<std::vector<double>> count_noise;
+  std::vector<double> seconds;
+  std::vector<double> seconds_noise;
+};
+
+// profile the indexing of filename with the active kernel
+// throws an exception if the file cannot be read
+StageProfile profile_stages(const char *filename, const Dialect &dialect,
+                            const std::vector<PerfEvent> &events,
+                            size_t iterations);
+
+// one object, or one line per stage and event (and one for the seconds)
+void write_profile_json(std::ostream &out, const StageProfile &profile);
+void write_profile_csv(std::ostream &out, const StageProfile &profile);
+
+#endif // SIMDCSV_INSTRUMENT && __linux__
+
+#endif
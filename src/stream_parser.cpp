@@ -0,0 +1,164 @@
+#include "stream_parser.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "csv_defs.h"
+#include "io_util.h"
+#include "mem_util.h"
+#include "utf8.h"
+
+StreamParser::StreamParser(size_t window_size_in, Callback callback_in,
+                           const Dialect &dialect_in, unsigned checks_in,
+                           bool record_ends_in)
+    : window_len(ROUNDUP_N(window_size_in == 0 ? 64 : window_size_in, 64)),
+      callback(callback_in), dialect(dialect_in),
+      checks(checks_in), window(nullptr), indexes(nullptr) {
+  if (!valid_dialect(dialect)) {
+    throw std::runtime_error("invalid dialect");
+  }
+  if (window_len > std::numeric_limits<uint32_t>::max()) {
+    throw std::runtime_error("window too large for 32-bit offsets");
+  }
+  window = allocate_padded_buffer(window_len, CSV_PADDING);
+  // flatten_bits may write up to 15 entries past the last real one
+  indexes = static_cast<uint32_t *>(
+      aligned_malloc(64, (window_len + 64) * sizeof(uint32_t)));
+  if (record_ends_in) {
+    // a row per separator at most
+    rows = static_cast<uint32_t *>(
+        aligned_malloc(64, (window_len + 64) * sizeof(uint32_t)));
+    end_bits = static_cast<uint64_t *>(
+        aligned_malloc(64, (window_len / 64 + 1) * sizeof(uint64_t)));
+  }
+  if (window == nullptr || indexes == nullptr ||
+      (record_ends_in && (rows == nullptr || end_bits == nullptr))) {
+    aligned_free(window);
+    aligned_free(indexes);
+    aligned_free(rows);
+    aligned_free(end_bits);
+    throw std::runtime_error("could not allocate memory");
+  }
+}
+
+StreamParser::~StreamParser() {
+  aligned_free(window);
+  aligned_free(indexes);
+  aligned_free(rows);
+  aligned_free(end_bits);
+}
+
+void StreamParser::flush_window(const uint8_t *data, size_t len) {
+  uint32_t base = 0;
+  if (stream_offset == 0) {
+    // a new stream
+    utf8_error_offset = UINT64_MAX;
+    structure_error = StructureError();
+  }
+  // no need to look any further once an error is found
+  unsigned window_checks = checks;
+  if (utf8_error_offset != UINT64_MAX) {
+    window_checks &= ~CHECK_UTF8;
+  }
+  uint32_t tail = state.utf8_tail;
+  state.strict.base = stream_offset;
+  state.strict.limit = len;
+  bool valid;
+  if (rows == nullptr) {
+    valid = find_indexes_range(data, 0, len, dialect, state, indexes, base,
+                               window_checks);
+  } else {
+    // each row offset is one past the separator that ends the row
+    uint32_t n_rows = 0;
+    valid = find_indexes_range<uint32_t, true>(data, 0, len, dialect, state,
+                                               indexes, base, rows, n_rows,
+                                               window_checks);
+    memset(end_bits, 0, (base / 64 + 1) * sizeof(uint64_t));
+    for (uint32_t r = 0; r < n_rows; r++) {
+      end_bits[(rows[r] - 1) / 64] |= 1ULL << ((rows[r] - 1) % 64);
+    }
+  }
+  if (!valid) {
+    // the error may start in the tail, before the window
+    int64_t e = utf8_first_error(data, ROUNDUP_N(len, 64), tail);
+    utf8_error_offset = stream_offset + e;
+  }
+  structure_error = state.strict.error;
+  IndexBatch batch;
+  batch.base = stream_offset;
+  batch.indexes = indexes;
+  batch.n_indexes = base;
+  batch.record_ends = end_bits;
+  callback(batch);
+  stream_offset += len;
+  fill = 0;
+}
+
+void StreamParser::feed(const uint8_t *data, size_t len) {
+  while (len > 0) {
+    size_t n = std::min(len, window_len - fill);
+    memcpy(window + fill, data, n);
+    fill += n;
+    data += n;
+    len -= n;
+    if (fill == window_len) {
+      flush_window(window, window_len);
+    }
+  }
+}
+
+void StreamParser::feed_window(const uint8_t *data, size_t len) {
+  if (fill != 0 || len > window_len) {
+    throw std::runtime_error("feed_window needs an empty window");
+  }
+  if (len > 0) {
+    flush_window(data, len);
+  }
+}
+
+size_t StreamParser::feed_file(std::FILE *fp) {
+  size_t total = 0;
+  while (true) {
+    size_t readb = std::fread(window + fill, 1, window_len - fill, fp);
+    fill += readb;
+    total += readb;
+    if (fill == window_len) {
+      flush_window(window, window_len);
+    } else if (readb == 0) {
+      break;
+    }
+  }
+  if (std::ferror(fp)) {
+    throw std::runtime_error("could not read the data");
+  }
+  return total;
+}
+
+void StreamParser::finish() {
+  if (fill > 0) {
+    // the last block is scanned in full; it must not pick up stale bytes
+    memset(window + fill, 0, ROUNDUP_N(fill, 64) - fill);
+    flush_window(window, fill);
+  } else if (stream_offset == 0) {
+    // an empty stream
+    utf8_error_offset = UINT64_MAX;
+    structure_error = StructureError();
+  }
+  if ((checks & CHECK_UTF8) && utf8_error_offset == UINT64_MAX) {
+    // the padding of the last window caught any sequence cut short, unless
+    // the stream ended on a block boundary
+    int k = utf8_incomplete_tail(state.utf8_tail);
+    if (k != 0) {
+      utf8_error_offset = stream_offset + k;
+    }
+  }
+  if (checks & CHECK_STRICT) {
+    strict_finish(state.strict, stream_offset,
+                  state.prev_iter_inside_quote != 0);
+    structure_error = state.strict.error;
+  }
+  stream_offset = 0;
+  state = ParseState();
+}
@@ -0,0 +1,101 @@
+#ifndef SIMDCSV_STREAM_PARSER_H
+#define SIMDCSV_STREAM_PARSER_H
+
+#include <cstdio>
+#include <functional>
+
+#include "find_indexes.h"
+
+// the separators found in one window of a stream. Offsets are relative to
+// base, the position of the window in the stream, so they stay 32-bit no
+// matter how long the stream runs.
+struct IndexBatch {
+  uint64_t base;
+  const uint32_t *indexes;
+  uint32_t n_indexes;
+  // if the parser was asked for them, bit i set if separator i is a record
+  // end rather than a delimiter; nullptr otherwise
+  const uint64_t *record_ends;
+
+  bool is_record_end(uint32_t i) const {
+    return (record_ends[i / 64] >> (i % 64)) & 1;
+  }
+};
+
+// Indexes a stream of bytes a fixed-size window at a time. The quote and CR
+// state is carried from one window to the next, so the batches are exactly
+// the separators find_indexes would have found over the whole input, while
+// memory use is bounded by the window size (the window itself plus 4 bytes
+// of index per byte of window).
+//
+// The batch passed to the callback is only valid during the call.
+//
+// The checks (CHECK_UTF8, CHECK_STRICT; see Kernel) asked for are done on the
+// stream in the same pass; see utf8_error and error. With record_ends, the
+// windows are indexed with their row structure (see find_indexes), and the
+// batches tell record ends from delimiters.
+//
+// throws an exception if the dialect is invalid (see valid_dialect), the
+// buffers cannot be allocated or a read fails
+class StreamParser {
+public:
+  typedef std::function<void(const IndexBatch &)> Callback;
+
+  // the window size is rounded up to a multiple of 64 bytes
+  StreamParser(size_t window_size_in, Callback callback_in,
+               const Dialect &dialect_in = Dialect(),
+               unsigned checks_in = 0, bool record_ends_in = false);
+  ~StreamParser();
+
+  StreamParser(const StreamParser &) = delete;
+  StreamParser &operator=(const StreamParser &) = delete;
+
+  // append len bytes to the stream; every window filled is indexed
+  void feed(const uint8_t *data, size_t len);
+
+  // read fp to its end straight into the window (no intermediate copy)
+  // returns the number of bytes read
+  size_t feed_file(std::FILE *fp);
+
+  // index the len bytes at data as the next window, in place (no copy):
+  // nothing may be buffered (feed), len must be a multiple of 64 unless this
+  // is the last window, and data must be readable and zeroed up to len
+  // rounded up to 64 bytes. The batch's offsets fit 32 bits as long as len
+  // is at most the window size.
+  void feed_window(const uint8_t *data, size_t len);
+
+  // index whatever is left of the last window and get ready for a new stream
+  void finish();
+
+  // bytes indexed or buffered since the stream started
+  uint64_t bytes_seen() const { return stream_offset + fill; }
+
+  size_t window_size() const { return window_len; }
+
+  // with CHECK_UTF8, once the stream is finished: the offset in the stream
+  // of the first byte of the first ill-formed sequence, UINT64_MAX if there
+  // is none. Before that, the first error found so far.
+  uint64_t utf8_error() const { return utf8_error_offset; }
+
+  // with CHECK_STRICT, likewise: the first structural error of the stream
+  const StructureError &error() const { return structure_error; }
+
+private:
+  void flush_window(const uint8_t *data, size_t len);
+
+  size_t window_len;
+  Callback callback;
+  Dialect dialect;
+  unsigned checks;
+  uint8_t *window;
+  uint32_t *indexes;
+  uint32_t *rows{nullptr};        // with record_ends: see find_indexes_range
+  uint64_t *end_bits{nullptr};    // likewise: IndexBatch::record_ends
+  size_t fill{0};
+  uint64_t stream_offset{0};
+  uint64_t utf8_error_offset{UINT64_MAX};
+  StructureError structure_error;
+  ParseState state;
+};
+
+#endif
@@ -0,0 +1,412 @@
+#ifndef SIMDCSV_STRICT_CHECK_H
+#define SIMDCSV_STRICT_CHECK_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "common_defs.h"
+#include "dialect.h"
+#include "portability.h"
+
+// Strict mode: the structural rules of RFC 4180, checked on the masks the
+// kernels compute anyway. It comes in two passes over each batch of blocks:
+// the quote checks, a few bit operations per block done by the kernel as it
+// scans (strict_check_quotes), and the field counts, taken from the row
+// offsets of the records ended, as flatten_rows gives them
+// (strict_check_rows_ends). Either only leaves the loop for the rare batches
+// that need a closer look: an anomaly in the quote masks, a record of the
+// wrong length.
+//
+// A quote may only open a field (right after a separator, a record end or
+// the start of the input), and a closing quote must be followed by a
+// separator or a record end, unless it is the first half of an escaped ""
+// (a closing quote immediately followed by an opening one in the quote
+// mask). All records must have as many fields as the first.
+
+enum CsvError : uint8_t {
+  CSV_OK = 0,
+  CSV_UNTERMINATED_QUOTE, // at the quote opening the field
+  CSV_STRAY_QUOTE,        // at a quote within an unquoted field
+  CSV_TEXT_AFTER_QUOTE,   // at what follows the closing quote of a field
+  CSV_RAGGED_ROW,         // at the end of the row (record end or end of input)
+};
+
+inline const char *csv_error_message(CsvError e) {
+  switch (e) {
+  case CSV_OK:
+    return "no error";
+  case CSV_UNTERMINATED_QUOTE:
+    return "unterminated quoted field";
+  case CSV_STRAY_QUOTE:
+    return "quote within an unquoted field";
+  case CSV_TEXT_AFTER_QUOTE:
+    return "text after the closing quote of a field";
+  case CSV_RAGGED_ROW:
+    return "row does not have as many fields as the first";
+  }
+  return "unknown error";
+}
+
+// the first structural error, offset being a byte offset into the input and
+// row the (0-based) number of the record it is in
+struct StructureError {
+  CsvError code{CSV_OK};
+  uint64_t offset{0};
+  uint64_t row{0};
+};
+
+// what strict mode carries from one block to the next. Offsets are those of
+// the whole input: 'base' is the offset of the buffer being scanned, and
+// bytes from 'limit' (relative to that buffer) on are padding.
+struct StrictState {
+  uint64_t base{0};
+  uint64_t limit{0};
+  // does the next block start a field, follow a closing quote, or follow a
+  // byte after a closing quote that has to be the CR of a CR-LF?
+  uint64_t prev_iter_field_start{1ULL};
+  uint64_t prev_iter_closer{0ULL};
+  uint64_t prev_iter_cr_wanted{0ULL};
+  uint64_t last_open{0};       // offset of the last quote opening a field
+  // the first quote error the quote checks found, reported once the records
+  // before it are counted (UINT64_MAX if there is none pending)
+  uint64_t quote_error_offset{UINT64_MAX};
+  CsvError quote_error{CSV_OK};
+  uint64_t row{0};             // records ended so far
+  uint64_t row_fields{0};      // separators seen in the current record
+  uint64_t row_start{0};       // offset of the current record
+  uint64_t expected_fields{0}; // those of the first record, 0 until it ends
+  // when a scan starts in the middle of a record (a chunk of a parallel
+  // scan), the first record end only yields head_fields and head_end
+  bool head_pending{false};
+  uint64_t head_fields{0};
+  uint64_t head_end{0};
+  StructureError error;
+};
+
+// only the first error is kept
+really_inline void strict_fail(StrictState &s, CsvError code, uint64_t offset,
+                               uint64_t row) {
+  if (s.error.code != CSV_OK) {
+    return;
+  }
+  s.error.code = code;
+  s.error.offset = offset;
+  s.error.row = row;
+}
+
+// the record ends of a block, up to and including the bit 'upto' (all of
+// them if it is 0): the field counts of the records they end are checked
+really_inline bool strict_check_rows(StrictState &s, size_t idx, uint64_t seps,
+                                     uint64_t ends, int64_t upto) {
+  while (ends != 0) {
+    int64_t pos = trailingzeroes(ends);
+    if (pos > upto) {
+      break;
+    }
+    uint64_t mask = ends ^ (ends - 1);
+    uint64_t fields = s.row_fields + hamming(seps & mask);
+    uint64_t at = s.base + idx + pos;
+    if (unlikely(fields != s.expected_fields || s.head_pending)) {
+      if (s.head_pending) {
+        s.head_pending = false;
+        s.head_fields = fields;
+        s.head_end = at;
+      } else if (s.expected_fields == 0) {
+        s.expected_fields = fields;
+      } else {
+        if (at < s.base + s.limit) {
+          strict_fail(s, CSV_RAGGED_ROW, at, s.row);
+        }
+        return false;
+      }
+    }
+    s.row++;
+    s.row_fields = 0;
+    s.row_start = at + 1;
+    seps &= ~mask;
+    ends &= ends - 1;
+  }
+  s.row_fields += hamming(seps);
+  return true;
+}
+
+// the block at buf + idx, which strict_check_rows_ends could not do the quick
+// way: its record ends one at a time, and the quote error pending in it, if
+// any, once those before it are counted
+inline void strict_check_block_ends(StrictState &s, size_t idx, uint64_t seps,
+                                    uint64_t ends) {
+  uint64_t block = s.base + idx;
+  uint64_t q = s.quote_error_offset;
+  if (q >= block + 64) {
+    strict_check_rows(s, idx, seps, ends, 63);
+    return;
+  }
+  // the error may be at the last byte of the block before (-1)
+  if (strict_check_rows(s, idx, seps, ends, static_cast<int64_t>(q - block)) &&
+      q < s.base + s.limit) {
+    strict_fail(s, s.quote_error, q, s.row);
+  }
+  s.quote_error_offset = UINT64_MAX;
+}
+
+// strict_check_rows_ends for a batch that needs a closer look: block by block,
+// the record ends one at a time. The state goes in and out by value, so that
+// the kernel loops need not keep theirs in memory.
+never_inline StrictState strict_check_batch_ends(StrictState s, size_t idx,
+                                                 size_t n_blocks,
+                                                 const uint64_t *seps,
+                                                 const uint64_t *ends) {
+  for (size_t b = 0; b < n_blocks; b++) {
+    strict_check_block_ends(s, idx + 64 * b, seps[b], ends[b]);
+  }
+  return s;
+}
+
+// what strict_check_rows_ends and strict_check_ends share: whether the
+// batch of n_blocks blocks at buf + idx has to go the slow way whatever its
+// field counts
+really_inline uint64_t strict_batch_pending(const StrictState &s, size_t idx,
+                                            size_t n_blocks) {
+  return s.head_pending | (s.quote_error_offset < s.base + idx + 64 * n_blocks);
+}
+
+// and, once the records ending in it are counted ('bad' if any was not as
+// expected, n_rows of them, the last ending at separator row_k): the state
+// after the batch, or the batch done again the slow way, by
+// strict_check_batch_ends, from the state left untouched
+really_inline void strict_end_batch(StrictState &s, size_t idx,
+                                    size_t n_blocks, const uint64_t *seps,
+                                    const uint64_t *ends, uint64_t bad,
+                                    size_t n_rows, uint64_t row_k,
+                                    uint64_t k_after) {
+  if (unlikely(bad != 0)) {
+    s = strict_check_batch_ends(s, idx, n_blocks, seps, ends);
+    return;
+  }
+  if (n_rows != 0) {
+    size_t b = n_blocks - 1;
+    while (ends[b] == 0) {
+      b--;
+    }
+    s.row += n_rows;
+    s.row_start = s.base + idx + 64 * b + 64 - leadingzeroes(ends[b]);
+  }
+  s.row_fields = k_after - row_k;
+}
+
+// the field counts of the records ending in the n_blocks blocks at buf + idx,
+// buf + idx + 64, ...: 'seps' and 'ends' as in scan_blocks, 'rows' the
+// n_rows offsets flatten_rows gives for their record ends (each the number
+// of separators up to and including it, from any origin), k_before and
+// k_after the number of separators before and after the blocks. The state
+// is kept in locals, and the loop does not branch.
+template <typename index_t>
+really_inline void strict_check_rows_ends(StrictState &s, size_t idx,
+                                          size_t n_blocks, const uint64_t *seps,
+                                          const uint64_t *ends,
+                                          const index_t *rows, size_t n_rows,
+                                          uint64_t k_before, uint64_t k_after) {
+  const uint64_t expected = s.expected_fields;
+  uint64_t row_k = k_before - s.row_fields; // k at the start of the record
+  uint64_t bad = strict_batch_pending(s, idx, n_blocks);
+  for (size_t r = 0; r < n_rows; r++) {
+    bad |= rows[r] - row_k != expected;
+    row_k = rows[r];
+  }
+  strict_end_batch(s, idx, n_blocks, seps, ends, bad, n_rows, row_k, k_after);
+}
+
+// the same for blocks whose row offsets are not flattened: k[b] is the
+// number of separators before block b, from any origin (k[n_blocks] that
+// after the last block), and the offsets are worked out as flatten_rows does
+really_inline void strict_check_ends(StrictState &s, size_t idx, size_t n_blocks,
+                                     const uint64_t *seps, const uint64_t *ends,
+                                     const uint64_t *k) {
+  const uint64_t expected = s.expected_fields;
+  uint64_t row_k = k[0] - s.row_fields;
+  uint64_t bad = strict_batch_pending(s, idx, n_blocks);
+  size_t n_rows = 0;
+  for (size_t b = 0; b < n_blocks; b++) {
+    // the first record end of the block without branching on it, as there
+    // is at most one in most blocks
+    uint64_t e = ends[b];
+    uint64_t has_end = e != 0;
+    uint64_t end_k = k[b] + hamming(seps[b] & (e ^ (e - 1)));
+    bad |= has_end & (end_k - row_k != expected);
+    row_k = has_end ? end_k : row_k;
+    n_rows += has_end;
+    for (e &= e - 1; e != 0; e &= e - 1) {
+      end_k = k[b] + hamming(seps[b] & (e ^ (e - 1)));
+      bad |= end_k - row_k != expected;
+      row_k = end_k;
+      n_rows++;
+    }
+  }
+  strict_end_batch(s, idx, n_blocks, seps, ends, bad, n_rows, row_k,
+                   k[n_blocks]);
+}
+
+// strict_check_ends for blocks whose separators are not flattened: they are
+// counted here, 4 blocks at a time
+inline void strict_count_ends(StrictState &s, size_t idx, size_t n_blocks,
+                              const uint64_t *seps, const uint64_t *ends) {
+  for (size_t b = 0; b < n_blocks; b += 4) {
+    size_t n = n_blocks - b < 4 ? n_blocks - b : 4;
+    uint64_t k[5] = {0};
+    for (size_t i = 0; i < n; i++) {
+      k[i + 1] = k[i] + hamming(seps[b + i]);
+    }
+    strict_check_ends(s, idx + 64 * b, n, seps + b, ends + b, k);
+  }
+}
+
+// the first quote error of the n_blocks blocks at buf + idx, which
+// strict_check_quotes found one in, scanned again from the carries the
+// batch started with ('carry': field start, closer, CR wanted); by value, as
+// strict_check_batch_ends
+never_inline StrictState strict_quote_error(StrictState s, size_t idx,
+                                            size_t n_blocks, bool crlf,
+                                            const uint64_t *quotes,
+                                            const uint64_t *quote_mask,
+                                            const uint64_t *seps,
+                                            const uint64_t *ends,
+                                            const uint64_t *carry) {
+  uint64_t field_start_carry = carry[0];
+  uint64_t closer_carry = carry[1];
+  uint64_t cr_carry = carry[2];
+  for (size_t b = 0; b < n_blocks; b++) {
+    uint64_t openers = quotes[b] & quote_mask[b];
+    uint64_t closers = quotes[b] & ~quote_mask[b];
+    uint64_t field_start = (seps[b] << 1) | field_start_carry;
+    uint64_t after_closer = (closers << 1) | closer_carry;
+    field_start_carry = seps[b] >> 63;
+    closer_carry = closers >> 63;
+    uint64_t stray = openers & ~field_start & ~after_closer;
+    uint64_t text_after = after_closer & ~(seps[b] | quotes[b]);
+    uint64_t missed = 0;
+    if (crlf) {
+      missed = ((text_after << 1) | cr_carry) & ~ends[b];
+      cr_carry = text_after >> 63;
+      text_after = 0;
+    }
+    if ((stray | text_after | missed) == 0) {
+      continue;
+    }
+    // as an offset from the block (-1 if it is the last byte of the block
+    // before)
+    int64_t at = 64;
+    CsvError code = CSV_OK;
+    if (stray != 0) {
+      at = trailingzeroes(stray);
+      code = CSV_STRAY_QUOTE;
+    }
+    if (text_after != 0 && trailingzeroes(text_after) < at) {
+      at = trailingzeroes(text_after);
+      code = CSV_TEXT_AFTER_QUOTE;
+    }
+    if (missed != 0 && trailingzeroes(missed) - 1 < at) {
+      at = static_cast<int64_t>(trailingzeroes(missed)) - 1;
+      code = CSV_TEXT_AFTER_QUOTE;
+    }
+    if (s.quote_error_offset == UINT64_MAX) {
+      s.quote_error_offset = s.base + idx + 64 * b + at;
+      s.quote_error = code;
+    }
+    return s;
+  }
+  return s;
+}
+
+// the quote checks of the n_blocks blocks at buf + idx, buf + idx + 64, ...:
+// 'quotes' are their quote characters and 'quote_mask' their quoted bytes
+// (see find_quote_mask), 'seps' and 'ends' as in scan_blocks. The first
+// error found is left pending, for strict_check_rows_ends to report in order.
+really_inline void strict_check_quotes(StrictState &s, size_t idx,
+                                       size_t n_blocks, bool crlf,
+                                       const uint64_t *quotes,
+                                       const uint64_t *quote_mask,
+                                       const uint64_t *seps,
+                                       const uint64_t *ends) {
+  const uint64_t carry[3] = {s.prev_iter_field_start, s.prev_iter_closer,
+                             s.prev_iter_cr_wanted};
+  uint64_t field_start_carry = carry[0];
+  uint64_t closer_carry = carry[1];
+  uint64_t cr_carry = carry[2];
+  uint64_t last_open = s.last_open;
+  uint64_t anomalies = 0;
+  for (size_t b = 0; b < n_blocks; b++) {
+    uint64_t openers = quotes[b] & quote_mask[b];
+    uint64_t closers = quotes[b] & ~quote_mask[b];
+    uint64_t field_start = (seps[b] << 1) | field_start_carry;
+    uint64_t after_closer = (closers << 1) | closer_carry;
+    field_start_carry = seps[b] >> 63;
+    closer_carry = closers >> 63;
+    uint64_t field_openers = openers & field_start;
+    last_open = field_openers != 0 ? s.base + idx + 64 * b + 63 -
+                                         leadingzeroes(field_openers)
+                                   : last_open;
+    anomalies |= openers & ~field_start & ~after_closer; // stray quotes
+    uint64_t text_after = after_closer & ~(seps[b] | quotes[b]);
+    // in CR-LF dialects, what follows a closing quote is fine after all if
+    // it is the CR of a record end: the byte after those that are not is
+    // flagged (a byte after a closing quote at bit 63 is carried to the
+    // next block)
+    if (crlf) {
+      anomalies |= ((text_after << 1) | cr_carry) & ~ends[b];
+      cr_carry = text_after >> 63;
+    } else {
+      anomalies |= text_after;
+    }
+  }
+  s.prev_iter_field_start = field_start_carry;
+  s.prev_iter_closer = closer_carry;
+  s.prev_iter_cr_wanted = cr_carry;
+  s.last_open = last_open;
+  if (unlikely(anomalies != 0)) {
+    s = strict_quote_error(s, idx, n_blocks, crlf, quotes, quote_mask, seps,
+                           ends, carry);
+  }
+}
+
+// at the end of the input (at offset 'end'): the checks that need to know
+// it is over
+really_inline void strict_finish(StrictState &s, uint64_t end,
+                                 bool inside_quote) {
+  if (s.quote_error_offset != UINT64_MAX) {
+    // only if its blocks were not counted
+    strict_check_block_ends(s, s.quote_error_offset - s.base, 0, 0);
+  }
+  if (s.error.code != CSV_OK) {
+    return;
+  }
+  if (inside_quote) {
+    strict_fail(s, CSV_UNTERMINATED_QUOTE, s.last_open, s.row);
+  } else if (end > s.row_start && s.expected_fields != 0 &&
+             s.row_fields + 1 != s.expected_fields) {
+    // a last record without a line ending
+    strict_fail(s, CSV_RAGGED_ROW, end, s.row);
+  }
+}
+
+// what the scan of a chunk starting at buf[start] (start > 1,
+// inside_quote telling whether it starts in a quoted field) needs to know of
+// the bytes before it
+inline void strict_chunk_start(StrictState &s, const uint8_t *buf, size_t start,
+                               bool inside_quote, const Dialect &dialect) {
+  s.head_pending = true;
+  if (inside_quote) {
+    s.prev_iter_field_start = 0;
+    return;
+  }
+  uint8_t b1 = buf[start - 1];
+  uint8_t b2 = buf[start - 2];
+  // outside quotes after b1, a quote there closes a field; and, b1 being no
+  // quote, so does a quote in b2
+  s.prev_iter_field_start =
+      b1 == dialect.delimiter || (b1 == 0x0a && (!dialect.crlf || b2 == 0x0d));
+  s.prev_iter_closer = b1 == dialect.quote;
+  s.prev_iter_cr_wanted = dialect.crlf && b2 == dialect.quote &&
+                          b1 != dialect.delimiter && b1 != dialect.quote;
+}
+
+#endif
@@ -8,27 +8,139 @@
 #include <unistd.h>           // for syscall
 
 #include <cerrno>  // for errno
+#include <cstdlib> // for strtoull
 #include <cstring> // for memset
+#include <fstream>
 #include <stdexcept>
+#include <string>
 #include <vector>
 #include <iostream>
 
+// a perf event: a type (PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+// PERF_TYPE_RAW or that of a PMU in sysfs) and its config
+struct PerfEvent {
+  uint32_t type;
+  uint64_t config;
+  std::string name;
+};
+
+// an event of the cpu PMU by its sysfs name, e.g. topdown-retiring: its
+// terms ("event=0x00,umask=0x81") placed in the config as the PMU's format
+// directory says ("config:8-15"); false if there is no such event
+inline bool sysfs_perf_event(const std::string &name, PerfEvent &event) {
+  const std::string pmu = "/sys/bus/event_source/devices/cpu/";
+  std::ifstream type_file(pmu + "type");
+  std::ifstream event_file(pmu + "events/" + name);
+  std::string terms;
+  if (!(type_file >> event.type) || !std::getline(event_file, terms)) {
+    return false;
+  }
+  event.config = 0;
+  size_t pos = 0;
+  while (pos < terms.size()) {
+    size_t comma = terms.find(',', pos);
+    std::string term = terms.substr(pos, comma - pos);
+    pos = comma == std::string::npos ? terms.size() : comma + 1;
+    size_t eq = term.find('=');
+    std::string key = term.substr(0, eq);
+    uint64_t value = eq == std::string::npos ? 1 : strtoull(term.c_str() + eq + 1, nullptr, 0);
+    std::ifstream format_file(pmu + "format/" + key);
+    std::string format;
+    if (!std::getline(format_file, format) || format.compare(0, 7, "config:") != 0) {
+      return false;
+    }
+    event.config |= value << strtoull(format.c_str() + 7, nullptr, 10);
+  }
+  event.name = name;
+  return true;
+}
+
+// an event by name: the generic hardware events (cycles, instructions,
+// branch-misses, cache-references, cache-misses, ref-cycles), cache events
+// (L1D-read-miss, L1D-read-access, LLC-read-miss, LLC-read-access,
+// dTLB-read-miss), raw events (r and the hex config, e.g. r01c2), and the
+// events of the cpu PMU in sysfs, the top-down ones among them (slots,
+// topdown-retiring, topdown-bad-spec, topdown-fe-bound, topdown-be-bound,
+// with slots first, where the CPU has them). False if there is no such event.
+inline bool parse_perf_event(const std::string &name, PerfEvent &event) {
+  struct Named {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+  };
+  const uint64_t read = PERF_COUNT_HW_CACHE_OP_READ << 8;
+  const uint64_t miss = uint64_t(PERF_COUNT_HW_CACHE_RESULT_MISS) << 16;
+  const uint64_t access = uint64_t(PERF_COUNT_HW_CACHE_RESULT_ACCESS) << 16;
+  static const Named named[] = {
+      {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+      {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+      {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+      {"cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+      {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+      {"ref-cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES},
+      {"L1D-read-miss", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | read | miss},
+      {"L1D-read-access", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | read | access},
+      {"LLC-read-miss", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | read | miss},
+      {"LLC-read-access", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | read | access},
+      {"dTLB-read-miss", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | read | miss},
+  };
+  for (const Named &n : named) {
+    if (name == n.name) {
+      event = {n.type, n.config, name};
+      return true;
+    }
+  }
+  if (name.size() > 1 && name[0] == 'r' &&
+      name.find_first_not_of("0123456789abcdefABCDEF", 1) == std::string::npos) {
+    event = {PERF_TYPE_RAW, strtoull(name.c_str() + 1, nullptr, 16), name};
+    return true;
+  }
+  return sysfs_perf_event(name, event);
+}
+
+// the events of a comma-separated list; false if one of them is unknown,
+// its name then left in 'bad'
+inline bool parse_perf_events(const std::string &list, std::vector<PerfEvent> &events,
+                              std::string &bad) {
+  size_t pos = 0;
+  while (pos <= list.size()) {
+    size_t comma = list.find(',', pos);
+    std::string name = list.substr(pos, comma - pos);
+    PerfEvent e;
+    if (!parse_perf_event(name, e)) {
+      bad = name;
+      return false;
+    }
+    events.push_back(e);
+    if (comma == std::string::npos) {
+      break;
+    }
+    pos = comma + 1;
+  }
+  return true;
+}
+
 class TimingAccumulator {
 public:
   std::vector<uint64_t> results;
   std::vector<uint64_t> temp_result_vec; // reused rather than allocated in the middle of timing
+  std::vector<std::string> event_names;
   int num_phases;
   int num_events;
   int fd;
   bool working;
 
-  explicit TimingAccumulator(int num_phases_in, std::vector<int> config_vec) 
+  // PERF_TYPE_HARDWARE events
+  explicit TimingAccumulator(int num_phases_in, std::vector<int> config_vec)
+    : TimingAccumulator(num_phases_in, hardware_events(config_vec)) {}
+
+  // the events are counted as one group, led by the first
+  explicit TimingAccumulator(int num_phases_in, const std::vector<PerfEvent> &events)
     : num_phases(num_phases_in), fd(0), working(true) {
     perf_event_attr attribs;
     std::vector<uint64_t> ids;
 
     memset(&attribs, 0, sizeof(attribs));
-    attribs.type = PERF_TYPE_HARDWARE; // for now
     attribs.size = sizeof(attribs);
     attribs.disabled = 1;
     attribs.exclude_kernel = 1;
@@ -41,11 +153,12 @@ public:
     const unsigned long flags = 0;
 
     int group = -1; // no group
-    num_events = config_vec.size();
-    ids.resize(config_vec.size());
+    num_events = events.size();
+    ids.resize(events.size());
     uint32_t i = 0;
-    for (auto config : config_vec) {
-      attribs.config = config;
+    for (const PerfEvent &e : events) {
+      attribs.type = e.type;
+      attribs.config = e.config;
       fd = syscall(__NR_perf_event_open, &attribs, pid, cpu, group, flags);
       if (fd == -1) {
         report_error("perf_event_open");
@@ -54,14 +167,22 @@ public:
       if (group == -1) {
         group = fd;
       }
+      fds.push_back(fd);
+      event_names.push_back(e.name);
     }
+    // the group is enabled, reset and read through its leader
+    fd = group;
 
     temp_result_vec.resize(num_events * 2 + 1);
-    results.resize(num_phases*num_events, config_vec.size());
+    results.resize(num_phases*num_events, 0);
   }
 
   ~TimingAccumulator() {
-    close(fd);
+    for (int f : fds) {
+      if (f != -1) {
+        close(f);
+      }
+    }
   }
 
   void report_error(const std::string &context) {
@@ -95,6 +216,9 @@ public:
     }
   }
 
+  // the count of event j in phase i
+  uint64_t count(int i, int j) const { return results[i * num_events + j]; }
+
   void dump() {
     for (int i = 0; i < num_phases; i++) {
       for (int j = 0; j < num_events; j++) {
@@ -103,6 +227,23 @@ public:
       std::cout << "\n";
     }
   }
+
+private:
+  static std::vector<PerfEvent> hardware_events(const std::vector<int> &configs) {
+    static const char *names[] = {"cycles", "instructions", "cache-references",
+                                  "cache-misses", "branch-instructions",
+                                  "branch-misses", "bus-cycles",
+                                  "stalled-cycles-frontend",
+                                  "stalled-cycles-backend", "ref-cycles"};
+    std::vector<PerfEvent> events;
+    for (int config : configs) {
+      events.push_back({PERF_TYPE_HARDWARE, uint64_t(config),
+                        config >= 0 && config < 10 ? names[config] : "unknown"});
+    }
+    return events;
+  }
+
+  std::vector<int> fds;
 };
 
 // a that is designed to start counting on coming into scope and stop counting, putting its results into
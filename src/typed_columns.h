@@ -0,0 +1,106 @@
+#ifndef SIMDCSV_TYPED_COLUMNS_H
+#define SIMDCSV_TYPED_COLUMNS_H
+
+#include <cstdint>
+#include <vector>
+
+#include "find_indexes.h"
+#include "number_parsing.h"
+#include "unescape.h"
+
+// Typed columns: the fields of some columns converted to numbers, into one
+// contiguous array per column (see number_parsing.h for what a number is).
+// An empty field, or one missing from a short row, is null; so is a field
+// that is not a number of the column's type, which is also flagged invalid.
+// The value of a null is 0. A quoted field is converted without its quotes.
+
+enum ColumnType : uint8_t {
+  COLUMN_INT64,
+  COLUMN_DOUBLE,
+};
+
+struct ColumnSpec {
+  size_t column; // 0-based
+  ColumnType type;
+};
+
+// bit r % 64 of bitmap[r / 64] is that of row r
+struct TypedColumn {
+  ColumnSpec spec;
+  std::vector<int64_t> ints;    // COLUMN_INT64
+  std::vector<double> doubles;  // COLUMN_DOUBLE
+  std::vector<uint64_t> nulls;
+  std::vector<uint64_t> invalid;
+  size_t n_nulls{0};
+  size_t n_invalid{0};
+
+  size_t size() const {
+    return spec.type == COLUMN_INT64 ? ints.size() : doubles.size();
+  }
+  bool is_null(size_t r) const { return (nulls[r / 64] >> (r % 64)) & 1; }
+};
+
+really_inline void set_bit(std::vector<uint64_t> &bitmap, size_t r) {
+  bitmap[r / 64] |= 1ULL << (r % 64);
+}
+
+// convert the columns of schema for rows first_row and on (to leave out a
+// header) of pcsv, which must have the row structure; columns[j] is the
+// column of schema[j], its row r the row first_row + r of pcsv. buf must be
+// padded (CSV_PADDING).
+template <typename index_t>
+really_inline void decode_columns(const uint8_t *buf,
+                                  const BasicParsedCSV<index_t> &pcsv,
+                                  const std::vector<ColumnSpec> &schema,
+                                  std::vector<TypedColumn> &columns,
+                                  size_t first_row = 0) {
+  size_t n_rows = pcsv.n_rows > first_row ? pcsv.n_rows - first_row : 0;
+  columns.resize(schema.size());
+  for (size_t j = 0; j < schema.size(); j++) {
+    TypedColumn &c = columns[j];
+    c.spec = schema[j];
+    if (c.spec.type == COLUMN_INT64) {
+      c.ints.assign(n_rows, 0);
+      c.doubles.clear();
+    } else {
+      c.doubles.assign(n_rows, 0);
+      c.ints.clear();
+    }
+    c.nulls.assign((n_rows + 63) / 64, 0);
+    c.invalid.assign((n_rows + 63) / 64, 0);
+    c.n_nulls = 0;
+    c.n_invalid = 0;
+  }
+  const uint8_t quote = pcsv.dialect.quote;
+  // a row at a time, so that the input is only gone through once
+  for (size_t r = 0; r < n_rows; r++) {
+    index_t row = static_cast<index_t>(first_row + r);
+    size_t n_fields = pcsv.row_fields(row);
+    for (TypedColumn &c : columns) {
+      index_t start = 0, end = 0;
+      if (c.spec.column < n_fields) {
+        pcsv.field(row, static_cast<index_t>(c.spec.column), start, end);
+      }
+      size_t s = start, e = end;
+      quoted_field_inside(buf, s, e, quote);
+      bool ok;
+      if (s == e) {
+        ok = false;
+      } else if (c.spec.type == COLUMN_INT64) {
+        ok = parse_int64(buf + s, buf + e, c.ints[r]);
+      } else {
+        ok = parse_double(buf + s, buf + e, c.doubles[r]);
+      }
+      if (unlikely(!ok)) {
+        set_bit(c.nulls, r);
+        c.n_nulls++;
+        if (s != e) {
+          set_bit(c.invalid, r);
+          c.n_invalid++;
+        }
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef SIMDCSV_UNESCAPE_H
+#define SIMDCSV_UNESCAPE_H
+
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "arena.h"
+#include "find_indexes.h"
+
+// The contents of the fields, as string_views rather than std::strings. A
+// field that does not start with a quote is its bytes as they are. A quoted
+// field loses its enclosing quotes, and each of its doubled quotes becomes
+// one; the views of quoted fields without a doubled quote (by far the most
+// common kind) still point into the input, so only the others are copied:
+// to an Arena, or in place, over the input itself (which must then be
+// writable, e.g. from get_corpus rather than map_corpus).
+//
+// The collapsing is done by the kernel (see Kernel::unescape), which finds
+// the quote pairs with the same carry-less multiply as find_quote_mask and
+// compacts the blocks with byte shuffles. Quotes are only expected to come
+// in pairs inside a quoted field: others are dropped or kept, but the
+// output is then not meaningful.
+
+// the bounds of field k of pcsv (the bytes after separator k - 1 up to
+// separator k, the CR of a CR-LF left out)
+template <typename index_t>
+really_inline void index_field(const uint8_t *buf,
+                               const BasicParsedCSV<index_t> &pcsv, size_t k,
+                               size_t &start, size_t &end) {
+  start = k == 0 ? 0 : pcsv.indexes[k - 1] + 1;
+  end = pcsv.indexes[k];
+  // with CR-LF, a LF among the separators is a record end (the end of the
+  // data past them, for a last row without a line ending, is not)
+  if (pcsv.dialect.crlf && k < pcsv.n_indexes && buf[end] == '\n') {
+    end--;
+  }
+}
+
+// if buf[start, end) is a quoted field, narrow it down to the inside of the
+// quotes and return true
+really_inline bool quoted_field_inside(const uint8_t *buf, size_t &start,
+                                       size_t &end, uint8_t quote) {
+  if (start == end || buf[start] != quote) {
+    return false;
+  }
+  start++;
+  // a quote opening a field that the input ends in has no pair
+  if (end > start && buf[end - 1] == quote) {
+    end--;
+  }
+  return true;
+}
+
+really_inline std::string_view field_view(const uint8_t *p, size_t len) {
+  return std::string_view(reinterpret_cast<const char *>(p), len);
+}
+
+// the contents of the field buf[start, end), copied to arena if need be
+really_inline std::string_view unescape_field(const uint8_t *buf, size_t start,
+                                              size_t end, uint8_t quote,
+                                              Arena &arena) {
+  if (!quoted_field_inside(buf, start, end, quote) ||
+      memchr(buf + start, quote, end - start) == nullptr) {
+    return field_view(buf + start, end - start);
+  }
+  uint8_t *out = arena.allocate(end - start);
+  size_t len = active_kernel->unescape(buf + start, end - start, quote, out);
+  arena.shrink_last(out, len);
+  return field_view(out, len);
+}
+
+// likewise, over the field itself
+really_inline std::string_view unescape_field_in_place(uint8_t *buf,
+                                                       size_t start, size_t end,
+                                                       uint8_t quote) {
+  if (!quoted_field_inside(buf, start, end, quote) ||
+      memchr(buf + start, quote, end - start) == nullptr) {
+    return field_view(buf + start, end - start);
+  }
+  size_t len = active_kernel->unescape(buf + start, end - start, quote,
+                                       buf + start);
+  return field_view(buf + start, len);
+}
+
+// the contents of all the fields indexed in pcsv, in order: one per index
+// (see BasicParsedCSV::n_fields), so that with the row structure, field m of
+// row r is fields[pcsv.row_offsets[r] + m]. The views are valid for as long
+// as buf and what was allocated from arena.
+template <typename index_t>
+really_inline void unescape_fields(const uint8_t *buf,
+                                   const BasicParsedCSV<index_t> &pcsv,
+                                   Arena &arena,
+                                   std::vector<std::string_view> &fields) {
+  fields.resize(pcsv.n_fields());
+  const uint8_t quote = pcsv.dialect.quote;
+  for (size_t k = 0; k < fields.size(); k++) {
+    size_t start, end;
+    index_field(buf, pcsv, k, start, end);
+    fields[k] = unescape_field(buf, start, end, quote, arena);
+  }
+}
+
+// likewise, in place: the fields with a doubled quote are overwritten, and
+// the index no longer describes them
+template <typename index_t>
+really_inline void unescape_fields_in_place(uint8_t *buf,
+                                            const BasicParsedCSV<index_t> &pcsv,
+                                            std::vector<std::string_view> &fields) {
+  fields.resize(pcsv.n_fields());
+  const uint8_t quote = pcsv.dialect.quote;
+  for (size_t k = 0; k < fields.size(); k++) {
+    size_t start, end;
+    index_field(buf, pcsv, k, start, end);
+    fields[k] = unescape_field_in_place(buf, start, end, quote);
+  }
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef SIMDCSV_UTF8_H
+#define SIMDCSV_UTF8_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "common_defs.h"
+
+// Scalar UTF-8 helpers. The kernels validate in SIMD (see utf8_lookup.h) and
+// only say whether a range was valid; these find where it was not, and serve
+// as the validation of the scalar kernel.
+//
+// A range is validated knowing the last three bytes before it, its "tail"
+// (byte -3 in the low byte), so that a sequence split between two ranges is
+// seen whole.
+
+// the tail of the bytes ending at end
+really_inline uint32_t utf8_tail(const uint8_t *end) {
+  return end[-3] | (end[-2] << 8) | (static_cast<uint32_t>(end[-1]) << 16);
+}
+
+// the tail of the bytes ending at buf + len, given the tail before buf
+really_inline uint32_t utf8_next_tail(const uint8_t *buf, size_t len,
+                                      uint32_t tail) {
+  for (size_t i = len < 3 ? 0 : len - 3; i < len; i++) {
+    tail = (tail >> 8) | (static_cast<uint32_t>(buf[i]) << 16);
+  }
+  return tail;
+}
+
+// the length of the sequence led by b, and the range of its second byte
+// (RFC 3629); 0 if b cannot start a sequence
+really_inline int utf8_sequence(uint8_t b, uint8_t &lo, uint8_t &hi) {
+  lo = 0x80;
+  hi = 0xbf;
+  if (b < 0x80) {
+    return 1;
+  } else if (b < 0xc2) {
+    return 0; // continuation, or overlong 2-byte lead
+  } else if (b < 0xe0) {
+    return 2;
+  } else if (b < 0xf0) {
+    if (b == 0xe0) {
+      lo = 0xa0; // overlong
+    } else if (b == 0xed) {
+      hi = 0x9f; // surrogates
+    }
+    return 3;
+  } else if (b < 0xf5) {
+    if (b == 0xf0) {
+      lo = 0x90; // overlong
+    } else if (b == 0xf4) {
+      hi = 0x8f; // beyond U+10FFFF
+    }
+    return 4;
+  }
+  return 0;
+}
+
+// where a range must start being decoded given its tail: the (negative)
+// offset of the lead byte of a sequence the tail leaves unfinished, or that
+// cannot lead a sequence at all, 0 if there is none. The tail is assumed to
+// be valid as far as it goes. At the very end of the input, this is where
+// the input stops being valid.
+really_inline int utf8_incomplete_tail(uint32_t tail) {
+  for (int k = -1; k >= -3; k--) {
+    uint8_t b = static_cast<uint8_t>(tail >> (8 * (3 + k)));
+    if ((b & 0xc0) != 0x80) {
+      uint8_t lo, hi;
+      int length = utf8_sequence(b, lo, hi);
+      return b >= 0xc0 && (length == 0 || length > -k) ? k : 0;
+    }
+  }
+  return 0;
+}
+
+// the offset, relative to buf, of the first byte of the first ill-formed
+// sequence in buf[0, len): negative if the sequence starts in the tail, len
+// if there is none. A sequence cut short by the end of the range is not an
+// error; see utf8_incomplete_tail.
+really_inline int64_t utf8_first_error(const uint8_t *buf, size_t len,
+                                       uint32_t tail) {
+  auto at = [&](int64_t i) -> uint8_t {
+    return i < 0 ? static_cast<uint8_t>(tail >> (8 * (3 + i))) : buf[i];
+  };
+  const int64_t n = static_cast<int64_t>(len);
+  int64_t i = utf8_incomplete_tail(tail);
+  while (i < n) {
+    uint8_t b = at(i);
+    if (b < 0x80) {
+      i++;
+      continue;
+    }
+    uint8_t lo, hi;
+    int length = utf8_sequence(b, lo, hi);
+    if (length == 0) {
+      return i;
+    }
+    for (int j = 1; j < length; j++) {
+      if (i + j >= n) {
+        return n;
+      }
+      uint8_t c = at(i + j);
+      if (c < lo || c > hi) {
+        return i;
+      }
+      lo = 0x80;
+      hi = 0xbf;
+    }
+    i += length;
+  }
+  return n;
+}
+
+#endif
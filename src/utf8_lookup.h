@@ -0,0 +1,175 @@
+// UTF-8 validation for the SIMD kernels, after simdjson (Keiser and Lemire,
+// "Validating UTF-8 In Less Than One Instruction Per Byte"): three nibble
+// lookups classify every byte together with the one before it, and the
+// lengths of the multibyte sequences are checked against the bytes two and
+// three back. Blocks of pure ASCII only check that the block before did not
+// end in the middle of a sequence.
+//
+// Like kernel_generic.h, included inside the namespace of a kernel, which
+// must first define, over its vector type utf8_vec:
+//   utf8_chunks                 number of utf8_vec in a simd_input
+//   chunk(in, i)                the i-th of them
+//   is_ascii(in)                no byte of the block has its high bit set
+//   splat, vand, vor, vxor      the obvious
+//   subs(a, b)                  unsigned saturating a - b, bytewise
+//   shr4(a)                     the high nibble of every byte
+//   lookup16(idx, table)        table[idx], bytewise, for idx < 16
+//   prev<N>(a, prev_a)          a shifted N bytes late, fed from prev_a
+//   any(a)                      is any bit set?
+// Deliberately no include guard.
+
+// the errors each pair of consecutive bytes can be part of, as found by the
+// three lookups (high and low nibble of the first, high nibble of the second)
+const uint8_t TOO_SHORT = 1 << 0;  // 11______ 0_______
+                                   // 11______ 11______
+const uint8_t TOO_LONG = 1 << 1;   // 0_______ 10______
+const uint8_t OVERLONG_3 = 1 << 2; // 11100000 100_____
+const uint8_t TOO_LARGE = 1 << 3;  // 11110100 1001____
+                                   // 11110100 101_____
+                                   // 11110101 1001____
+                                   // 11110101 101_____
+                                   // 1111011_ 1001____
+                                   // 1111011_ 101_____
+                                   // 11111___ 1001____
+                                   // 11111___ 101_____
+const uint8_t SURROGATE = 1 << 4;  // 11101101 101_____
+const uint8_t OVERLONG_2 = 1 << 5; // 1100000_ 10______
+const uint8_t TOO_LARGE_1000 = 1 << 6; // 11110101 1000____
+                                       // 1111011_ 1000____
+                                       // 11111___ 1000____
+const uint8_t OVERLONG_4 = 1 << 6; // 11110000 1000____
+const uint8_t TWO_CONTS = 1 << 7;  // 10______ 10______
+// errors that do not depend on the low nibble of the first byte
+const uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+const uint8_t utf8_byte_1_high[16] = {
+  // 0_______ ________ <ASCII in byte 1>
+  TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+  TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+  // 10______ ________ <continuation in byte 1>
+  TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+  // 1100____ ________ <two byte lead in byte 1>
+  TOO_SHORT | OVERLONG_2,
+  // 1101____ ________ <two byte lead in byte 1>
+  TOO_SHORT,
+  // 1110____ ________ <three byte lead in byte 1>
+  TOO_SHORT | OVERLONG_3 | SURROGATE,
+  // 1111____ ________ <four+ byte lead in byte 1>
+  TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4
+};
+
+const uint8_t utf8_byte_1_low[16] = {
+  // ____0000 ________
+  CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+  // ____0001 ________
+  CARRY | OVERLONG_2,
+  // ____001_ ________
+  CARRY,
+  CARRY,
+  // ____0100 ________
+  CARRY | TOO_LARGE,
+  // ____0101 ________
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  // ____011_ ________
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  // ____1___ ________
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  // ____1101 ________
+  CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+  CARRY | TOO_LARGE | TOO_LARGE_1000,
+  CARRY | TOO_LARGE | TOO_LARGE_1000
+};
+
+const uint8_t utf8_byte_2_high[16] = {
+  // ________ 0_______ <ASCII in byte 2>
+  TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+  TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+  // ________ 1000____
+  TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+  // ________ 1001____
+  TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+  // ________ 101_____
+  TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+  TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+  // ________ 11______
+  TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT
+};
+
+// a block whose last three bytes exceed these ends inside a sequence:
+// ... 1111____ 111_____ 11______
+const uint8_t utf8_incomplete_max[64] = {
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+  0xf0 - 1, 0xe0 - 1, 0xc0 - 1
+};
+
+struct utf8_checker {
+  utf8_vec error;
+  utf8_vec prev_input;
+  utf8_vec prev_incomplete;
+};
+
+really_inline utf8_vec check_special_cases(utf8_vec input, utf8_vec prev1) {
+  utf8_vec byte_1_high = lookup16(shr4(prev1), utf8_byte_1_high);
+  utf8_vec byte_1_low = lookup16(vand(prev1, splat(0x0f)), utf8_byte_1_low);
+  utf8_vec byte_2_high = lookup16(shr4(input), utf8_byte_2_high);
+  return vand(vand(byte_1_high, byte_1_low), byte_2_high);
+}
+
+// the third and fourth bytes of sequences must be continuations, and
+// continuations anywhere else are errors (TWO_CONTS flags them all)
+really_inline utf8_vec check_multibyte_lengths(utf8_vec input,
+                                               utf8_vec prev_input,
+                                               utf8_vec special_cases) {
+  utf8_vec prev2 = prev<2>(input, prev_input);
+  utf8_vec prev3 = prev<3>(input, prev_input);
+  // only 111_____ and 1111____ respectively are left >= 0x80
+  utf8_vec is_third_byte = subs(prev2, splat(0xe0 - 0x80));
+  utf8_vec is_fourth_byte = subs(prev3, splat(0xf0 - 0x80));
+  utf8_vec must23_80 = vand(vor(is_third_byte, is_fourth_byte), splat(0x80));
+  return vxor(must23_80, special_cases);
+}
+
+really_inline utf8_vec is_incomplete(utf8_vec input) {
+  return subs(input, chunk(fill_input(utf8_incomplete_max), utf8_chunks - 1));
+}
+
+// start validating after the bytes in tail (see utf8.h)
+really_inline void utf8_init(utf8_checker &c, uint32_t tail) {
+  uint8_t block[64] = {0};
+  block[61] = static_cast<uint8_t>(tail);
+  block[62] = static_cast<uint8_t>(tail >> 8);
+  block[63] = static_cast<uint8_t>(tail >> 16);
+  c.error = splat(0);
+  c.prev_input = chunk(fill_input(block), utf8_chunks - 1);
+  c.prev_incomplete = is_incomplete(c.prev_input);
+}
+
+really_inline void utf8_check(utf8_checker &c, simd_input in) {
+  if (is_ascii(in)) {
+    c.error = vor(c.error, c.prev_incomplete);
+  } else {
+    for (int i = 0; i < utf8_chunks; i++) {
+      utf8_vec input = chunk(in, i);
+      utf8_vec prev1 = prev<1>(input, c.prev_input);
+      utf8_vec special_cases = check_special_cases(input, prev1);
+      c.error = vor(c.error,
+                    check_multibyte_lengths(input, c.prev_input, special_cases));
+      c.prev_input = input;
+    }
+    c.prev_incomplete = is_incomplete(c.prev_input);
+  }
+}
+
+// were all the blocks checked valid, leaving aside a sequence the last one
+// might have left unfinished?
+really_inline bool utf8_valid(const utf8_checker &c) {
+  return !any(c.error);
+}
@@ -0,0 +1,86 @@
+#include <string>
+
+#include "bitmap_index.h"
+#include "check.h"
+#include "simd_kernels.h"
+using namespace std;
+
+// BitmapIndex must give the separators and rows of find_indexes, and
+// field(row, col) the bytes BasicParsedCSV::field gives, with every kernel:
+// rank and select across the 64-bit words and the 512-byte steps of the
+// rank directory, a final record without a line ending (closed at the end
+// of the data, on a word boundary or not), CR-LF. Besides the usual inputs,
+// rows of about a word, and rows of several words.
+//
+// check_bitmap_index [<csvfile>...]
+
+static void check(const string &input, const string &data,
+                  const Dialect &dialect) {
+  Indexed ref(data, dialect);
+  const ParsedCSV &pcsv = ref.pcsv;
+  const Kernel *saved = active_kernel;
+  for (const Kernel *k : all_kernels()) {
+    if (!k->supported()) {
+      continue;
+    }
+    active_kernel = k;
+    string what = string(k->name) + " kernel";
+    BitmapIndex index;
+    index.build(ref.buf.data(), ref.buf.padded_size(), dialect);
+    if (index.n_separators() != pcsv.n_indexes || index.n_rows() != pcsv.n_rows) {
+      fail(input, what + ": not the same rows");
+      continue;
+    }
+    for (uint64_t i = 0; i < pcsv.n_fields(); i++) {
+      if (index.separator(i) != pcsv.indexes[i] ||
+          index.separators_before(pcsv.indexes[i]) != i) {
+        fail(input, what + ": separator " + to_string(i) + " is not the same");
+        break;
+      }
+    }
+    for (uint32_t r = 0; r < pcsv.n_rows; r++) {
+      bool same = index.row_begin(r) == pcsv.row_offsets[r] &&
+                  index.row_fields(r) == pcsv.row_fields(r) &&
+                  index.row_end(r) == pcsv.indexes[pcsv.row_offsets[r + 1] - 1];
+      for (uint32_t m = 0; same && m < pcsv.row_fields(r); m++) {
+        uint32_t start, end;
+        pcsv.field(r, m, start, end);
+        uint64_t found_start, found_end;
+        index.field(r, m, found_start, found_end);
+        same = found_start == start && found_end == end;
+      }
+      if (!same) {
+        fail(input, what + ": row " + to_string(r) + " is not the same");
+        break;
+      }
+    }
+  }
+  active_kernel = saved;
+}
+
+int main(int argc, char *argv[]) {
+  size_t n_inputs = check_inputs(argc, argv, check);
+  Dialect crlf;
+  crlf.crlf = true;
+  // rows of 50 to 80 bytes, some across a word boundary and some within a
+  // word; then rows of 100 to 700 bytes, across several words
+  for (size_t width : {50, 80, 100, 700}) {
+    string rows;
+    for (size_t i = 0; rows.size() < 5000; i++) {
+      string row = string(width - 10 + i % 20, 'a');
+      row[row.size() / 3] = ',';
+      row[row.size() / 2] = ',';
+      rows += row + "\n";
+    }
+    string name = "rows of about " + to_string(width) + " bytes";
+    // the last record ending anywhere in the last word, or on its boundary
+    for (size_t cut : {0, 1, 2, 30, 63, 64, 65}) {
+      string data = rows.substr(0, ROUNDUP_N(rows.size() - 200, 64) + cut);
+      string suffix = ", " + to_string(data.size()) + " bytes";
+      check(name + suffix, data, Dialect());
+      check(name + suffix + ", CR-LF", with_crlf(data), crlf);
+      n_inputs += 2;
+    }
+  }
+  return report(n_inputs);
+}
@@ -0,0 +1,211 @@
+#ifndef SIMDCSV_CHECK_H
+#define SIMDCSV_CHECK_H
+
+#include <unistd.h> // for mkstemp, write, close
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "csv_defs.h"
+#include "decompress.h"
+#include "dialect.h"
+#include "find_indexes.h"
+#include "io_util.h"
+#include "mem_util.h"
+#include "synthetic.h"
+
+// What the programs of tests/ share. Each is a ctest of its own (see
+// CMakeLists.txt), run on the files of examples/: it reports what fails on
+// standard error and exits non-zero if anything did.
+
+inline size_t &failures() {
+  static size_t n = 0;
+  return n;
+}
+
+inline void fail(const std::string &input, const std::string &what) {
+  std::cerr << input << ": " << what << std::endl;
+  failures()++;
+}
+
+// the summary line, and the exit status
+inline int report(size_t n_inputs) {
+  std::cout << n_inputs << " inputs, " << failures() << " failures" << std::endl;
+  return failures() == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// a copy of the bytes followed by CSV_PADDING zero bytes, as get_corpus
+// gives them
+class Padded {
+public:
+  explicit Padded(const std::string &data) : len(data.size()) {
+    buf = allocate_padded_buffer(len, CSV_PADDING);
+    if (buf == nullptr) {
+      throw std::runtime_error("could not allocate memory");
+    }
+    memcpy(buf, data.data(), len);
+    memset(buf + len, 0, CSV_PADDING);
+  }
+  ~Padded() { aligned_free(buf); }
+  Padded(const Padded &) = delete;
+  Padded &operator=(const Padded &) = delete;
+
+  uint8_t *data() const { return buf; }
+  size_t size() const { return len; }                       // the data
+  size_t padded_size() const { return len + CSV_PADDING; }  // what find_indexes takes
+
+private:
+  uint8_t *buf;
+  size_t len;
+};
+
+// the input indexed with its rows, by find_indexes: what the other ways of
+// reading it are checked against
+struct Indexed {
+  Indexed(const std::string &data, const Dialect &dialect)
+      : buf(data), indexes(buf.padded_size()),
+        row_offsets(buf.padded_size() + 1) {
+    pcsv.indexes = indexes.data();
+    pcsv.row_offsets = row_offsets.data();
+    find_indexes(buf.data(), buf.padded_size(), pcsv, dialect);
+  }
+
+  // the bytes of field m of row r, quotes and all, for m < row_fields(r)
+  std::string field(uint32_t r, uint32_t m) const {
+    uint32_t start, end;
+    pcsv.field(r, m, start, end);
+    return std::string(reinterpret_cast<const char *>(buf.data()) + start,
+                       end - start);
+  }
+
+  Padded buf;
+  std::vector<uint32_t> indexes;
+  std::vector<uint32_t> row_offsets;
+  ParsedCSV pcsv;
+};
+
+// the bytes of a string, as a ByteSource
+class StringSource : public ByteSource {
+public:
+  explicit StringSource(const std::string &s_in) : s(s_in) {}
+  size_t read(uint8_t *out, size_t len) override {
+    size_t n = std::min(len, s.size() - pos);
+    memcpy(out, s.data() + pos, n);
+    pos += n;
+    return n;
+  }
+  uint64_t bytes_in() const override { return pos; }
+
+private:
+  const std::string &s;
+  size_t pos{0};
+};
+
+// the bytes of a string in a temporary file, removed with the object
+class TempFile {
+public:
+  explicit TempFile(const std::string &data) {
+    char name[] = "/tmp/simdcsv_check_XXXXXX";
+    int fd = mkstemp(name);
+    if (fd == -1) {
+      throw std::runtime_error("could not create a temporary file");
+    }
+    bool written = data.empty() || write(fd, data.data(), data.size()) ==
+                                       static_cast<ssize_t>(data.size());
+    close(fd);
+    path = name;
+    if (!written) {
+      remove(path.c_str());
+      throw std::runtime_error("could not write a temporary file");
+    }
+  }
+  ~TempFile() { remove(path.c_str()); }
+  TempFile(const TempFile &) = delete;
+  TempFile &operator=(const TempFile &) = delete;
+
+  std::string path;
+};
+
+inline std::string load_file(const char *path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    throw std::runtime_error(std::string("could not load the file ") + path);
+  }
+  std::stringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+// the same, with CR-LF line endings
+inline std::string with_crlf(const std::string &s) {
+  std::string out;
+  for (char c : s) {
+    if (c == '\n') {
+      out += '\r';
+    }
+    out += c;
+  }
+  return out;
+}
+
+// synthetic inputs, named: sizes around the 64-byte blocks, line endings
+// within quotes, a last record without a line ending
+inline std::vector<std::pair<std::string, std::string>> edge_inputs() {
+  std::vector<std::pair<std::string, std::string>> inputs = {
+      {"empty", ""}, {"1 byte", "a"}, {"1 line ending", "\n"}};
+  for (size_t n : {63, 64, 65, 127, 128, 129}) {
+    // fields of one byte, then the line ending at byte n - 1
+    std::string fields;
+    for (size_t i = 0; i + 1 < n; i++) {
+      fields += i % 2 == 0 ? 'x' : ',';
+    }
+    std::string quoted = "\"" + std::string(n - 3, 'q') + "\"";
+    quoted[n / 2] = '\n'; // a line ending within the quotes
+    quoted[n / 3] = ',';
+    for (const std::string &s : {fields, quoted}) {
+      std::string name =
+          std::to_string(n) + (s == fields ? " bytes" : " bytes, quoted");
+      inputs.push_back({name, s + "\n"});
+      inputs.push_back({name + ", no line ending", s});
+      inputs.push_back({name + ", two rows, no line ending", s + "\n" + s});
+    }
+  }
+  CorpusSpec spec;
+  spec.quoted = 0.3;
+  spec.newlines = 0.3;
+  spec.size = 200000;
+  std::string corpus = generate_corpus(spec);
+  inputs.push_back({"synthetic", corpus});
+  inputs.push_back({"synthetic, no line ending",
+                    corpus.substr(0, corpus.size() - 1)});
+  return inputs;
+}
+
+// check(name, data, dialect) on the files given, then on the synthetic
+// inputs with LF and with CR-LF line endings; the number of inputs
+template <typename F>
+size_t check_inputs(int argc, char *argv[], F check) {
+  for (int i = 1; i < argc; i++) {
+    check(argv[i], load_file(argv[i]), Dialect());
+  }
+  size_t n_inputs = argc - 1;
+  Dialect crlf;
+  crlf.crlf = true;
+  for (const auto &input : edge_inputs()) {
+    check(input.first, input.second, Dialect());
+    check(input.first + ", CR-LF", with_crlf(input.second), crlf);
+    n_inputs += 2;
+  }
+  return n_inputs;
+}
+
+#endif
@@ -0,0 +1,114 @@
+#include <string>
+#include <vector>
+
+#include "arena.h"
+#include "check.h"
+#include "columnar.h"
+#include "simd_kernels.h"
+#include "unescape.h"
+using namespace std;
+
+// find_columns must give, for each column of the first record and each row,
+// the contents unescape_field gives for the field of BasicParsedCSV::field,
+// or a null for a row too short to have it; with every kernel, with int32_t
+// and int64_t offsets. The buffers are reused from a call on a longer input
+// first, and must still be zero from their ends up to the next multiple of
+// 64 bytes.
+//
+// check_columnar [<csvfile>...]
+
+// a longer input, with long fields and doubled quotes, to leave bytes in
+// the buffers past where the next call ends them
+static string dirty() {
+  string s;
+  for (size_t r = 0; r < 500; r++) {
+    s += string(r % 97, 'x') + ",\"y\"\"" + string(r % 31, 'y') + "\",z,w,v\n";
+  }
+  return s;
+}
+
+// whether the n elements of b are followed by zero bytes up to a multiple
+// of 64 bytes
+template <typename T>
+static bool zero_padded(const ArrowBuffer<T> &b) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(b.data());
+  size_t n = b.size() * sizeof(T);
+  for (size_t i = n; i < ROUNDUP_N(n, 64); i++) {
+    if (p[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename offset_t>
+static void check_columns(const string &input, const string &what,
+                          const Indexed &ref, const Dialect &dialect,
+                          BasicColumnarCSV<offset_t> &out) {
+  const ParsedCSV &pcsv = ref.pcsv;
+  const uint8_t *buf = ref.buf.data();
+  Padded previous(dirty());
+  find_columns(previous.data(), previous.padded_size(), out, dialect);
+  if (!find_columns(buf, ref.buf.padded_size(), out, dialect)) {
+    fail(input, what + ": the offsets do not fit");
+    return;
+  }
+  size_t width = pcsv.n_rows == 0 ? 0 : pcsv.row_fields(0);
+  if (out.n_rows != pcsv.n_rows || out.columns.size() != width) {
+    fail(input, what + ": not the same rows and columns");
+    return;
+  }
+  Arena arena;
+  for (size_t m = 0; m < width; m++) {
+    const BasicStringColumn<offset_t> &c = out.columns[m];
+    if (!zero_padded(c.validity) || !zero_padded(c.offsets) ||
+        !zero_padded(c.data)) {
+      fail(input, what + ": column " + to_string(m) + " is not zero-padded");
+    }
+    size_t nulls = 0;
+    for (uint32_t r = 0; r < pcsv.n_rows; r++) {
+      bool same;
+      if (m < pcsv.row_fields(r)) {
+        uint32_t start, end;
+        pcsv.field(r, m, start, end);
+        same = c.is_valid(r) &&
+               c.value(r) == unescape_field(buf, start, end, dialect.quote, arena);
+      } else {
+        same = !c.is_valid(r) && c.value(r).empty();
+        nulls++;
+      }
+      if (!same) {
+        fail(input, what + ": row " + to_string(r) + ", column " +
+                        to_string(m) + " is not the same");
+        break; // one is enough
+      }
+    }
+    if (c.null_count != nulls) {
+      fail(input, what + ": column " + to_string(m) + " has " +
+                      to_string(c.null_count) + " nulls, not " +
+                      to_string(nulls));
+    }
+  }
+}
+
+static void check(const string &input, const string &data,
+                  const Dialect &dialect) {
+  Indexed ref(data, dialect);
+  ColumnarCSV out;
+  ColumnarCSV64 out64;
+  const Kernel *saved = active_kernel;
+  for (const Kernel *k : all_kernels()) {
+    if (!k->supported()) {
+      continue;
+    }
+    active_kernel = k;
+    check_columns(input, string(k->name) + " kernel", ref, dialect, out);
+    check_columns(input, string(k->name) + " kernel, int64_t offsets", ref,
+                  dialect, out64);
+  }
+  active_kernel = saved;
+}
+
+int main(int argc, char *argv[]) {
+  return report(check_inputs(argc, argv, check));
+}
@@ -0,0 +1,293 @@
+#include <unistd.h> // for mkstemp, close
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef SIMDCSV_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "check.h"
+#include "count_fields.h"
+#include "parallel_indexer.h"
+#include "simd_kernels.h"
+#include "split_point.h"
+#include "stream_parser.h"
+using namespace std;
+
+// The ways of indexing an input must all agree with find_indexes over the
+// padded input, the reference: find_indexes_unpadded, every kernel with
+// every flattener it has (with and without the checks), the parallel
+// indexer, count_fields, the pieces between split points, and StreamParser,
+// over the file as it is and gzip compressed. Run over the files given and
+// over synthetic inputs: sizes around the 64-byte blocks, a last record
+// without a line ending, CR-LF.
+//
+// check_consistency [<csvfile>...]
+
+// the reference: the separators, and the row structure with its virtual
+// last index (see BasicParsedCSV)
+struct Reference {
+  vector<uint64_t> indexes; // n_fields of them
+  vector<uint64_t> row_offsets;
+  size_t n_indexes;
+  size_t n_rows;
+};
+
+template <typename index_t>
+static bool same_rows(const Reference &ref, const BasicParsedCSV<index_t> &pcsv,
+                      size_t shift = 0) {
+  if (pcsv.n_indexes != ref.n_indexes || pcsv.n_rows != ref.n_rows ||
+      pcsv.n_fields() != ref.indexes.size()) {
+    return false;
+  }
+  for (size_t k = 0; k < ref.indexes.size(); k++) {
+    if (pcsv.indexes[k] + shift != ref.indexes[k]) {
+      return false;
+    }
+  }
+  for (size_t r = 0; r <= ref.n_rows; r++) {
+    if (pcsv.row_offsets[r] != ref.row_offsets[r]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename index_t>
+static bool same_indexes(const Reference &ref, const index_t *indexes,
+                         size_t n_indexes) {
+  if (n_indexes != ref.n_indexes) {
+    return false;
+  }
+  for (size_t k = 0; k < n_indexes; k++) {
+    if (indexes[k] != ref.indexes[k]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void check_kernels(const string &input, const uint8_t *buf, size_t len,
+                          const Dialect &dialect, const Reference &ref) {
+  const Kernel *saved = active_kernel;
+  Flattener saved_flattener = active_flattener;
+  vector<uint32_t> indexes(len + CSV_PADDING);
+  vector<uint32_t> row_offsets(len + CSV_PADDING + 1);
+  for (const Kernel *k : all_kernels()) {
+    if (!k->supported()) {
+      continue;
+    }
+    active_kernel = k;
+    for (unsigned f = 0; f < N_FLATTENERS; f++) {
+      if (f != FLATTEN_UNROLLED && !(k->flatteners & (1u << f))) {
+        continue;
+      }
+      active_flattener = Flattener(f);
+      ParsedCSV pcsv;
+      pcsv.indexes = indexes.data();
+      find_indexes(buf, len + CSV_PADDING, pcsv, dialect);
+      if (!same_indexes(ref, indexes.data(), pcsv.n_indexes)) {
+        fail(input, string(k->name) + " kernel, " + flattener_name(Flattener(f)) +
+                        " flattener: not the same separators");
+      }
+    }
+    active_flattener = FLATTEN_UNROLLED;
+    ParsedCSV pcsv;
+    pcsv.indexes = indexes.data();
+    pcsv.row_offsets = row_offsets.data();
+    find_indexes(buf, len + CSV_PADDING, pcsv, dialect);
+    if (!same_rows(ref, pcsv)) {
+      fail(input, string(k->name) + " kernel: not the same rows");
+    }
+    ParsedCSV checked;
+    checked.indexes = indexes.data();
+    checked.validate_utf8 = checked.strict = true;
+    find_indexes(buf, len + CSV_PADDING, checked, dialect);
+    if (!same_indexes(ref, indexes.data(), checked.n_indexes)) {
+      fail(input, string(k->name) + " kernel, checked: not the same separators");
+    }
+  }
+  active_kernel = saved;
+  active_flattener = saved_flattener;
+}
+
+static void check_unpadded(const string &input, const uint8_t *buf, size_t len,
+                           const Dialect &dialect, const Reference &ref) {
+  // exactly len bytes, so that a sanitizer catches any read past them
+  uint8_t *data = new uint8_t[len == 0 ? 1 : len];
+  memcpy(data, buf, len);
+  vector<uint32_t> indexes(len + CSV_PADDING);
+  vector<uint32_t> row_offsets(len + CSV_PADDING + 1);
+  ParsedCSV pcsv;
+  pcsv.indexes = indexes.data();
+  pcsv.row_offsets = row_offsets.data();
+  find_indexes_unpadded(data, len, pcsv, dialect);
+  if (!same_rows(ref, pcsv)) {
+    fail(input, "find_indexes_unpadded: not the same rows");
+  }
+  delete[] data;
+}
+
+static void check_parallel(const string &input, const uint8_t *buf, size_t len,
+                           const Dialect &dialect, const Reference &ref) {
+  vector<uint32_t> indexes(len + CSV_PADDING);
+  vector<uint32_t> row_offsets(len + CSV_PADDING + 1);
+  for (size_t threads : {2, 4}) {
+    ParallelIndexer indexer(threads);
+    ParsedCSV pcsv;
+    pcsv.indexes = indexes.data();
+    pcsv.row_offsets = row_offsets.data();
+    indexer.find_indexes(buf, len + CSV_PADDING, pcsv, dialect);
+    if (!same_rows(ref, pcsv)) {
+      fail(input, to_string(threads) + " threads: not the same rows");
+    }
+  }
+}
+
+static void check_counts(const string &input, const uint8_t *buf, size_t len,
+                         const Dialect &dialect, const Reference &ref) {
+  CsvCounts counts;
+  count_fields(buf, len + CSV_PADDING, counts, dialect);
+  if (counts.n_separators != ref.n_indexes || counts.n_rows != ref.n_rows ||
+      counts.n_fields() != ref.indexes.size()) {
+    fail(input, "count_fields: not the same counts");
+  }
+}
+
+static void check_splits(const string &input, const uint8_t *buf, size_t len,
+                         const Dialect &dialect, const Reference &ref) {
+  vector<uint32_t> indexes(len + CSV_PADDING);
+  vector<uint32_t> row_offsets(len + CSV_PADDING + 1);
+  for (size_t n_pieces : {2, 3, 7}) {
+    // the split points, with a look-back short enough not to reach the
+    // start of a larger input
+    vector<size_t> splits = {0};
+    for (size_t i = 1; i < n_pieces; i++) {
+      SplitPoint sp = find_split_point(buf, len + CSV_PADDING, len * i / n_pieces,
+                                       dialect, 4096, len);
+      if (sp.confidence != SPLIT_NONE && sp.offset > splits.back()) {
+        splits.push_back(sp.offset);
+      }
+    }
+    if (splits.back() != len) {
+      splits.push_back(len);
+    }
+    // the pieces, each indexed on its own, end to end
+    Reference whole;
+    whole.n_indexes = whole.n_rows = 0;
+    whole.row_offsets = {0};
+    for (size_t i = 0; i + 1 < splits.size(); i++) {
+      ParsedCSV piece;
+      piece.indexes = indexes.data();
+      piece.row_offsets = row_offsets.data();
+      find_indexes_unpadded(buf + splits[i], splits[i + 1] - splits[i], piece,
+                            dialect);
+      for (size_t k = 0; k < piece.n_fields(); k++) {
+        whole.indexes.push_back(indexes[k] + splits[i]);
+      }
+      for (size_t r = 1; r <= piece.n_rows; r++) {
+        whole.row_offsets.push_back(whole.n_indexes + row_offsets[r]);
+      }
+      whole.n_indexes += piece.n_indexes;
+      whole.n_rows += piece.n_rows;
+    }
+    if (whole.indexes != ref.indexes || whole.row_offsets != ref.row_offsets ||
+        whole.n_indexes != ref.n_indexes || whole.n_rows != ref.n_rows) {
+      fail(input, to_string(n_pieces) + " pieces: not the same rows");
+    }
+  }
+}
+
+// the separators StreamParser finds in the bytes of source, windows of
+// window bytes at a time
+static vector<uint64_t> stream_indexes(ByteSource &source, size_t window,
+                                       const Dialect &dialect) {
+  vector<uint64_t> found;
+  StreamParser parser(window, [&](const IndexBatch &batch) {
+    for (uint32_t i = 0; i < batch.n_indexes; i++) {
+      found.push_back(batch.base + batch.indexes[i]);
+    }
+  }, dialect);
+  vector<uint8_t> chunk(1000); // not a multiple of the windows
+  size_t n;
+  while ((n = source.read(chunk.data(), chunk.size())) > 0) {
+    parser.feed(chunk.data(), n);
+  }
+  parser.finish();
+  return found;
+}
+
+static void check_stream(const string &input, const string &data,
+                         const Dialect &dialect, const Reference &ref) {
+  vector<uint64_t> expected(ref.indexes.begin(),
+                            ref.indexes.begin() + ref.n_indexes);
+  for (size_t window : {64, 192, 1 << 16}) {
+    StringSource source(data);
+    if (stream_indexes(source, window, dialect) != expected) {
+      fail(input, "stream, " + to_string(window) + "-byte windows: not the same separators");
+    }
+  }
+#ifdef SIMDCSV_HAVE_ZLIB
+  char path[] = "/tmp/simdcsv_check_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd == -1) {
+    fail(input, "could not create a temporary file");
+    return;
+  }
+  gzFile gz = gzdopen(fd, "wb");
+  bool written = gz != nullptr &&
+                 (data.empty() || gzwrite(gz, data.data(), data.size()) > 0);
+  if (gz == nullptr || gzclose(gz) != Z_OK || !written) {
+    fail(input, "could not write the gzip file");
+    remove(path);
+    return;
+  }
+  try {
+    unique_ptr<ByteSource> source = open_source(path);
+    if (detect_compression(path) != COMPRESSION_GZIP ||
+        stream_indexes(*source, 1 << 16, dialect) != expected) {
+      fail(input, "gzip stream: not the same separators");
+    }
+  } catch (const std::exception &e) {
+    fail(input, string("gzip stream: ") + e.what());
+  }
+  remove(path);
+#endif
+}
+
+static void check(const string &input, const string &data,
+                  const Dialect &dialect) {
+  Padded padded(data);
+  uint8_t *buf = padded.data();
+  size_t len = padded.size();
+  vector<uint64_t> indexes(len + CSV_PADDING);
+  vector<uint64_t> row_offsets(len + CSV_PADDING + 1);
+  ParsedCSV64 pcsv;
+  pcsv.indexes = indexes.data();
+  pcsv.row_offsets = row_offsets.data();
+  find_indexes(buf, len + CSV_PADDING, pcsv, dialect);
+  Reference ref;
+  ref.indexes.assign(indexes.begin(), indexes.begin() + pcsv.n_fields());
+  ref.row_offsets.assign(row_offsets.begin(), row_offsets.begin() + pcsv.n_rows + 1);
+  ref.n_indexes = pcsv.n_indexes;
+  ref.n_rows = pcsv.n_rows;
+  // a last record without a line ending is a row (the inputs are all
+  // well-formed: the last byte is not within quotes)
+  if ((len > 0 && data[len - 1] != '\n') != pcsv.last_row_open()) {
+    fail(input, "the last record is not closed at the end of the data");
+  }
+
+  check_kernels(input, buf, len, dialect, ref);
+  check_unpadded(input, buf, len, dialect, ref);
+  check_parallel(input, buf, len, dialect, ref);
+  check_counts(input, buf, len, dialect, ref);
+  check_splits(input, buf, len, dialect, ref);
+  check_stream(input, data, dialect, ref);
+}
+
+int main(int argc, char *argv[]) {
+  return report(check_inputs(argc, argv, check));
+}
@@ -0,0 +1,86 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "csv_parser.h"
+using namespace std;
+
+// CsvParser must give the index of find_indexes, with and without the rows
+// and with and without huge pages (whose buffers must then be aligned to
+// 2 MiB), from parse, parse_in_place and parse_file. The parsers are kept
+// from one input to the next, as they are meant to be, so that the inputs
+// are parsed into buffers a larger or smaller one had before.
+//
+// check_csv_parser [<csvfile>...]
+
+static bool same_index(const Indexed &ref, const ParsedCSV &pcsv,
+                       bool with_rows) {
+  const ParsedCSV &expected = ref.pcsv;
+  if (pcsv.n_indexes != expected.n_indexes) {
+    return false;
+  }
+  for (size_t k = 0; k < pcsv.n_indexes; k++) {
+    if (pcsv.indexes[k] != expected.indexes[k]) {
+      return false;
+    }
+  }
+  if (!with_rows) {
+    return pcsv.row_offsets == nullptr;
+  }
+  if (pcsv.n_rows != expected.n_rows || pcsv.n_fields() != expected.n_fields()) {
+    return false;
+  }
+  for (size_t r = 0; r <= pcsv.n_rows; r++) {
+    if (pcsv.row_offsets[r] != expected.row_offsets[r]) {
+      return false;
+    }
+  }
+  // the virtual last index of a last row without a line ending
+  return !pcsv.last_row_open() ||
+         pcsv.indexes[pcsv.n_indexes] == expected.indexes[expected.n_indexes];
+}
+
+static void check(const string &input, const string &data,
+                  const Dialect &dialect) {
+  static CsvParser parsers[] = {CsvParser(false, false), CsvParser(true, false),
+                                CsvParser(false, true), CsvParser(true, true)};
+  Indexed ref(data, dialect);
+  TempFile file(data);
+  basic_string_view<uint8_t> bytes(
+      reinterpret_cast<const uint8_t *>(data.data()), data.size());
+  for (size_t i = 0; i < 4; i++) {
+    CsvParser &parser = parsers[i];
+    bool with_rows = i % 2 == 1, huge_pages = i >= 2;
+    string what = string(with_rows ? "rows" : "no rows") +
+                  (huge_pages ? ", huge pages" : "");
+    auto expect = [&](const string &how, bool ok) {
+      if (!ok) {
+        fail(input, what + ", " + how + ": the input is too large");
+      } else if (parser.size() != data.size() ||
+                 string(reinterpret_cast<const char *>(parser.data()),
+                        parser.size()) != data) {
+        fail(input, what + ", " + how + ": not the bytes of the input");
+      } else if (!same_index(ref, parser.index(), with_rows)) {
+        fail(input, what + ", " + how + ": not the same index");
+      }
+    };
+    expect("parse", parser.parse(bytes, dialect));
+    const uintptr_t huge = uintptr_t(2) << 20;
+    if (huge_pages &&
+        (reinterpret_cast<uintptr_t>(parser.data()) % huge != 0 ||
+         reinterpret_cast<uintptr_t>(parser.index().indexes) % huge != 0)) {
+      fail(input, what + ": the buffers are not aligned to 2 MiB");
+    }
+    expect("parse_file", parser.parse_file(file.path, dialect));
+    // exactly the bytes of the input, so that a sanitizer catches any read
+    // past them
+    vector<uint8_t> exact(data.begin(), data.end());
+    expect("parse_in_place",
+           parser.parse_in_place({exact.data(), exact.size()}, dialect));
+  }
+}
+
+int main(int argc, char *argv[]) {
+  return report(check_inputs(argc, argv, check));
+}
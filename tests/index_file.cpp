@@ -0,0 +1,143 @@
+#include <fcntl.h>    // for AT_FDCWD
+#include <sys/stat.h> // for utimensat
+
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "index_file.h"
+#include "stream_parser.h"
+using namespace std;
+
+// The persistent index of -x, built as main builds it (the batches of a
+// StreamParser with their record ends, through an IndexFileWriter) with a
+// few window sizes, must reopen with the rows of find_indexes: every field
+// of every row, and first_row_at for byte offsets all over the data. It
+// must be refused once stale: the CSV file with another modification time,
+// other contents of the same size, or another dialect.
+//
+// check_index_file [<csvfile>...]
+
+// the data in a temporary file, and its index file next to it
+struct TempCsv : TempFile {
+  explicit TempCsv(const string &data)
+      : TempFile(data), index_path(path + ".idx") {}
+  ~TempCsv() { remove(index_path.c_str()); }
+
+  string index_path;
+};
+
+static void write_index(const TempCsv &csv, const Padded &buf, size_t window,
+                        const Dialect &dialect) {
+  IndexFileWriter writer;
+  StreamParser parser(window, [&](const IndexBatch &batch) {
+    for (uint32_t i = 0; i < batch.n_indexes; i++) {
+      writer.add(batch.base + batch.indexes[i], batch.is_record_end(i));
+    }
+  }, dialect, 0, true);
+  // fed in pieces that are not a multiple of the window
+  for (size_t i = 0; i < buf.size(); i += 1000) {
+    parser.feed(buf.data() + i, min<size_t>(1000, buf.size() - i));
+  }
+  parser.finish();
+  writer.write(csv.index_path, csv.path, buf.data(), buf.size(), dialect);
+}
+
+static void check_rows(const string &input, const string &what,
+                       const Indexed &ref, const IndexFile &index) {
+  const ParsedCSV &pcsv = ref.pcsv;
+  if (index.n_rows() != pcsv.n_rows || index.n_indexes() != pcsv.n_indexes ||
+      index.last_row_open() != pcsv.last_row_open()) {
+    fail(input, what + ": not the same rows");
+    return;
+  }
+  vector<uint64_t> row_starts;
+  for (uint32_t r = 0; r < pcsv.n_rows; r++) {
+    if (index.row_fields(r) != pcsv.row_fields(r)) {
+      fail(input, what + ": row " + to_string(r) + " has not the same fields");
+      return;
+    }
+    for (uint32_t m = 0; m < pcsv.row_fields(r); m++) {
+      uint32_t start, end;
+      pcsv.field(r, m, start, end);
+      uint64_t found_start, found_end;
+      index.field(r, m, found_start, found_end);
+      if (found_start != start || found_end != end) {
+        fail(input, what + ": row " + to_string(r) + ", field " +
+                        to_string(m) + " is not the same");
+        return;
+      }
+    }
+    uint32_t start, end;
+    pcsv.field(r, 0, start, end);
+    row_starts.push_back(start);
+  }
+  size_t len = ref.buf.size();
+  size_t step = max<size_t>(1, len / 5000);
+  for (size_t offset = 0; offset <= len + 1; offset += step) {
+    size_t expected = lower_bound(row_starts.begin(), row_starts.end(), offset) -
+                      row_starts.begin();
+    if (index.first_row_at(offset) != expected) {
+      fail(input, what + ": the first row at " + to_string(offset) + " is " +
+                      to_string(index.first_row_at(offset)) + ", not " +
+                      to_string(expected));
+      return;
+    }
+  }
+}
+
+static void check(const string &input, const string &data,
+                  const Dialect &dialect) {
+  Indexed ref(data, dialect);
+  const Padded &buf = ref.buf;
+  TempCsv csv(data);
+  for (size_t window : {64, 192, 1 << 16}) {
+    string what = to_string(window) + "-byte windows";
+    write_index(csv, buf, window, dialect);
+    IndexFile index;
+    if (!index.open(csv.index_path, csv.path, buf.data(), buf.size(), dialect)) {
+      fail(input, what + ": the index does not reopen");
+      continue;
+    }
+    check_rows(input, what, ref, index);
+  }
+
+  // stale: other contents of the same size (the hash), another dialect,
+  // another modification time
+  if (!data.empty()) {
+    Padded other(string(1, data[0] == 'z' ? 'y' : 'z') + data.substr(1));
+    IndexFile index;
+    if (index.open(csv.index_path, csv.path, other.data(), other.size(),
+                   dialect)) {
+      fail(input, "the index of other contents is taken");
+    }
+  }
+  Dialect semicolon = dialect;
+  semicolon.delimiter = ';';
+  IndexFile other_dialect;
+  if (other_dialect.open(csv.index_path, csv.path, buf.data(), buf.size(),
+                         semicolon)) {
+    fail(input, "the index of another dialect is taken");
+  }
+  struct stat st;
+  if (stat(csv.path.c_str(), &st) != 0) {
+    fail(input, "could not stat the temporary file");
+    return;
+  }
+  struct timespec times[2] = {st.st_atim, st.st_mtim};
+  times[1].tv_sec -= 1;
+  if (utimensat(AT_FDCWD, csv.path.c_str(), times, 0) != 0) {
+    fail(input, "could not set the modification time");
+    return;
+  }
+  IndexFile older;
+  if (older.open(csv.index_path, csv.path, buf.data(), buf.size(), dialect)) {
+    fail(input, "the index of another modification time is taken");
+  }
+}
+
+int main(int argc, char *argv[]) {
+  return report(check_inputs(argc, argv, check));
+}
@@ -0,0 +1,230 @@
+#include <cerrno>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "number_parsing.h"
+using namespace std;
+
+// parse_int64 and parse_double must give what strtoll and strtod give, to
+// the bit, and reject what they do not read whole: 19- and 20-digit
+// integers around INT64_MIN and INT64_MAX, more than 19 significant digits,
+// runs of digits on either side of the 8-byte SWAR steps, exponents within
+// and beyond Clinger's fast path, subnormals, and decimals exactly halfway
+// between two doubles and next to them, for Eisel-Lemire. Every field of
+// the files given that either function takes is checked the same way.
+//
+// check_number_parsing [<csvfile>...]
+
+static size_t n_checked = 0;
+
+static string bits_name(double d) {
+  uint64_t bits;
+  memcpy(&bits, &d, 8);
+  char s[64];
+  snprintf(s, sizeof(s), "%.17g (0x%016" PRIx64 ")", d, bits);
+  return s;
+}
+
+static bool same_bits(double a, double b) { return memcmp(&a, &b, 8) == 0; }
+
+// the integer check on s; with strict, s must be what strtoll reads whole
+static void check_int(const string &input, const string &s, bool strict) {
+  Padded buf(s);
+  int64_t found = 0;
+  bool ok = parse_int64(buf.data(), buf.data() + s.size(), found);
+  errno = 0;
+  char *end;
+  long long expected = strtoll(s.c_str(), &end, 10);
+  bool whole = !s.empty() && s[0] != ' ' && end == s.c_str() + s.size() &&
+               errno == 0;
+  if (ok && !whole) {
+    fail(input, "parse_int64 takes \"" + s + "\", strtoll does not");
+  } else if (ok && found != expected) {
+    fail(input, "parse_int64 gives " + to_string(found) + " for \"" + s +
+                    "\", not " + to_string(expected));
+  } else if (!ok && whole && (strict || s[0] == '-' || s[0] == '+' ||
+                              (s[0] >= '0' && s[0] <= '9'))) {
+    fail(input, "parse_int64 does not take \"" + s + "\"");
+  }
+  n_checked++;
+}
+
+// the same for doubles: strtod reads more (spaces, inf, hexadecimal), so
+// only a number in the syntax of parse_double has to be taken
+static void check_double(const string &input, const string &s, bool valid) {
+  Padded buf(s);
+  double found = 0;
+  bool ok = parse_double(buf.data(), buf.data() + s.size(), found);
+  char *end;
+  double expected = strtod(s.c_str(), &end);
+  bool whole = !s.empty() && end == s.c_str() + s.size();
+  if (ok && !whole) {
+    fail(input, "parse_double takes \"" + s + "\", strtod does not");
+  } else if (ok && !same_bits(found, expected)) {
+    fail(input, "parse_double gives " + bits_name(found) + " for \"" + s +
+                    "\", not " + bits_name(expected));
+  } else if (!ok && valid) {
+    fail(input, "parse_double does not take \"" + s + "\"");
+  }
+  n_checked++;
+}
+
+static void check_fields(const string &input, const string &data) {
+  Indexed ref(data, Dialect());
+  for (uint32_t r = 0; r < ref.pcsv.n_rows; r++) {
+    for (uint32_t m = 0; m < ref.pcsv.row_fields(r); m++) {
+      string s = ref.field(r, m);
+      check_int(input, s, false);
+      check_double(input, s, false);
+    }
+  }
+}
+
+static string u64(uint64_t v) { return to_string(v); }
+
+int main(int argc, char *argv[]) {
+  size_t n_files = 0;
+  for (int i = 1; i < argc; i++, n_files++) {
+    check_fields(argv[i], load_file(argv[i]));
+  }
+
+  const char *integers[] = {
+      "0", "-0", "+0", "7", "-7", "+42", "12345678", "123456789",
+      "1234567812345678", "12345678123456781", "9223372036854775807",
+      "9223372036854775808", "-9223372036854775807", "-9223372036854775808",
+      "-9223372036854775809", "999999999999999999", "1000000000000000000",
+      "9999999999999999999", "10000000000000000000", "18446744073709551615",
+      "18446744073709551616", "99999999999999999999", "-99999999999999999999",
+      "00000000000000000000000000000001", "-0000000000000000000009223372036854775808",
+      "000000000000000000009223372036854775808", "", "-", "+", "--1", "+-1",
+      "1a", "a1", "1 ", "12345678a", "1.0", "1e3"};
+  for (const char *s : integers) {
+    check_int("integers", s, false);
+  }
+
+  const char *doubles[] = {
+      // Clinger's fast path, at its limits
+      "0", "-0", "1", "-1", "+1.5", "0.1", "1e22", "1e23", "1e-22", "1e-23",
+      "9007199254740992", "9007199254740993", "9007199254740992e22",
+      "9007199254740993e-22", "123.456e-7", "-8.25E+3", "5.", ".5", "-.5e1",
+      // digits across the 8-byte steps
+      "1.2345678", "12345678.9", "1234567.89012345678", "0.0000000012345678",
+      "12345678901234567.89",
+      // more than 19 digits, leading zeros aside or not
+      "0.00000000000000000000000000001234567890123456789",
+      "000000000000000000000000012345.6789",
+      "12345678901234567890", "1234567890123456789012345678901234567890",
+      "2.22507385850720113605740979670913197593481954635164564e-308",
+      "7.3177701707893310e+15", "9007199254740993.0000000000000000001",
+      "0.1000000000000000055511151231257827021181583404541015625",
+      "0.1000000000000000055511151231257827021181583404541015624",
+      "0.1000000000000000055511151231257827021181583404541015626",
+      // Eisel-Lemire, and its limits
+      "1.7976931348623157e308", "1.7976931348623158e308",
+      "1.7976931348623159e308", "1e309", "-1e400", "1e-400", "1e99999999999",
+      "1e-99999999999", "2.2250738585072011e-308", "2.2250738585072012e-308",
+      "2.2250738585072014e-308", "4.9406564584124654e-324",
+      "2.4703282292062327e-324", "2.4703282292062328e-324",
+      "7.4109846876186982e-324", "1e-320", "-3.5e-310",
+      "0.000000000000000000000000000000000000000000000000000000000001e-265",
+      "8.988465674311579e307", "4.4501477170144023e-308",
+      // not numbers
+      "", "-", "+", ".", "-.", "e5", "1e", "1e+", "1e-", "1.2.3", "1e5e5",
+      "1,5", " 1", "1 ", "inf", "nan", "0x10", "1d", "--1"};
+  for (const char *s : doubles) {
+    check_double("doubles", s, false);
+  }
+
+  mt19937_64 rng(2026);
+  // random integers of every length, and around the 8-byte steps
+  for (size_t i = 0; i < 200000; i++) {
+    uint64_t v = rng() >> (rng() % 64);
+    string s = (i % 3 == 0 ? "-" : "") + u64(v);
+    check_int("random integers", s, true);
+  }
+
+  // random decimals: 1 to 25 digits, a point anywhere, any exponent
+  for (size_t i = 0; i < 300000; i++) {
+    size_t n = 1 + rng() % 25;
+    string digits;
+    for (size_t j = 0; j < n; j++) {
+      digits += char('0' + rng() % 10);
+    }
+    size_t point = rng() % (n + 1);
+    string s = (rng() % 2 ? "-" : "") + digits.substr(0, point) + "." +
+               digits.substr(point);
+    switch (rng() % 3) {
+    case 0:
+      s += "e" + to_string(static_cast<int>(rng() % 40) - 20);
+      break;
+    case 1:
+      s += "E" + to_string(static_cast<int>(rng() % 700) - 350);
+      break;
+    }
+    check_double("random decimals", s, true);
+  }
+
+  // random doubles, normal and subnormal, with their shortest digits and
+  // with one digit less
+  for (size_t i = 0; i < 200000; i++) {
+    uint64_t bits = rng() & ~(1ULL << 63);
+    if (i % 4 == 0) {
+      bits &= (1ULL << 52) - 1; // subnormal
+    }
+    if ((bits >> 52) == 0x7FF) {
+      continue;
+    }
+    double d;
+    memcpy(&d, &bits, 8);
+    char s[64];
+    snprintf(s, sizeof(s), "%.17g", d);
+    check_double("random doubles", s, true);
+    snprintf(s, sizeof(s), "%.16e", d);
+    check_double("random doubles", s, true);
+    snprintf(s, sizeof(s), "%.15e", d);
+    check_double("random doubles", s, true);
+  }
+
+  // decimals exactly halfway between two doubles (an odd 54-bit mantissa)
+  // and one unit of their last digit either side: w e q with 5^q dividing
+  // the mantissa, and w e-k with w the mantissa times 5^k
+  for (size_t i = 0; i < 20000; i++) {
+    for (int q = 0; q <= 22; q++) {
+      uint64_t p = 1;
+      for (int j = 0; j < q; j++) {
+        p *= 5;
+      }
+      uint64_t lo = ((1ULL << 53) + p - 1) / p, hi = (1ULL << 54) / p;
+      if (lo >= hi) {
+        continue;
+      }
+      uint64_t r = (lo + rng() % (hi - lo)) | 1;
+      if (r >= hi) {
+        continue;
+      }
+      for (int64_t d : {-1, 0, 1}) {
+        check_double("halfway", u64(r + d) + "e" + to_string(q), true);
+      }
+    }
+    uint64_t o = ((1ULL << 53) + rng() % (1ULL << 53)) | 1;
+    uint64_t w = o;
+    for (int k = 1; k <= 4 && w <= UINT64_MAX / 5; k++) {
+      w *= 5;
+      if (w >= 10000000000000000000ULL) {
+        break;
+      }
+      for (int64_t d : {-1, 0, 1}) {
+        check_double("halfway", u64(w + d) + "e-" + to_string(k), true);
+      }
+    }
+  }
+
+  cout << n_checked << " numbers" << endl;
+  return report(n_files + 1);
+}
@@ -0,0 +1,62 @@
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "column_projection.h"
+#include "simd_kernels.h"
+using namespace std;
+
+// find_projected_indexes must give, for each selected column of each row,
+// the bytes BasicParsedCSV::field gives, and an empty field for a column
+// past the end of a short row; with every kernel, for a few projections.
+//
+// check_projection [<csvfile>...]
+
+static void check(const string &input, const string &data,
+                  const Dialect &dialect) {
+  Indexed ref(data, dialect);
+  const ParsedCSV &pcsv = ref.pcsv;
+  const uint8_t *buf = ref.buf.data();
+  const vector<vector<size_t>> projections = {
+      {0}, {1}, {0, 2}, {7, 3, 1, 3}, {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11}};
+  const Kernel *saved = active_kernel;
+  for (const Kernel *k : all_kernels()) {
+    if (!k->supported()) {
+      continue;
+    }
+    active_kernel = k;
+    for (const vector<size_t> &columns : projections) {
+      ColumnProjection proj(columns);
+      ProjectedCSV out;
+      find_projected_indexes(buf, ref.buf.padded_size(), proj, out, dialect);
+      string what = string(k->name) + " kernel, " + to_string(proj.size()) +
+                    " columns from " + to_string(proj.selected()[0]);
+      if (out.n_rows != pcsv.n_rows || out.width != proj.size()) {
+        fail(input, what + ": not the same rows");
+        continue;
+      }
+      for (uint32_t r = 0; r < out.n_rows; r++) {
+        for (size_t j = 0; j < out.width; j++) {
+          size_t col = proj.selected()[j];
+          uint32_t start = out.fields[2 * (r * out.width + j)];
+          uint32_t end = out.fields[2 * (r * out.width + j) + 1];
+          bool same = col < pcsv.row_fields(r)
+                          ? string(reinterpret_cast<const char *>(buf) + start,
+                                   end - start) == ref.field(r, col)
+                          : start == end;
+          if (!same) {
+            fail(input, what + ": row " + to_string(r) + ", column " +
+                            to_string(col) + " is not the same");
+            r = out.n_rows; // one is enough
+            break;
+          }
+        }
+      }
+    }
+  }
+  active_kernel = saved;
+}
+
+int main(int argc, char *argv[]) {
+  return report(check_inputs(argc, argv, check));
+}
@@ -0,0 +1,150 @@
+#include <string>
+#include <vector>
+
+#ifdef SIMDCSV_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "check.h"
+#include "read_pipeline.h"
+#include "stream_parser.h"
+using namespace std;
+
+// ReadPipeline must hand over the bytes a plain read of the file gives, in
+// order, in windows of whole 64-byte blocks but for the last, zeroed up to
+// its next block; and StreamParser fed those windows in place must find the
+// separators of find_indexes. With a few window sizes and ring sizes, over
+// the file as it is and gzip compressed. A file that does not exist is an
+// exception, and so is a gzip file cut short; trailing zeros or garbage
+// after gzip members are left out, and counted.
+//
+// check_read_pipeline [<csvfile>...]
+
+static void check_file(const string &input, const string &what,
+                       const char *path, const string &data,
+                       const Indexed &ref, const Dialect &dialect) {
+  for (size_t window : {64, 192, 1 << 16}) {
+    for (size_t n_buffers : {2, 3}) {
+      string name = what + to_string(window) + "-byte windows, " +
+                    to_string(n_buffers) + " buffers";
+      ReadPipeline pipeline(window, n_buffers);
+      string read;
+      bool blocks = true;
+      vector<uint32_t> found;
+      StreamParser parser(pipeline.window_size(), [&](const IndexBatch &batch) {
+        for (uint32_t i = 0; i < batch.n_indexes; i++) {
+          found.push_back(static_cast<uint32_t>(batch.base + batch.indexes[i]));
+        }
+      }, dialect);
+      uint64_t n;
+      try {
+        n = pipeline.run(path, [&](const uint8_t *buf, size_t len) {
+          // only the last window may end within a block, zeroed past it
+          if (read.size() % 64 != 0) {
+            blocks = false;
+          }
+          for (size_t i = len; i < ROUNDUP_N(len, 64); i++) {
+            blocks &= buf[i] == 0;
+          }
+          read.append(reinterpret_cast<const char *>(buf), len);
+          parser.feed_window(buf, len);
+        });
+        parser.finish();
+      } catch (const std::exception &e) {
+        fail(input, name + ": " + e.what());
+        continue;
+      }
+      if (n != data.size() || read != data) {
+        fail(input, name + ": not the bytes of the file");
+      } else if (!blocks) {
+        fail(input, name + ": a window is not whole blocks");
+      } else if (found != vector<uint32_t>(ref.indexes.begin(),
+                                           ref.indexes.begin() +
+                                               ref.pcsv.n_indexes)) {
+        fail(input, name + ": not the same separators");
+      }
+    }
+  }
+}
+
+#ifdef SIMDCSV_HAVE_ZLIB
+// the bytes of data as a gzip member
+static string gzip(const string &data) {
+  TempFile file("");
+  gzFile gz = gzopen(file.path.c_str(), "wb");
+  bool written = gz != nullptr &&
+                 (data.empty() || gzwrite(gz, data.data(), data.size()) > 0);
+  if (gz == nullptr || gzclose(gz) != Z_OK || !written) {
+    throw std::runtime_error("could not write the gzip file");
+  }
+  return load_file(file.path.c_str());
+}
+#endif
+
+static void check(const string &input, const string &data,
+                  const Dialect &dialect) {
+  Indexed ref(data, dialect);
+  TempFile plain(data);
+  check_file(input, "", plain.path.c_str(), data, ref, dialect);
+#ifdef SIMDCSV_HAVE_ZLIB
+  TempFile compressed(gzip(data));
+  check_file(input, "gzip, ", compressed.path.c_str(), data, ref, dialect);
+#endif
+}
+
+// the file at path must read as expected, garbage bytes left out after
+// it, or be an error if expected is null
+static void check_ends(const string &name, const char *path,
+                       const string *expected, uint64_t garbage) {
+  ReadPipeline pipeline(1 << 16);
+  string read;
+  try {
+    pipeline.run(path, [&](const uint8_t *buf, size_t len) {
+      read.append(reinterpret_cast<const char *>(buf), len);
+    });
+  } catch (const std::exception &e) {
+    if (expected != nullptr) {
+      fail(name, e.what());
+    }
+    return;
+  }
+  if (expected == nullptr) {
+    fail(name, "no exception");
+  } else if (read != *expected) {
+    fail(name, "not the bytes compressed");
+  } else if (pipeline.trailing_garbage() != garbage) {
+    fail(name, to_string(pipeline.trailing_garbage()) +
+                   " bytes of trailing garbage, not " + to_string(garbage));
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t n_inputs = check_inputs(argc, argv, check);
+  check_ends("a missing file", "/nonexistent/simdcsv_check.csv", nullptr, 0);
+  n_inputs++;
+#ifdef SIMDCSV_HAVE_ZLIB
+  const string data = edge_inputs().back().second;
+  const string member = gzip(data), twice = data + data;
+  const struct {
+    const char *name;
+    string file;
+    const string *expected;
+    uint64_t garbage;
+  } cases[] = {
+      {"two members", member + member, &twice, 0},
+      {"trailing zeros", member + member + string(1000, '\0'), &twice, 1000},
+      {"trailing garbage", member + "garbage\n", &data, 8},
+      {"a header cut short", member + "\x1f", &data, 1},
+      {"an invalid header", member + string("\x1f\x8b\x07\x00", 4), &data, 4},
+      {"a member cut short", member.substr(0, member.size() / 2), nullptr, 0},
+      {"a second member cut short", member + member.substr(0, 30), nullptr, 0},
+  };
+  for (const auto &c : cases) {
+    TempFile file(c.file);
+    check_ends(string("gzip, ") + c.name, file.path.c_str(), c.expected,
+               c.garbage);
+    n_inputs++;
+  }
+#endif
+  return report(n_inputs);
+}
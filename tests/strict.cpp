@@ -0,0 +1,188 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "parallel_indexer.h"
+#include "simd_kernels.h"
+#include "stream_parser.h"
+using namespace std;
+
+// Strict mode (-R) must report the same first structural error, its code,
+// byte offset and row, on every path: each kernel, find_indexes_unpadded,
+// the parallel indexer and StreamParser. Each malformed record is put after
+// a prefix of well-formed ones long enough for it to straddle a 64-byte
+// block, a 192-byte stream window and the chunks of the parallel indexer.
+// The files given are well-formed.
+//
+// check_strict [<csvfile>...]
+
+// where the second of two chunks of the parallel indexer starts, for an
+// input of n bytes (see BasicParallelIndexer::find_indexes)
+static size_t second_chunk(size_t n) { return ROUNDUP_N((n + 1) / 2, 64); }
+
+// n bytes of records of two fields, n / 6 of them (n is 0 or at least 6)
+static string records(size_t n, const Dialect &dialect) {
+  if (n == 0) {
+    return "";
+  }
+  const string row = dialect.crlf ? "aa,b\r\n" : "aa,bb\n";
+  string s = string(2 + n % 6, 'a') + row.substr(2);
+  for (size_t i = 1; i < n / 6; i++) {
+    s += row;
+  }
+  return s;
+}
+
+static string error_name(const StructureError &e) {
+  string name = csv_error_message(e.code);
+  if (e.code != CSV_OK) {
+    name += " at " + to_string(e.offset) + ", row " + to_string(e.row);
+  }
+  return name;
+}
+
+static bool same_error(const StructureError &a, const StructureError &b) {
+  return a.code == b.code &&
+         (a.code == CSV_OK || (a.offset == b.offset && a.row == b.row));
+}
+
+static void check(const string &input, const string &data,
+                  const Dialect &dialect, const StructureError &expected) {
+  Padded buf(data);
+  size_t len = buf.size();
+  vector<uint32_t> indexes(buf.padded_size());
+  vector<uint32_t> row_offsets(buf.padded_size() + 1);
+  auto expect = [&](const string &path, const StructureError &found,
+                    bool returned) {
+    if (!same_error(found, expected)) {
+      fail(input, path + ": " + error_name(found) + ", not " +
+                      error_name(expected));
+    } else if (returned != (expected.code == CSV_OK)) {
+      fail(input, path + ": the wrong return value");
+    }
+  };
+
+  const Kernel *saved = active_kernel;
+  for (const Kernel *k : all_kernels()) {
+    if (!k->supported()) {
+      continue;
+    }
+    active_kernel = k;
+    ParsedCSV pcsv;
+    pcsv.indexes = indexes.data();
+    pcsv.strict = true;
+    bool ok = find_indexes(buf.data(), buf.padded_size(), pcsv, dialect);
+    expect(string(k->name) + " kernel", pcsv.error, ok);
+    pcsv.row_offsets = row_offsets.data();
+    ok = find_indexes(buf.data(), buf.padded_size(), pcsv, dialect);
+    expect(string(k->name) + " kernel, rows", pcsv.error, ok);
+  }
+  active_kernel = saved;
+
+  // exactly len bytes, so that a sanitizer catches any read past them
+  vector<uint8_t> exact(data.begin(), data.end());
+  ParsedCSV unpadded;
+  unpadded.indexes = indexes.data();
+  unpadded.strict = true;
+  bool ok = find_indexes_unpadded(exact.data(), len, unpadded, dialect);
+  expect("find_indexes_unpadded", unpadded.error, ok);
+
+  for (size_t threads : {2, 4}) {
+    ParallelIndexer indexer(threads);
+    ParsedCSV pcsv;
+    pcsv.indexes = indexes.data();
+    pcsv.row_offsets = row_offsets.data();
+    pcsv.strict = true;
+    ok = indexer.find_indexes(buf.data(), buf.padded_size(), pcsv, dialect);
+    expect(to_string(threads) + " threads", pcsv.error, ok);
+  }
+
+  for (size_t window : {64, 192, 1 << 16}) {
+    StreamParser parser(window, [](const IndexBatch &) {}, dialect,
+                        CHECK_STRICT);
+    // fed in pieces that are not a multiple of the window
+    for (size_t i = 0; i < len; i += 1000) {
+      parser.feed(buf.data() + i, min<size_t>(1000, len - i));
+    }
+    parser.finish();
+    expect("stream, " + to_string(window) + "-byte windows", parser.error(),
+           parser.error().code == CSV_OK);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t n_inputs = 0;
+  for (int i = 1; i < argc; i++, n_inputs++) {
+    check(argv[i], load_file(argv[i]), Dialect(), StructureError());
+  }
+
+  Dialect crlf;
+  crlf.crlf = true;
+  // a record of two fields or more, malformed at byte 'at' of it (unless
+  // the code is CSV_OK), after records of two fields
+  const struct {
+    const char *name;
+    string record;
+    bool crlf;
+    CsvError code;
+    size_t at;
+    bool last; // nothing may follow the record
+  } cases[] = {
+      {"unterminated quote", "\"c,d\n", false, CSV_UNTERMINATED_QUOTE, 0, false},
+      {"unterminated quote, CR-LF", "\"c,d\r\n", true, CSV_UNTERMINATED_QUOTE, 0,
+       false},
+      {"stray quote", "c,d\"e\n", false, CSV_STRAY_QUOTE, 3, false},
+      {"text after a closing quote", "\"c\"x,d\n", false, CSV_TEXT_AFTER_QUOTE,
+       3, false},
+      {"ragged row, long", "c,d,e\n", false, CSV_RAGGED_ROW, 5, false},
+      {"ragged row, short", "c\n", false, CSV_RAGGED_ROW, 1, false},
+      {"ragged row, no line ending", "c", false, CSV_RAGGED_ROW, 1, true},
+      {"ragged row, CR-LF", "c,d,e\r\n", true, CSV_RAGGED_ROW, 6, false},
+      // in CR-LF dialects, a bare CR is field content, but not right after
+      // a closing quote
+      {"bare CR after a closing quote", "\"c\"\rd,e\r\n", true,
+       CSV_TEXT_AFTER_QUOTE, 3, false},
+      {"bare CR", "c\rd,e\r\n", true, CSV_OK, 0, false},
+      {"escaped quotes", "\"c\"\"\",\"\"\"d\"\n", false, CSV_OK, 0, false},
+      {"quoted line endings", "\"c\r\n\",\"\n\"\r\n", true, CSV_OK, 0, false},
+  };
+  for (const auto &c : cases) {
+    const Dialect &dialect = c.crlf ? crlf : Dialect();
+    // the prefixes putting the record across a block, a window, a chunk
+    // (a ragged record that comes first sets the field count instead)
+    vector<size_t> prefixes = {6};
+    if (c.code != CSV_RAGGED_ROW) {
+      prefixes.push_back(0);
+    }
+    for (size_t boundary : {64, 128, 192}) {
+      for (size_t d = 0; d < 8; d++) {
+        if (boundary - c.at + d >= 10) {
+          prefixes.push_back(boundary - c.at + d - 4);
+        }
+      }
+    }
+    const size_t suffix = 150000;
+    for (size_t n = suffix - 300; n < suffix + 300; n++) {
+      size_t total = n + c.record.size() + (c.last ? 0 : suffix);
+      size_t chunk = second_chunk(total);
+      if (n + c.at + 3 >= chunk && n + c.at <= chunk + 3) {
+        prefixes.push_back(n);
+      }
+    }
+    for (size_t n : prefixes) {
+      string data = records(n, dialect) + c.record;
+      if (!c.last) {
+        data += records(n < suffix - 1000 ? 300 : suffix, dialect);
+      }
+      StructureError expected;
+      expected.code = c.code;
+      expected.offset = n + c.at;
+      expected.row = n / 6;
+      check(string(c.name) + " after " + to_string(n) + " bytes", data,
+            dialect, expected);
+      n_inputs++;
+    }
+  }
+  return report(n_inputs);
+}
@@ -0,0 +1,153 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "parallel_indexer.h"
+#include "simd_kernels.h"
+#include "stream_parser.h"
+using namespace std;
+
+// UTF-8 validation (-u) must report the offset of the first byte of the first
+// ill-formed sequence, or none, the same way on every path: each kernel,
+// find_indexes_unpadded, the parallel indexer and StreamParser. The inputs
+// are ASCII CSV with a sequence written at a given offset: ill-formed ones
+// (overlong, a surrogate, a 4-byte sequence cut short at the end of the
+// input) and well- or ill-formed ones split across a 64-byte block, a
+// parallel chunk and a stream window.
+//
+// check_utf8 [<csvfile>...]
+
+// n bytes of ASCII fields and records
+static string ascii(size_t n) {
+  const string row = "abc,de,\"f,g\",h\n";
+  string s;
+  while (s.size() < n) {
+    s += row;
+  }
+  s.resize(n);
+  return s;
+}
+
+// ascii(n), with the sequence seq written at offset at
+static string with_sequence(size_t n, size_t at, const string &seq) {
+  return ascii(n).replace(at, seq.size(), seq);
+}
+
+// where the second of two chunks of the parallel indexer starts, for an
+// input of n bytes (see BasicParallelIndexer::find_indexes); with n a
+// multiple of 4, so does the third of four
+static size_t second_chunk(size_t n) { return ROUNDUP_N((n + 1) / 2, 64); }
+
+static string offset_name(size_t offset) {
+  return offset == SIZE_MAX ? "none" : to_string(offset);
+}
+
+static void check(const string &input, const string &data, size_t expected) {
+  Padded buf(data);
+  size_t len = buf.size();
+  vector<uint32_t> indexes(buf.padded_size());
+  vector<uint32_t> row_offsets(buf.padded_size() + 1);
+  auto expect = [&](const string &path, size_t found) {
+    if (found != expected) {
+      fail(input, path + ": the error is at " + offset_name(found) +
+                      ", not at " + offset_name(expected));
+    }
+  };
+
+  const Kernel *saved = active_kernel;
+  for (const Kernel *k : all_kernels()) {
+    if (!k->supported()) {
+      continue;
+    }
+    active_kernel = k;
+    ParsedCSV pcsv;
+    pcsv.indexes = indexes.data();
+    pcsv.validate_utf8 = true;
+    find_indexes(buf.data(), buf.padded_size(), pcsv);
+    expect(string(k->name) + " kernel", pcsv.utf8_error);
+    pcsv.row_offsets = row_offsets.data();
+    find_indexes(buf.data(), buf.padded_size(), pcsv);
+    expect(string(k->name) + " kernel, rows", pcsv.utf8_error);
+  }
+  active_kernel = saved;
+
+  // exactly len bytes, so that a sanitizer catches any read past them
+  vector<uint8_t> exact(data.begin(), data.end());
+  ParsedCSV unpadded;
+  unpadded.indexes = indexes.data();
+  unpadded.validate_utf8 = true;
+  find_indexes_unpadded(exact.data(), len, unpadded);
+  expect("find_indexes_unpadded", unpadded.utf8_error);
+
+  for (size_t threads : {2, 4}) {
+    ParallelIndexer indexer(threads);
+    ParsedCSV pcsv;
+    pcsv.indexes = indexes.data();
+    pcsv.validate_utf8 = true;
+    indexer.find_indexes(buf.data(), buf.padded_size(), pcsv);
+    expect(to_string(threads) + " threads", pcsv.utf8_error);
+  }
+
+  for (size_t window : {64, 192, 1 << 16}) {
+    StreamParser parser(window, [](const IndexBatch &) {}, Dialect(),
+                        CHECK_UTF8);
+    // fed in pieces that are not a multiple of the window
+    for (size_t i = 0; i < len; i += 1000) {
+      parser.feed(buf.data() + i, min<size_t>(1000, len - i));
+    }
+    parser.finish();
+    uint64_t found = parser.utf8_error();
+    expect("stream, " + to_string(window) + "-byte windows",
+           found == UINT64_MAX ? SIZE_MAX : found);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  size_t n_inputs = 0;
+  // the files given are valid UTF-8
+  for (int i = 1; i < argc; i++, n_inputs++) {
+    check(argv[i], load_file(argv[i]), SIZE_MAX);
+  }
+
+  const string emoji = "\xf0\x9f\x98\x80"; // U+1F600
+  const string cut = "\xf0\x9f\x98";       // the same, missing its last byte
+  const size_t big = 300000;               // two parallel chunks or more
+  const size_t chunk = second_chunk(big);
+  const struct {
+    const char *name;
+    string data;
+    size_t expected;
+  } cases[] = {
+      {"valid", with_sequence(100, 30, "\xc3\xa9" + emoji + "\xe2\x82\xac"),
+       SIZE_MAX},
+      {"overlong 2 bytes", with_sequence(100, 40, "\xc0\xaf"), 40},
+      {"overlong 3 bytes", with_sequence(100, 40, "\xe0\x80\xaf"), 40},
+      {"overlong 4 bytes", with_sequence(100, 40, "\xf0\x80\x80\xaf"), 40},
+      {"surrogate", with_sequence(100, 40, "\xed\xa0\x80"), 40},
+      {"past U+10FFFF", with_sequence(100, 40, "\xf4\x90\x80\x80"), 40},
+      {"lone continuation byte", with_sequence(100, 40, "\x80"), 40},
+      {"cut short at the end", ascii(61) + cut, 61},
+      {"cut short at the end of a block", ascii(125) + cut, 125},
+      {"cut short at the end, 2 bytes of 3", ascii(70) + "\xe2\x82", 70},
+      {"cut short before a line ending", with_sequence(100, 40, cut), 40},
+      {"split across a block", with_sequence(200, 62, emoji), SIZE_MAX},
+      {"cut short across a block", with_sequence(200, 62, cut), 62},
+      {"surrogate across a block", with_sequence(200, 63, "\xed\xa0\x80"), 63},
+      {"split across a window", with_sequence(400, 190, emoji), SIZE_MAX},
+      {"cut short across a window", with_sequence(400, 190, cut), 190},
+      {"split across a chunk", with_sequence(big, chunk - 2, emoji), SIZE_MAX},
+      {"cut short across a chunk", with_sequence(big, chunk - 2, cut),
+       chunk - 2},
+      {"overlong across a chunk", with_sequence(big, chunk - 1, "\xe0\x80\xaf"),
+       chunk - 1},
+      {"the first of two", with_sequence(big, chunk + 5, "\xc0\xaf").replace(
+                               1000, 3, "\xed\xa0\x80"),
+       1000},
+  };
+  for (const auto &c : cases) {
+    check(c.name, c.data, c.expected);
+    n_inputs++;
+  }
+  return report(n_inputs);
+}